@@ -1,84 +1,62 @@
-import { useState, useEffect } from 'react';
+import { useState, useEffect, useMemo } from 'react';
 import { Link, useNavigate } from 'react-router-dom';
-import { useAuth } from '../context/AuthContext';
 import '../styles/PostCard.css';
 
 function PostCard({ post, lockInfo, onEdit, onEditComplete }) {
-  const { user } = useAuth();
   const navigate = useNavigate();
-  const [previewSrc, setPreviewSrc] = useState('');
-  const [creator, setCreator] = useState(null);
   const [remainingTime, setRemainingTime] = useState(null);
 
-  useEffect(() => {
-    const fetchPostDetails = async () => {
-      try {
-        const headers = user?.token ? {
-          "Authorization": `Bearer ${user.token}`
-        } : {};
-
-        const [postResponse, creatorResponse] = await Promise.all([
-          fetch(`http://localhost:18080/posts/${post.id}`, { headers }),
-          fetch(`http://localhost:18080/posts/${post.id}/creator`, { headers })
-        ]);
+  // The feed already carries a bounded preview of the code, so the card
+  // renders without fetching the full post or its creator
+  const previewSrc = useMemo(() => {
+    const preview = post.preview;
+    if (!preview) return '';
 
-        if (postResponse.ok) {
-          const data = await postResponse.json();
-          const previewDoc = `
-            <!DOCTYPE html>
-            <html>
-              <head>
-                <base target="_blank">
-                <meta charset="utf-8">
-                <meta name="viewport" content="width=device-width, initial-scale=1.0">
-                <style>
-                  html, body {
-                    margin: 0;
-                    padding: 0;
-                    height: 100%;
-                    width: 100%;
-                    overflow: hidden;
-                  }
-                  .preview-container {
-                    width: 100%;
-                    height: 100%;
-                    display: flex;
-                    align-items: center;
-                    justify-content: center;
-                    transform-origin: center;
-                    transform: scale(0.8);
-                  }
-                  /* Inject user CSS directly */
-                  ${data.css_code}
-                </style>
-              </head>
-              <body>
-                <div class="preview-container">
-                  ${data.html_code}
-                </div>
-                <script type="text/javascript">
-                  // Wrap JS in IIFE to avoid global scope pollution
-                  (function() {
-                    ${data.js_code}
-                  })();
-                </script>
-              </body>
-            </html>
-          `;
-          setPreviewSrc(previewDoc);
-        }
+    // A cut-off script would only throw a syntax error, so skip it
+    const jsCode = preview.truncated ? '' : preview.js_code;
 
-        if (creatorResponse.ok) {
-          const creatorData = await creatorResponse.json();
-          setCreator(creatorData);
-        }
-      } catch (error) {
-        console.error("Error fetching post details:", error);
-      }
-    };
-    
-    fetchPostDetails();
-  }, [post.id, user]);
+    return `
+      <!DOCTYPE html>
+      <html>
+        <head>
+          <base target="_blank">
+          <meta charset="utf-8">
+          <meta name="viewport" content="width=device-width, initial-scale=1.0">
+          <style>
+            html, body {
+              margin: 0;
+              padding: 0;
+              height: 100%;
+              width: 100%;
+              overflow: hidden;
+            }
+            .preview-container {
+              width: 100%;
+              height: 100%;
+              display: flex;
+              align-items: center;
+              justify-content: center;
+              transform-origin: center;
+              transform: scale(0.8);
+            }
+            /* Inject user CSS directly */
+            ${preview.css_code}
+          </style>
+        </head>
+        <body>
+          <div class="preview-container">
+            ${preview.html_code}
+          </div>
+          <script type="text/javascript">
+            // Wrap JS in IIFE to avoid global scope pollution
+            (function() {
+              ${jsCode}
+            })();
+          </script>
+        </body>
+      </html>
+    `;
+  }, [post.preview]);
 
   useEffect(() => {
     let timer;
@@ -174,9 +152,9 @@ function PostCard({ post, lockInfo, onEdit, onEditComplete }) {
               </span>
             )}
           </h3>
-          {creator && (
+          {post.username && (
             <p className="post-creator">
-              Created by <span className="creator-name">{creator.username}</span>
+              Created by <span className="creator-name">{post.username}</span>
             </p>
           )}
           <div className="post-dates">
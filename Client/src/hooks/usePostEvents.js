@@ -0,0 +1,72 @@
+import { useEffect, useRef } from "react";
+
+const WS_URL = "ws://localhost:18080/ws";
+const MAX_RECONNECT_DELAY = 30000;
+
+/**
+ * Subscribes to live lock and post events for a single post.
+ *
+ * onEvent receives every message for the post: the initial "subscribed"
+ * snapshot of the lock state, then "lock" and "post" events as they happen.
+ * The socket reconnects with exponential backoff and resubscribes, and the
+ * snapshot is resent after each reconnect.
+ */
+export function usePostEvents(postId, token, onEvent) {
+  const onEventRef = useRef(onEvent);
+  onEventRef.current = onEvent;
+
+  useEffect(() => {
+    let socket = null;
+    let reconnectTimer = null;
+    let attempts = 0;
+    let closed = false;
+
+    const connect = () => {
+      socket = new WebSocket(WS_URL);
+
+      socket.onopen = () => {
+        attempts = 0;
+        socket.send(
+          JSON.stringify({
+            action: "subscribe",
+            post_id: parseInt(postId),
+            ...(token ? { token } : {}),
+          })
+        );
+      };
+
+      socket.onmessage = (message) => {
+        let data;
+        try {
+          data = JSON.parse(message.data);
+        } catch {
+          return;
+        }
+        if (data.type === "error") {
+          console.error("Post events:", data.message);
+          return;
+        }
+        if (data.post_id === parseInt(postId)) {
+          onEventRef.current(data);
+        }
+      };
+
+      socket.onclose = () => {
+        if (closed) return;
+        const delay = Math.min(1000 * 2 ** attempts, MAX_RECONNECT_DELAY);
+        attempts += 1;
+        reconnectTimer = setTimeout(connect, delay);
+      };
+    };
+
+    connect();
+
+    return () => {
+      closed = true;
+      clearTimeout(reconnectTimer);
+      if (socket) {
+        socket.close();
+      }
+    };
+  }, [postId, token]);
+}
@@ -5,6 +5,40 @@ import ResizablePreview from "../components/ResizablePreview";
 import "../styles/CreatePost.css";
 import "../styles/common.css";
 import { useAuth } from "../context/AuthContext";
+import { usePostEvents } from "../hooks/usePostEvents";
+
+const utf8 = new TextEncoder();
+
+// The smallest single edit that turns `from` into `to`, in the form PATCH
+// /posts/<id> takes: offsets and lengths in UTF-8 bytes. Null if unchanged.
+function textEdits(from, to) {
+  if (from === to) return null;
+
+  const limit = Math.min(from.length, to.length);
+  let prefix = 0;
+  while (prefix < limit && from[prefix] === to[prefix]) prefix++;
+  // Never cut a surrogate pair in two
+  const high = from.charCodeAt(prefix - 1);
+  if (prefix > 0 && high >= 0xd800 && high <= 0xdbff) prefix--;
+
+  let suffix = 0;
+  while (
+    suffix < limit - prefix &&
+    from[from.length - 1 - suffix] === to[to.length - 1 - suffix]
+  ) {
+    suffix++;
+  }
+  const low = from.charCodeAt(from.length - suffix);
+  if (suffix > 0 && low >= 0xdc00 && low <= 0xdfff) suffix--;
+
+  return [
+    {
+      at: utf8.encode(from.slice(0, prefix)).length,
+      delete: utf8.encode(from.slice(prefix, from.length - suffix)).length,
+      insert: to.slice(prefix, to.length - suffix),
+    },
+  ];
+}
 
 function EditPost() {
   const navigate = useNavigate();
@@ -20,7 +54,9 @@ function EditPost() {
   const [loading, setLoading] = useState(true);
   const [isOwner, setIsOwner] = useState(false);
   const hasActiveLock = useRef(false);
-  const lockCheckRef = useRef(null);
+  const savingRef = useRef(false);
+  // The version loaded from the server, which saves are diffed against
+  const baseRef = useRef(null);
   const [inactiveTime, setInactiveTime] = useState(0);
   const lastActivityRef = useRef(Date.now());
 
@@ -61,6 +97,13 @@ function EditPost() {
         }
 
         const data = await response.json();
+        baseRef.current = {
+          version: data.version ?? 0,
+          title: data.title,
+          htmlCode: data.html_code || "",
+          cssCode: data.css_code || "",
+          jsCode: data.js_code || "",
+        };
         setTitle(data.title);
         setHtmlCode(data.html_code);
         setCssCode(data.css_code);
@@ -76,40 +119,33 @@ function EditPost() {
 
     verifyLockAndLoadPost();
 
-    lockCheckRef.current = setInterval(async () => {
-      if (!hasActiveLock.current) return;
-
-      try {
-        const response = await fetch(
-          `http://localhost:18080/posts/${postId}/lock`,
-          {
-            headers: { Authorization: `Bearer ${user.token}` },
-          }
-        );
-
-        const data = await response.json();
-        if (!response.ok || !data.locked || !data.is_lock_holder) {
-          if (lockCheckRef.current) {
-            clearInterval(lockCheckRef.current);
-          }
-          hasActiveLock.current = false;
-          navigate(`/posts/${postId}`);
-        }
-      } catch (error) {
-        console.error("Error verifying lock:", error);
-      }
-    }, 30000);
-
     return () => {
-      if (lockCheckRef.current) {
-        clearInterval(lockCheckRef.current);
-      }
       if (hasActiveLock.current) {
         releaseLock();
       }
     };
   }, [postId, user.token, navigate]);
 
+  // Leave the editor as soon as the server reports that our lock is gone
+  usePostEvents(postId, user.token, (event) => {
+    if (!hasActiveLock.current || savingRef.current) return;
+
+    const userId = parseInt(user.userId);
+    const lostLock =
+      (event.type === "subscribed" &&
+        (!event.locked || event.user_id !== userId)) ||
+      (event.type === "lock" &&
+        (event.event === "expired" ||
+          event.event === "released" ||
+          event.user_id !== userId)) ||
+      (event.type === "post" && event.event === "deleted");
+
+    if (lostLock) {
+      hasActiveLock.current = false;
+      navigate(event.event === "deleted" ? "/" : `/posts/${postId}`);
+    }
+  });
+
   const releaseLock = async () => {
     if (!hasActiveLock.current) return;
 
@@ -174,26 +210,46 @@ function EditPost() {
   const handleSave = async () => {
     if (isSaving) return;
     setIsSaving(true);
+    savingRef.current = true;
     setSaveStatus(null);
 
     try {
+      // Send only what changed since the version we loaded
+      const base = baseRef.current;
+      const changes = {
+        base_version: base.version,
+        isPrivate,
+        release_lock: true,
+      };
+      if (title !== base.title) changes.title = title;
+      const fields = [
+        ["html_code", base.htmlCode, htmlCode],
+        ["css_code", base.cssCode, cssCode],
+        ["js_code", base.jsCode, jsCode],
+      ];
+      for (const [field, before, after] of fields) {
+        const edits = textEdits(before, after);
+        if (edits) changes[field] = edits;
+      }
+
       const response = await fetch(`http://localhost:18080/posts/${postId}`, {
-        method: "PUT",
+        method: "PATCH",
         headers: {
           "Content-Type": "application/json",
           Authorization: `Bearer ${user.token}`,
         },
-        body: JSON.stringify({
-          title,
-          html_code: htmlCode,
-          css_code: cssCode,
-          js_code: jsCode,
-          isPrivate,
-        }),
+        body: JSON.stringify(changes),
       });
 
-      if (response.ok) {
-        await releaseLock();
+      if (response.status === 409) {
+        setSaveStatus({
+          success: false,
+          message:
+            "This post was changed elsewhere since you opened it. Reload to get the latest version.",
+        });
+      } else if (response.ok) {
+        // The server releases our lock once the update has committed
+        hasActiveLock.current = false;
         setSaveStatus({
           success: true,
           message: "Post updated successfully",
@@ -212,6 +268,7 @@ function EditPost() {
       });
     } finally {
       setIsSaving(false);
+      savingRef.current = false;
     }
   };
 
@@ -4,6 +4,8 @@ import PostCard from "../components/PostCard";
 import "../styles/common.css";
 import "../styles/HomePage.css";
 
+const PAGE_SIZE = 20;
+
 const formatDate = (dateString) => {
   return new Date(dateString).toLocaleDateString("en-US", {
     year: "numeric",
@@ -17,6 +19,8 @@ function HomePage() {
   const [posts, setPosts] = useState([]);
   const [loading, setLoading] = useState(true);
   const [error, setError] = useState(null);
+  const [nextCursor, setNextCursor] = useState(null);
+  const [loadingMore, setLoadingMore] = useState(false);
   const [lockedPosts, setLockedPosts] = useState(new Map());
 
   // Debug: Verify authentication status when component mounts
@@ -33,24 +37,36 @@ function HomePage() {
     }
   }, [user]);
 
+  // Fetch one page of the feed (posts with creator and code preview);
+  // pass the cursor from the previous page to continue
+  const fetchPostsPage = async (cursor) => {
+    const headers = {};
+    if (user?.token) {
+      headers["Authorization"] = `Bearer ${user.token}`;
+    }
+
+    const params = new URLSearchParams({ limit: PAGE_SIZE });
+    if (cursor) {
+      params.set("cursor", cursor);
+    }
+
+    const response = await fetch(`http://localhost:18080/feed?${params}`, {
+      headers,
+    });
+
+    if (!response.ok) {
+      throw new Error(`Error: ${response.status}`);
+    }
+    return response.json();
+  };
+
   useEffect(() => {
     const fetchPosts = async () => {
       try {
         setLoading(true);
-        const headers = {};
-        if (user?.token) {
-          headers["Authorization"] = `Bearer ${user.token}`;
-        }
-
-        const response = await fetch("http://localhost:18080/posts", {
-          headers,
-        });
-
-        if (!response.ok) {
-          throw new Error(`Error: ${response.status}`);
-        }
-        const data = await response.json();
+        const data = await fetchPostsPage(null);
         setPosts(data.posts || []);
+        setNextCursor(data.has_more ? data.next_cursor : null);
         setError(null);
       } catch (err) {
         setError("Failed to load posts. Please try again later.");
@@ -63,6 +79,21 @@ function HomePage() {
     fetchPosts();
   }, [user]);
 
+  const loadMorePosts = async () => {
+    if (!nextCursor || loadingMore) return;
+
+    try {
+      setLoadingMore(true);
+      const data = await fetchPostsPage(nextCursor);
+      setPosts((prev) => [...prev, ...(data.posts || [])]);
+      setNextCursor(data.has_more ? data.next_cursor : null);
+    } catch (err) {
+      console.error("Error fetching more posts:", err);
+    } finally {
+      setLoadingMore(false);
+    }
+  };
+
   const acquireLock = async (postId) => {
     if (!user?.token) return false;
 
@@ -272,6 +303,17 @@ function HomePage() {
                 />
               ))}
             </div>
+            {nextCursor && (
+              <div className="load-more-container">
+                <button
+                  className="button secondary-button"
+                  onClick={loadMorePosts}
+                  disabled={loadingMore}
+                >
+                  {loadingMore ? "Loading..." : "Load more"}
+                </button>
+              </div>
+            )}
           </div>
         )}
       </div>
@@ -4,6 +4,7 @@ import { useAuth } from "../context/AuthContext";
 import EditorPane from "../components/EditorPane";
 import ResizablePreview from "../components/ResizablePreview";
 import DeleteConfirmModal from "../components/DeleteConfirmModal";
+import { usePostEvents } from "../hooks/usePostEvents";
 import "../styles/ViewPost.css";
 import "../styles/common.css";
 
@@ -18,6 +19,7 @@ function ViewPost() {
   const [creator, setCreator] = useState(null);
   const [showDeleteModal, setShowDeleteModal] = useState(false);
   const [lockInfo, setLockInfo] = useState(null);
+  const [refreshKey, setRefreshKey] = useState(0);
 
   useEffect(() => {
     const fetchPostData = async () => {
@@ -59,36 +61,32 @@ function ViewPost() {
     };
 
     fetchPostData();
-  }, [postId, user]);
-
-  useEffect(() => {
-    const checkLockStatus = async () => {
-      try {
-        const response = await fetch(
-          `http://localhost:18080/posts/${postId}/lock`,
-          {
-            headers: user?.token
-              ? {
-                  Authorization: `Bearer ${user.token}`,
-                }
-              : {},
-          }
-        );
-
-        if (response.ok) {
-          const data = await response.json();
-          setLockInfo(data);
-        }
-      } catch (err) {
-        console.error("Error checking lock status:", err);
-      }
-    };
-
-    const interval = setInterval(checkLockStatus, 5000); // Check every 5 seconds
-    checkLockStatus(); // Initial check
-
-    return () => clearInterval(interval);
-  }, [postId, user]);
+  }, [postId, user, refreshKey]);
+
+  // Lock state and edits by other users are pushed by the server
+  usePostEvents(postId, user?.token, (event) => {
+    if (event.type === "subscribed" || event.type === "lock") {
+      const locked =
+        event.type === "subscribed"
+          ? event.locked
+          : event.event === "acquired" || event.event === "extended";
+      setLockInfo(
+        locked
+          ? {
+              locked: true,
+              user_id: event.user_id,
+              username: event.username,
+              is_lock_holder: parseInt(user?.userId) === event.user_id,
+            }
+          : { locked: false }
+      );
+    } else if (event.type === "post" && event.event === "updated") {
+      setRefreshKey((key) => key + 1);
+    } else if (event.type === "post" && event.event === "deleted") {
+      setError("This post has been deleted");
+      setPost(null);
+    }
+  });
 
   const handleEditClick = async (e) => {
     e.preventDefault();
@@ -158,34 +156,16 @@ function ViewPost() {
     }
 
     try {
-      // First get the current post data
-      const response = await fetch(`http://localhost:18080/posts/${postId}`, {
-        headers: {
-          Authorization: `Bearer ${user.token}`,
-        },
-      });
-
-      if (!response.ok) {
-        throw new Error(await response.text());
-      }
-
-      const postData = await response.json();
-
-      // Create new post using existing data
-      const forkResponse = await fetch("http://localhost:18080/posts", {
-        method: "POST",
-        headers: {
-          "Content-Type": "application/json",
-          Authorization: `Bearer ${user.token}`,
-        },
-        body: JSON.stringify({
-          title: `${postData.title} (Fork)`,
-          html_code: postData.html_code || "",
-          css_code: postData.css_code || "",
-          js_code: postData.js_code || "",
-          isPrivate: false, // Default to public for forked posts
-        }),
-      });
+      // The server copies the post itself; nothing but the new id comes back
+      const forkResponse = await fetch(
+        `http://localhost:18080/posts/${postId}/fork`,
+        {
+          method: "POST",
+          headers: {
+            Authorization: `Bearer ${user.token}`,
+          },
+        }
+      );
 
       if (!forkResponse.ok) {
         const errorText = await forkResponse.text();
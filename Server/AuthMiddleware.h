@@ -1,10 +1,11 @@
 #pragma once
 
 #include "crow.h"
+#include "TokenSigner.h"
+#include "Metrics.h"
 #include <string>
-#include <unordered_map>
-#include <mutex>
-#include <ctime>
+#include <vector>
+#include <chrono>
 
 /**
  * @class AuthMiddleware
@@ -13,75 +14,83 @@
  * This class provides basic authentication functionality through token management.
  * It allows endpoints to verify user identity and restrict access to authenticated users.
  * 
+ * Tokens are stateless HMAC-signed claims (see TokenSigner), so validating one
+ * touches no shared state and any process holding the same keys accepts it.
  */
 class AuthMiddleware {
 private:
-    // Maps authentication tokens to user IDs
-    std::unordered_map<std::string, int> userTokens;
+    // Signs and verifies authentication tokens
+    TokenSigner signer;
     
-    // Mutex to protect concurrent access to the tokens map
-    std::mutex tokenMutex;
+    Metrics::Counter issued = Metrics::instance().counter(
+        "auth_tokens_issued_total", "Authentication tokens issued at login");
+    Metrics::Counter accepted = Metrics::instance().counter(
+        "auth_token_checks_total", "Presented authentication tokens by outcome", "result=\"valid\"");
+    Metrics::Counter refused = Metrics::instance().counter(
+        "auth_token_checks_total", "Presented authentication tokens by outcome", "result=\"invalid\"");
+    
+    int verify(const std::string& token) {
+        int userId = signer.verify(token);
+        Metrics::increment(userId == -1 ? refused : accepted);
+        return userId;
+    }
 
 public:
+    // Default lifetime of an issued token
+    static constexpr std::chrono::hours DEFAULT_TOKEN_TTL{24};
+
+    /**
+     * @param keys Token signing keys, the active one first
+     * @param tokenTtl How long a token stays valid after login
+     */
+    explicit AuthMiddleware(std::vector<TokenSigner::Key> keys,
+                            std::chrono::seconds tokenTtl = DEFAULT_TOKEN_TTL)
+        : signer(std::move(keys), tokenTtl) {}
+
     /**
-     * Verifies if the request has valid authentication
+     * Validates the request's authentication and resolves its user
      * 
-     * Checks for the presence of a valid Bearer token in the Authorization header
-     * and verifies it against stored tokens.
+     * Checks for a Bearer token in the Authorization header and verifies it
+     * once, so handlers need a single call to both authenticate the request
+     * and learn who made it.
      * 
      * @param req The HTTP request to authenticate
-     * @return true if the request has valid authentication, false otherwise
+     * @return The user ID if the request carries a valid token, -1 otherwise
      */
-    bool authenticate(const crow::request& req) {
+    int resolveUserId(const crow::request& req) {
         // Extract the Authorization header
-        std::string authHeader = req.get_header_value("Authorization");
-        
+        const std::string& authHeader = req.get_header_value("Authorization");
+
         // Check if header exists and has the Bearer prefix
-        if (authHeader.empty() || authHeader.substr(0, 7) != "Bearer ") {
-            return false;
+        if (authHeader.size() <= 7 || authHeader.compare(0, 7, "Bearer ") != 0) {
+            return -1;
         }
-        
-        // Extract the token
-        std::string token = authHeader.substr(7);
-        
-        // Check if token exists in our map
-        std::lock_guard<std::mutex> lock(tokenMutex);
-        return userTokens.find(token) != userTokens.end();
+
+        return verify(authHeader.substr(7));
     }
-    
+
     /**
-     * Gets the user ID associated with the token in the request
+     * Gets the user ID associated with a bare token
+     * 
+     * Used where there is no Authorization header, such as WebSocket messages.
      * 
-     * @param req The HTTP request containing the authentication token
+     * @param token The authentication token
      * @return The user ID if valid token, -1 otherwise
      */
-    int getUserId(const crow::request& req) {
-        std::string authHeader = req.get_header_value("Authorization");
-        if (authHeader.empty() || authHeader.substr(0, 7) != "Bearer ") {
-            return -1;
-        }
-        
-        std::string token = authHeader.substr(7);
-        std::lock_guard<std::mutex> lock(tokenMutex);
-        auto it = userTokens.find(token);
-        return (it != userTokens.end()) ? it->second : -1;
+    int getUserIdForToken(const std::string& token) {
+        return verify(token);
     }
-    
+
     /**
      * Generates a new authentication token for a user
      * 
-     * Creates a simple token based on timestamp and user ID.
+     * The token carries the user ID and its expiry, signed with the active key.
      * 
      * @param userId The user ID to associate with the token
      * @return The generated token string
      */
     std::string generateToken(int userId) {
-        // Simple token generation - timestamp + user ID
-        std::string token = std::to_string(std::time(nullptr)) + "_" + std::to_string(userId);
-        
-        // Store the token in our map
-        std::lock_guard<std::mutex> lock(tokenMutex);
-        userTokens[token] = userId;
-        return token;
+        Metrics::increment(issued);
+        return signer.issue(userId);
     }
 };
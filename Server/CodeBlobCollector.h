@@ -0,0 +1,116 @@
+#pragma once
+#include "sqlite3.h"
+#include "WriteQueue.h"
+#include "Metrics.h"
+#include "Logger.h"
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <atomic>
+#include <cstdint>
+
+/**
+ * Background thread that deletes code blobs no post refers to any more
+ *
+ * Deletion goes through the write queue like any other write, in batches
+ * of at most batchSize blobs, so collecting a large backlog never holds the
+ * writer for long. A blob is only ever unreferenced between the commit
+ * that dropped its last reference and the next collection.
+ */
+class CodeBlobCollector {
+private:
+    WriteQueue& writeQueue;
+    std::chrono::milliseconds interval;
+    int batchSize;
+
+    std::thread worker;
+    std::mutex mtx;
+    std::condition_variable wakeup;
+    bool stopping = false;
+
+    Metrics::Counter collected = Metrics::instance().counter(
+        "code_blobs_collected_total", "Unreferenced code blobs deleted");
+
+    void run() {
+        std::unique_lock<std::mutex> lock(mtx);
+        while (!wakeup.wait_for(lock, interval, [this] { return stopping; })) {
+            lock.unlock();
+            // Keep going while batches come back full
+            while (collect() == batchSize) {
+                lock.lock();
+                bool stop = stopping;
+                lock.unlock();
+                if (stop) {
+                    return;
+                }
+            }
+            lock.lock();
+        }
+    }
+
+    // Deletes one batch; returns the number of blobs deleted, or -1 on failure
+    int collect() {
+        int deleted = 0;
+        bool success = writeQueue.execute([this, &deleted](ConnectionPool::Lease& conn) -> bool {
+            sqlite3* db = conn.get();
+            CachedStatement stmt = conn.prepare(
+                "DELETE FROM code_blobs WHERE hash IN "
+                "(SELECT hash FROM code_blobs WHERE refcount = 0 LIMIT ?)");
+            if (!stmt) {
+                Logger::instance().error("code_blob_gc_failed", {{"error", sqlite3_errmsg(db)}});
+                return false;
+            }
+            sqlite3_bind_int(stmt, 1, batchSize);
+            if (sqlite3_step(stmt) != SQLITE_DONE) {
+                Logger::instance().error("code_blob_gc_failed", {{"error", sqlite3_errmsg(db)}});
+                return false;
+            }
+            deleted = sqlite3_changes(db);
+            return true;
+        });
+
+        if (!success) {
+            return -1;
+        }
+        if (deleted > 0) {
+            Metrics::increment(collected, static_cast<uint64_t>(deleted));
+            Logger::instance().debug("code_blobs_collected", {{"count", deleted}});
+        }
+        return deleted;
+    }
+
+public:
+    /**
+     * @param writeQueue Queue the deletes are submitted to; must outlive the collector
+     * @param interval Time between collections
+     * @param batchSize Most blobs deleted in one write
+     */
+    CodeBlobCollector(WriteQueue& writeQueue, std::chrono::milliseconds interval, int batchSize = 500)
+        : writeQueue(writeQueue), interval(interval), batchSize(batchSize > 0 ? batchSize : 1) {}
+
+    ~CodeBlobCollector() {
+        stop();
+    }
+
+    CodeBlobCollector(const CodeBlobCollector&) = delete;
+    CodeBlobCollector& operator=(const CodeBlobCollector&) = delete;
+
+    void start() {
+        worker = std::thread(&CodeBlobCollector::run, this);
+    }
+
+    /**
+     * Joins the thread; safe to call more than once
+     */
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            stopping = true;
+        }
+        wakeup.notify_all();
+        if (worker.joinable()) {
+            worker.join();
+        }
+    }
+};
@@ -0,0 +1,59 @@
+#pragma once
+#include "sqlite3.h"
+#include <openssl/sha.h>
+#include <string>
+
+/**
+ * Content addressing for post code
+ *
+ * The HTML, CSS and JS of a post are stored once per distinct content in
+ * the code_blobs table, keyed by the SHA-256 of the text, and posts only
+ * hold the three hashes. A fork, or a save that leaves a field as it was,
+ * writes a hash that already exists and costs no extra bytes. Hashes are
+ * raw 32-byte BLOBs rather than hex, which halves what each reference
+ * costs in posts and in the blob index.
+ *
+ * Each blob counts the post columns that point at it; triggers on posts
+ * keep the count exact (see schema migration 5). Blobs whose count drops
+ * to zero are not deleted inline but left for CodeBlobCollector, so a
+ * blob that is unreferenced for a moment (an edit undone by the next save)
+ * is not deleted and rewritten.
+ *
+ * Listings that show code only need its start. code_previews keeps the
+ * first CODE_PREVIEW_CHARS characters and the full length of every blob,
+ * written by a trigger when the blob is stored, so a feed page never reads
+ * whole code bodies.
+ */
+
+// Characters of each blob kept in code_previews for the feed. The triggers
+// of schema migration 9 bake the value in, so changing it needs a migration.
+constexpr int CODE_PREVIEW_CHARS = 4096;
+
+/**
+ * Returns the content hash of a code body: the raw 32-byte SHA-256 digest
+ *
+ * Bind it with sqlite3_bind_blob; as TEXT it would never match.
+ */
+inline std::string codeHash(const std::string& content) {
+    unsigned char digest[SHA256_DIGEST_LENGTH];
+    SHA256(reinterpret_cast<const unsigned char*>(content.data()), content.size(), digest);
+    return std::string(reinterpret_cast<const char*>(digest), sizeof(digest));
+}
+
+/**
+ * Registers code_hash(text) on a connection, for SQL that hashes existing rows
+ *
+ * NULL hashes like the empty string, matching how the routes treat a
+ * missing code field.
+ */
+inline bool registerCodeHashFunction(sqlite3* db) {
+    auto function = [](sqlite3_context* context, int /*argc*/, sqlite3_value** argv) {
+        const unsigned char* text = sqlite3_value_text(argv[0]);
+        std::string content = text ? std::string(reinterpret_cast<const char*>(text),
+                                                 sqlite3_value_bytes(argv[0])) : "";
+        std::string hash = codeHash(content);
+        sqlite3_result_blob(context, hash.data(), static_cast<int>(hash.size()), SQLITE_TRANSIENT);
+    };
+    return sqlite3_create_function_v2(db, "code_hash", 1, SQLITE_UTF8 | SQLITE_DETERMINISTIC,
+                                      nullptr, function, nullptr, nullptr, nullptr) == SQLITE_OK;
+}
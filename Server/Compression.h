@@ -0,0 +1,158 @@
+#pragma once
+#include <zlib.h>
+#include <brotli/encode.h>
+#include <algorithm>
+#include <string>
+#include <cstdlib>
+#include <cstdint>
+#include <cctype>
+
+/**
+ * HTTP content codings supported for response bodies
+ *
+ * The numeric values index CachedPost::encoded, so Identity must stay last.
+ */
+enum class ContentEncoding {
+    Brotli = 0,
+    Gzip = 1,
+    Deflate = 2,
+    Identity = 3
+};
+
+constexpr size_t CONTENT_ENCODING_COUNT = 3;  // Encodings other than Identity
+
+// Bodies smaller than this are sent uncompressed; the framing overhead
+// and CPU cost outweigh the savings on tiny payloads
+constexpr size_t COMPRESSION_MIN_BYTES = 1024;
+
+// Name of the coding as used in Accept-Encoding / Content-Encoding headers
+inline const char* contentEncodingName(ContentEncoding encoding) {
+    switch (encoding) {
+        case ContentEncoding::Brotli: return "br";
+        case ContentEncoding::Gzip: return "gzip";
+        case ContentEncoding::Deflate: return "deflate";
+        default: return "identity";
+    }
+}
+
+/**
+ * Picks the best supported coding from an Accept-Encoding header
+ *
+ * The coding with the highest q-value wins; ties prefer br, then gzip,
+ * then deflate. Codings with q=0 are refused. "*" gives its q-value to
+ * every coding the header does not name (RFC 9110), so "gzip;q=0, *"
+ * still refuses gzip.
+ *
+ * @param acceptEncoding The raw Accept-Encoding header value
+ * @return The chosen coding, or Identity if none is acceptable
+ */
+inline ContentEncoding negotiateEncoding(const std::string& acceptEncoding) {
+    double bestQ[CONTENT_ENCODING_COUNT] = {-1, -1, -1};
+    double wildcardQ = -1;
+
+    size_t start = 0;
+    while (start < acceptEncoding.size()) {
+        size_t end = acceptEncoding.find(',', start);
+        if (end == std::string::npos) {
+            end = acceptEncoding.size();
+        }
+        std::string item = acceptEncoding.substr(start, end - start);
+        start = end + 1;
+
+        // Split "coding;q=value"
+        double q = 1.0;
+        size_t params = item.find(';');
+        std::string coding = item.substr(0, params);
+        if (params != std::string::npos) {
+            size_t qPos = item.find("q=", params);
+            if (qPos != std::string::npos) {
+                q = std::atof(item.c_str() + qPos + 2);
+            }
+        }
+
+        // Trim and lowercase the coding name
+        std::string name;
+        for (char c : coding) {
+            if (!std::isspace(static_cast<unsigned char>(c))) {
+                name += static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+            }
+        }
+
+        int index = -1;
+        if (name == "br") index = static_cast<int>(ContentEncoding::Brotli);
+        else if (name == "gzip" || name == "x-gzip") index = static_cast<int>(ContentEncoding::Gzip);
+        else if (name == "deflate") index = static_cast<int>(ContentEncoding::Deflate);
+        else if (name == "*") wildcardQ = std::max(wildcardQ, q);
+
+        if (index >= 0 && q > bestQ[index]) {
+            bestQ[index] = q;
+        }
+    }
+
+    // Codings named explicitly keep their own q-value, even q=0
+    for (double& q : bestQ) {
+        if (q < 0) {
+            q = wildcardQ;
+        }
+    }
+
+    int best = -1;
+    for (int i = 0; i < static_cast<int>(CONTENT_ENCODING_COUNT); i++) {
+        if (bestQ[i] > 0 && (best < 0 || bestQ[i] > bestQ[best])) {
+            best = i;
+        }
+    }
+    return best < 0 ? ContentEncoding::Identity : static_cast<ContentEncoding>(best);
+}
+
+/**
+ * Compresses a body with the given coding
+ *
+ * @param input The uncompressed body
+ * @param encoding The coding to apply (must not be Identity)
+ * @param output Receives the compressed bytes
+ * @param thorough Spend more CPU for a smaller result; meant for bodies
+ *                 that are cached and served many times
+ * @return true on success, false if compression failed
+ */
+inline bool compressBody(const std::string& input, ContentEncoding encoding, std::string& output, bool thorough = false) {
+    if (encoding == ContentEncoding::Brotli) {
+        size_t encodedSize = BrotliEncoderMaxCompressedSize(input.size());
+        if (encodedSize == 0) {
+            return false;
+        }
+        output.resize(encodedSize);
+
+        int quality = thorough ? 9 : 5;
+        if (!BrotliEncoderCompress(quality, BROTLI_DEFAULT_WINDOW, BROTLI_MODE_TEXT,
+                                   input.size(), reinterpret_cast<const uint8_t*>(input.data()),
+                                   &encodedSize, reinterpret_cast<uint8_t*>(&output[0]))) {
+            return false;
+        }
+        output.resize(encodedSize);
+        return true;
+    }
+
+    if (encoding != ContentEncoding::Gzip && encoding != ContentEncoding::Deflate) {
+        return false;
+    }
+
+    z_stream stream{};
+    // windowBits 15 produces the zlib format HTTP calls "deflate"; +16 adds the gzip wrapper
+    int windowBits = encoding == ContentEncoding::Gzip ? 15 + 16 : 15;
+    int level = thorough ? 9 : Z_DEFAULT_COMPRESSION;
+    if (deflateInit2(&stream, level, Z_DEFLATED, windowBits, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        return false;
+    }
+
+    output.resize(deflateBound(&stream, input.size()));
+    stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(input.data()));
+    stream.avail_in = static_cast<uInt>(input.size());
+    stream.next_out = reinterpret_cast<Bytef*>(&output[0]);
+    stream.avail_out = static_cast<uInt>(output.size());
+
+    int result = deflate(&stream, Z_FINISH);
+    output.resize(stream.total_out);
+    deflateEnd(&stream);
+    return result == Z_STREAM_END;
+}
@@ -0,0 +1,354 @@
+#pragma once
+#include "sqlite3.h"
+#include "DatabaseUtils.h"
+#include <iostream>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <condition_variable>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <utility>
+#include <cstdint>
+
+/**
+ * Pool of SQLite connections shared by the Crow worker threads
+ *
+ * WAL mode only lets readers run alongside a writer when they use separate
+ * connections. The pool therefore keeps:
+ * 1. One read connection per worker thread
+ * 2. A single dedicated writer connection that serializes all write transactions
+ *
+ * Each thread is given a preferred reader of its own pool on first use, so
+ * the worker threads normally spread over the readers and keep their
+ * statement caches warm. Slots still wrap once more threads read than there
+ * are readers (or non-worker threads read too), so a thread whose reader is
+ * taken borrows any idle one and only waits when every reader is busy.
+ *
+ * Read connections are opened with query_only so a handler can never write through them.
+ */
+class ConnectionPool {
+private:
+    struct PooledConnection {
+        sqlite3* db = nullptr;
+        std::unique_ptr<StatementCache> statements;
+        std::mutex mtx;
+        
+        void attach(sqlite3* handle) {
+            db = handle;
+            statements = std::make_unique<StatementCache>(handle);
+        }
+        
+        void close() {
+            // Cached statements must be finalized before the connection can close
+            statements.reset();
+            sqlite3_close(db);
+            db = nullptr;
+        }
+    };
+
+    std::string path;
+    size_t readerCount;
+    DatabaseSettings settings;
+    std::vector<std::unique_ptr<PooledConnection>> readers;
+    PooledConnection writer;
+
+    // Hands out reader slots to threads in round-robin order
+    std::atomic<size_t> nextReaderSlot{0};
+
+    // Tells pools apart in the per-thread slot table
+    const uint64_t id = nextPoolId();
+
+    // Background health checking, see startHealthChecks()
+    std::thread healthThread;
+    std::mutex healthMutex;
+    std::condition_variable healthWakeup;
+    bool healthStopping = false;
+
+    /**
+     * Opens and configures a single connection
+     *
+     * @param readOnly Whether the connection should reject writes (PRAGMA query_only)
+     * @return The connection handle, or nullptr if it could not be opened
+     */
+    sqlite3* openConnection(bool readOnly) {
+        sqlite3* db = nullptr;
+        // Each pooled connection is only ever used by one thread at a time,
+        // so SQLite's own per-connection mutex is unnecessary
+        int flags = SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE | SQLITE_OPEN_NOMUTEX;
+
+        if (sqlite3_open_v2(path.c_str(), &db, flags, nullptr) != SQLITE_OK) {
+            std::cerr << "Cannot open database: " << sqlite3_errmsg(db) << std::endl;
+            sqlite3_close(db);
+            return nullptr;
+        }
+
+        if (!configureSQLiteForACID(db, settings)) {
+            std::cerr << "Warning: Failed to configure pooled SQLite connection" << std::endl;
+        }
+
+        if (readOnly) {
+            sqlite3_exec(db, "PRAGMA query_only = ON;", nullptr, nullptr, nullptr);
+        }
+
+        if (settings.profileStatements) {
+            enableStatementProfiling(db);
+        }
+
+        return db;
+    }
+
+    /**
+     * Runs a trivial query to verify a connection is still usable
+     */
+    static bool isHealthy(sqlite3* db) {
+        if (db == nullptr) {
+            return false;
+        }
+        return sqlite3_exec(db, "SELECT 1", nullptr, nullptr, nullptr) == SQLITE_OK;
+    }
+
+    static uint64_t nextPoolId() {
+        static std::atomic<uint64_t> ids{0};
+        return ids.fetch_add(1);
+    }
+
+    // Index of the reader this pool assigned to the calling thread
+    size_t readerSlotForThread() {
+        thread_local std::vector<std::pair<uint64_t, size_t>> slots;
+        for (const auto& entry : slots) {
+            if (entry.first == id) {
+                return entry.second;
+            }
+        }
+        size_t slot = nextReaderSlot.fetch_add(1) % readers.size();
+        slots.emplace_back(id, slot);
+        return slot;
+    }
+
+public:
+    /**
+     * RAII handle to a pooled connection
+     *
+     * Holds the connection's mutex for its lifetime, so the connection
+     * is never used by two threads at once.
+     */
+    class Lease {
+    private:
+        PooledConnection* conn;
+        std::unique_lock<std::mutex> lock;
+
+    public:
+        explicit Lease(PooledConnection& conn) : conn(&conn), lock(conn.mtx) {}
+
+        // Takes over a lock already held on the connection's mutex
+        Lease(PooledConnection& conn, std::unique_lock<std::mutex> held)
+            : conn(&conn), lock(std::move(held)) {}
+
+        sqlite3* get() const { return conn->db; }
+
+        /**
+         * Checks out a cached prepared statement on this connection
+         *
+         * The returned handle must not outlive the lease.
+         */
+        CachedStatement prepare(const std::string& sql) {
+            return conn->statements->prepare(sql);
+        }
+    };
+
+    /**
+     * Aggregated prepared-statement cache counters across all connections
+     */
+    struct StatementCacheStats {
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+    };
+
+    /**
+     * @param path Path to the SQLite database file
+     * @param readerCount Number of read connections (normally the number of worker threads)
+     * @param settings Tuning applied to every connection the pool opens
+     */
+    ConnectionPool(const std::string& path, size_t readerCount,
+                   const DatabaseSettings& settings = DatabaseSettings())
+        : path(path), readerCount(readerCount == 0 ? 1 : readerCount), settings(settings) {}
+
+    ~ConnectionPool() {
+        stopHealthChecks();
+        for (auto& reader : readers) {
+            reader->close();
+        }
+        writer.close();
+    }
+
+    ConnectionPool(const ConnectionPool&) = delete;
+    ConnectionPool& operator=(const ConnectionPool&) = delete;
+
+    /**
+     * Opens the writer and all reader connections
+     *
+     * The writer is opened first so that it switches the database to WAL
+     * before any reader attaches.
+     *
+     * @return true if every connection was opened, false otherwise
+     */
+    bool open() {
+        sqlite3* writerDb = openConnection(false);
+        if (writerDb == nullptr) {
+            return false;
+        }
+        writer.attach(writerDb);
+
+        for (size_t i = 0; i < readerCount; i++) {
+            sqlite3* readerDb = openConnection(true);
+            if (readerDb == nullptr) {
+                return false;
+            }
+            auto reader = std::make_unique<PooledConnection>();
+            reader->attach(readerDb);
+            readers.push_back(std::move(reader));
+        }
+
+        std::cout << "Opened connection pool with " << readerCount
+                  << " reader(s) and 1 writer on " << path << std::endl;
+        return true;
+    }
+
+    /**
+     * Leases the calling thread's reader, or another idle one if it is taken
+     *
+     * Blocks on the thread's own reader only when every reader is busy.
+     */
+    Lease acquireReader() {
+        size_t own = readerSlotForThread();
+        for (size_t i = 0; i < readers.size(); i++) {
+            PooledConnection& reader = *readers[(own + i) % readers.size()];
+            std::unique_lock<std::mutex> lock(reader.mtx, std::try_to_lock);
+            if (lock.owns_lock()) {
+                return Lease(reader, std::move(lock));
+            }
+        }
+        return Lease(*readers[own]);
+    }
+
+    /**
+     * Leases the dedicated writer connection
+     */
+    Lease acquireWriter() {
+        return Lease(writer);
+    }
+
+    /**
+     * Runs a write transaction on the writer connection
+     *
+     * @param operation A function containing the database operations; it receives
+     *                  the writer lease so it can use cached statements
+     * @param retries Number of retries if the transaction fails due to locking
+     * @return true if transaction completes successfully, false otherwise
+     */
+    bool executeWrite(const std::function<bool(Lease&)>& operation, int retries = 3) {
+        Lease lease = acquireWriter();
+        return executeTransaction(lease.get(), [&](sqlite3*) -> bool {
+            return operation(lease);
+        }, retries);
+    }
+
+    /**
+     * Verifies every pooled connection and reopens any that have failed
+     *
+     * Readers that are currently leased are skipped rather than waited on;
+     * they will be checked on the next pass.
+     *
+     * @return Number of connections that had to be reopened
+     */
+    int checkHealth() {
+        int repaired = 0;
+
+        auto repair = [&](PooledConnection& conn, bool readOnly) {
+            if (isHealthy(conn.db)) {
+                return;
+            }
+            std::cerr << "Pooled connection failed health check, reopening" << std::endl;
+            sqlite3* replacement = openConnection(readOnly);
+            if (replacement == nullptr) {
+                return;  // Keep the old handle and try again on the next pass
+            }
+            conn.close();
+            conn.attach(replacement);
+            repaired++;
+        };
+
+        {
+            std::lock_guard<std::mutex> lock(writer.mtx);
+            repair(writer, false);
+        }
+
+        for (auto& reader : readers) {
+            std::unique_lock<std::mutex> lock(reader->mtx, std::try_to_lock);
+            if (lock.owns_lock()) {
+                repair(*reader, true);
+            }
+        }
+
+        return repaired;
+    }
+
+    /**
+     * Runs checkHealth() on a background thread at a fixed interval
+     *
+     * @param interval Time between checks
+     */
+    void startHealthChecks(std::chrono::milliseconds interval) {
+        if (healthThread.joinable()) {
+            return;
+        }
+        healthThread = std::thread([this, interval]() {
+            std::unique_lock<std::mutex> lock(healthMutex);
+            while (!healthWakeup.wait_for(lock, interval, [this] { return healthStopping; })) {
+                lock.unlock();
+                checkHealth();
+                lock.lock();
+            }
+        });
+    }
+
+    /**
+     * Stops the health check thread; safe to call more than once
+     */
+    void stopHealthChecks() {
+        {
+            std::lock_guard<std::mutex> lock(healthMutex);
+            healthStopping = true;
+        }
+        healthWakeup.notify_all();
+        if (healthThread.joinable()) {
+            healthThread.join();
+        }
+    }
+
+    /**
+     * Sums the prepared-statement cache counters of every connection
+     *
+     * Each connection is locked only long enough to read its counters.
+     */
+    StatementCacheStats statementCacheStats() {
+        StatementCacheStats stats;
+        auto add = [&stats](PooledConnection& conn) {
+            std::lock_guard<std::mutex> lock(conn.mtx);
+            stats.hits += conn.statements->hitCount();
+            stats.misses += conn.statements->missCount();
+        };
+        
+        add(writer);
+        for (auto& reader : readers) {
+            add(*reader);
+        }
+        return stats;
+    }
+
+    size_t size() const { return readerCount; }
+};
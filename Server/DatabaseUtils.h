@@ -1,18 +1,54 @@
 #pragma once
 #include "sqlite3.h"
+#include "Metrics.h"
+#include "Logger.h"
+#include "CodeBlobs.h"
 #include <iostream>
 #include <functional>
 #include <string>
 #include <chrono>
 #include <thread>
+#include <unordered_map>
+#include <vector>
+#include <atomic>
+#include <cstdint>
+
+/**
+ * Transaction counters on /metrics
+ *
+ * Shared by executeTransaction and the batches WriteQueue commits itself,
+ * so they count every write transaction whichever path ran it.
+ */
+struct TransactionMetrics {
+    Metrics::Counter transactions;
+    Metrics::Counter retried;
+    Metrics::Counter failures;
+    Metrics::Counter rollbacks;
+};
+
+inline const TransactionMetrics& transactionMetrics() {
+    static const TransactionMetrics metrics{
+        Metrics::instance().counter(
+            "db_transactions_total", "Write transactions begun, including WriteQueue batches"),
+        Metrics::instance().counter(
+            "db_transaction_retries_total", "Transaction attempts retried because the database was locked"),
+        Metrics::instance().counter(
+            "db_transaction_failures_total", "Transactions that could not begin or commit"),
+        Metrics::instance().counter(
+            "db_transaction_rollbacks_total", "Operations rolled back because they failed"),
+    };
+    return metrics;
+}
 
 /**
  * Transaction helper function with deadlock handling capabilities
  * 
  * This improved version adds:
- * 1. Busy timeouts to prevent internal SQLite deadlocks
- * 2. Retry capability to recover from transient lock issues
- * 3. Error differentiation between deadlocks and other failures
+ * 1. Retry capability to recover from transient lock issues
+ * 2. Error differentiation between deadlocks and other failures
+ * 
+ * Lock waits inside SQLite are bounded by the connection's busy timeout,
+ * which configureSQLiteForACID sets from DatabaseSettings.
  * 
  * @param db The SQLite database connection
  * @param operation A function containing the database operations
@@ -20,23 +56,24 @@
  * @return true if transaction completes successfully, false otherwise
  */
 bool executeTransaction(sqlite3* db, const std::function<bool(sqlite3*)>& operation, int retries = 3) {
-    // Set SQLite busy timeout to avoid internal deadlocks
-    // This makes SQLite wait up to 1000ms when a resource is locked
-    sqlite3_busy_timeout(db, 1000);
+    const TransactionMetrics& metrics = transactionMetrics();
     
+    Metrics::increment(metrics.transactions);
     for (int attempt = 0; attempt <= retries; attempt++) {
         // Begin transaction
         if (sqlite3_exec(db, "BEGIN TRANSACTION", nullptr, nullptr, nullptr) != SQLITE_OK) {
-            std::cerr << "Failed to begin transaction: " << sqlite3_errmsg(db) << std::endl;
+            Logger::instance().error("transaction_begin_failed", {{"error", sqlite3_errmsg(db)}});
             
             // If database is busy/locked, retry after delay
             if (sqlite3_errcode(db) == SQLITE_BUSY || sqlite3_errcode(db) == SQLITE_LOCKED) {
                 if (attempt < retries) {
-                    std::cerr << "Database locked, retrying in " << (100 * (attempt + 1)) << "ms..." << std::endl;
+                    Metrics::increment(metrics.retried);
+                    Logger::instance().warn("transaction_retry", {{"stage", "begin"}, {"delay_ms", 100 * (attempt + 1)}});
                     std::this_thread::sleep_for(std::chrono::milliseconds(100 * (attempt + 1)));
                     continue;
                 }
             }
+            Metrics::increment(metrics.failures);
             return false;
         }
         
@@ -46,13 +83,14 @@ bool executeTransaction(sqlite3* db, const std::function<bool(sqlite3*)>& operat
         // Commit or rollback based on the operation result
         if (success) {
             if (sqlite3_exec(db, "COMMIT", nullptr, nullptr, nullptr) != SQLITE_OK) {
-                std::cerr << "Failed to commit transaction: " << sqlite3_errmsg(db) << std::endl;
+                Logger::instance().error("transaction_commit_failed", {{"error", sqlite3_errmsg(db)}});
                 
                 // Check if failure was due to lock contention
                 if (sqlite3_errcode(db) == SQLITE_BUSY || sqlite3_errcode(db) == SQLITE_LOCKED) {
                     sqlite3_exec(db, "ROLLBACK", nullptr, nullptr, nullptr);
                     if (attempt < retries) {
-                        std::cerr << "Commit failed due to locks, retrying..." << std::endl;
+                        Metrics::increment(metrics.retried);
+                        Logger::instance().warn("transaction_retry", {{"stage", "commit"}, {"delay_ms", 100 * (attempt + 1)}});
                         std::this_thread::sleep_for(std::chrono::milliseconds(100 * (attempt + 1)));
                         continue;
                     }
@@ -60,22 +98,88 @@ bool executeTransaction(sqlite3* db, const std::function<bool(sqlite3*)>& operat
                     // Try to rollback if commit fails
                     sqlite3_exec(db, "ROLLBACK", nullptr, nullptr, nullptr);
                 }
+                Metrics::increment(metrics.failures);
                 return false;
             }
             return true;  // Success!
         } else {
             if (sqlite3_exec(db, "ROLLBACK", nullptr, nullptr, nullptr) != SQLITE_OK) {
-                std::cerr << "Failed to rollback transaction: " << sqlite3_errmsg(db) << std::endl;
+                Logger::instance().error("transaction_rollback_failed", {{"error", sqlite3_errmsg(db)}});
             }
             // No need to retry if the operation itself failed
+            Metrics::increment(metrics.rollbacks);
             return false;
         }
     }
     
-    std::cerr << "Transaction failed after " << retries << " retries" << std::endl;
+    Logger::instance().error("transaction_gave_up", {{"retries", retries}});
+    Metrics::increment(metrics.failures);
     return false;
 }
 
+/**
+ * How much durability a commit buys, expressed as PRAGMA synchronous levels
+ * 
+ * In WAL mode every tier keeps the database consistent if the server process
+ * crashes. The tiers differ in what an OS crash or power loss can cost:
+ * 
+ * - Safe (synchronous = FULL): the WAL is fsynced on every commit. A commit
+ *   that has returned is never lost. Each write pays a full fsync.
+ * - Balanced (synchronous = NORMAL): the WAL is only fsynced when it is
+ *   checkpointed. The database cannot corrupt, but commits made since the
+ *   last checkpoint may be rolled back after a power loss.
+ * - Fast (synchronous = OFF): SQLite never fsyncs. A power loss or OS crash
+ *   can corrupt the database; only for disposable data such as local
+ *   development and load tests.
+ */
+enum class DurabilityTier {
+    Safe,
+    Balanced,
+    Fast
+};
+
+inline const char* durabilityTierName(DurabilityTier tier) {
+    switch (tier) {
+        case DurabilityTier::Balanced: return "balanced";
+        case DurabilityTier::Fast: return "fast";
+        default: return "safe";
+    }
+}
+
+/**
+ * Per-connection SQLite tuning applied by configureSQLiteForACID
+ * 
+ * The defaults reproduce SQLite's own defaults except for durability,
+ * which stays at the Safe tier unless explicitly relaxed.
+ */
+struct DatabaseSettings {
+    DurabilityTier durability = DurabilityTier::Safe;
+    int busyTimeoutMs = 5000;
+    int walAutocheckpointPages = 1000;  // 0 disables automatic checkpoints on commit
+    long long mmapSizeBytes = 0;        // 0 disables memory-mapped I/O
+    long long cacheSizeKb = 2000;       // Page cache size per connection
+    std::string tempStore = "DEFAULT";  // DEFAULT, FILE or MEMORY
+    bool profileStatements = true;      // Record statement run times (sqlite3_trace_v2)
+};
+
+/**
+ * Records how long every statement run on a connection takes
+ * 
+ * Uses SQLITE_TRACE_PROFILE, which reports each statement's run time once
+ * it finishes or is reset, into the sqlite_statement_duration_seconds
+ * histogram. The callback only does a per-thread counter update.
+ */
+inline void enableStatementProfiling(sqlite3* db) {
+    static const Metrics::Histogram runTime = Metrics::instance().histogram(
+        "sqlite_statement_duration_seconds", "Time spent stepping statements until done or reset",
+        "", Metrics::fastBoundsUs());
+    
+    sqlite3_trace_v2(db, SQLITE_TRACE_PROFILE, [](unsigned, void*, void*, void* elapsed) -> int {
+        Metrics::observe(runTime, *static_cast<sqlite3_int64*>(elapsed) / 1000);
+        return 0;
+    }, nullptr);
+}
+
 /**
  * Configure SQLite database settings to ensure ACID compliance and deadlock prevention
  * 
@@ -86,23 +190,26 @@ bool executeTransaction(sqlite3* db, const std::function<bool(sqlite3*)>& operat
  *    - Enhances durability by writing changes to a separate log before applying them
  *    - Reduces chance of database corruption during system crashes
  * 
- * 2. synchronous = FULL
- *    - Ensures durability by forcing disk writes at critical moments
- *    - Prevents data loss in case of operating system crashes or power failures
- *    - Trades some performance for maximum reliability
+ * 2. synchronous = FULL / NORMAL / OFF
+ *    - Chosen by the configured DurabilityTier; see its documentation for what
+ *      each level risks on power loss
  * 
  * 3. foreign_keys = ON
  *    - Enforces referential integrity constraints
  *    - Contributes to consistency by preventing invalid data relationships
  *    - Ensures database remains in a valid state after transactions
  * 
- * 4. busy_timeout = 5000
- *    - Prevents deadlocks by making SQLite wait for up to 5000ms when a resource is locked
+ * 4. busy_timeout
+ *    - Prevents deadlocks by making SQLite wait a bounded time when a resource is locked
+ * 
+ * 5. wal_autocheckpoint, mmap_size, cache_size, temp_store
+ *    - Performance tuning only; none of them affects durability
  * 
  * @param db The SQLite database connection to configure
- * @return true if all configurations succeed, false if any fail
+ * @param settings The tuning to apply
+ * @return true if all critical configurations succeed, false if any fail
  */
-bool configureSQLiteForACID(sqlite3* db) {
+bool configureSQLiteForACID(sqlite3* db, const DatabaseSettings& settings = DatabaseSettings()) {
     char* errMsg = nullptr;
     
     // Set journal mode to WAL for better concurrency and durability
@@ -113,8 +220,13 @@ bool configureSQLiteForACID(sqlite3* db) {
         return false;
     }
     
-    // Set synchronous mode to FULL for durability (prevents corruption in case of OS crash)
+    // Set synchronous mode according to the configured durability tier
     const char* syncMode = "PRAGMA synchronous = FULL;";
+    if (settings.durability == DurabilityTier::Balanced) {
+        syncMode = "PRAGMA synchronous = NORMAL;";
+    } else if (settings.durability == DurabilityTier::Fast) {
+        syncMode = "PRAGMA synchronous = OFF;";
+    }
     if (sqlite3_exec(db, syncMode, nullptr, nullptr, &errMsg) != SQLITE_OK) {
         std::cerr << "Failed to set synchronous mode: " << errMsg << std::endl;
         sqlite3_free(errMsg);
@@ -129,87 +241,623 @@ bool configureSQLiteForACID(sqlite3* db) {
         return false;
     }
     
-    // Add deadlock timeout setting
-    const char* busyTimeout = "PRAGMA busy_timeout = 5000;";
-    if (sqlite3_exec(db, busyTimeout, nullptr, nullptr, &errMsg) != SQLITE_OK) {
-        std::cerr << "Failed to set busy timeout: " << errMsg << std::endl;
+    // Deadlock timeout and performance tuning; none of these is critical,
+    // so continue anyway if one fails
+    const std::string tuning[] = {
+        "PRAGMA busy_timeout = " + std::to_string(settings.busyTimeoutMs) + ";",
+        "PRAGMA wal_autocheckpoint = " + std::to_string(settings.walAutocheckpointPages) + ";",
+        "PRAGMA mmap_size = " + std::to_string(settings.mmapSizeBytes) + ";",
+        // A negative cache_size is a size in KiB rather than a page count
+        "PRAGMA cache_size = -" + std::to_string(settings.cacheSizeKb) + ";",
+        "PRAGMA temp_store = " + settings.tempStore + ";"
+    };
+    for (const std::string& pragma : tuning) {
+        if (sqlite3_exec(db, pragma.c_str(), nullptr, nullptr, &errMsg) != SQLITE_OK) {
+            std::cerr << "Failed to apply " << pragma << " " << errMsg << std::endl;
+            sqlite3_free(errMsg);
+        }
+    }
+    
+    return true;
+}
+
+/**
+ * A single versioned schema migration
+ * 
+ * Migrations are applied in order of version, each in its own transaction
+ * together with the PRAGMA user_version bump, so a database is always at
+ * exactly one schema version. Never edit a migration that has shipped;
+ * append a new one instead.
+ */
+struct Migration {
+    int version;
+    const char* description;
+    std::function<bool(sqlite3*)> apply;
+};
+
+// Runs a block of SQL statements, logging any error
+inline bool execMigrationSql(sqlite3* db, const char* sql) {
+    char* errMsg = nullptr;
+    if (sqlite3_exec(db, sql, nullptr, nullptr, &errMsg) != SQLITE_OK) {
+        std::cerr << "SQL error: " << errMsg << std::endl;
         sqlite3_free(errMsg);
-        // Continue anyway, this is not critical
+        return false;
+    }
+    return true;
+}
+
+/**
+ * The ordered list of schema migrations
+ * 
+ * Version 1 reproduces the schema that existed before versioning was
+ * introduced, so unversioned databases (user_version 0) are brought in
+ * line without losing data.
+ */
+inline const std::vector<Migration>& schemaMigrations() {
+    static const std::vector<Migration> migrations = {
+        {1, "Create posts and users tables", [](sqlite3* db) -> bool {
+            const char* sql = R"(
+                CREATE TABLE IF NOT EXISTS posts (
+                    id INTEGER PRIMARY KEY AUTOINCREMENT,
+                    user_id INTEGER,
+                    title TEXT NOT NULL,
+                    html_code TEXT,
+                    css_code TEXT, 
+                    js_code TEXT,
+                    isPrivate BOOLEAN DEFAULT 0 NOT NULL,
+                    created_at TIMESTAMP DEFAULT CURRENT_TIMESTAMP,
+                    updated_at TIMESTAMP DEFAULT CURRENT_TIMESTAMP,
+                    FOREIGN KEY (user_id) REFERENCES users(user_id)
+                );
+                
+                CREATE TABLE IF NOT EXISTS users (
+                    user_id INTEGER PRIMARY KEY AUTOINCREMENT,
+                    username TEXT NOT NULL UNIQUE,
+                    email TEXT NOT NULL UNIQUE,
+                    password TEXT NOT NULL,
+                    created_at TIMESTAMP DEFAULT CURRENT_TIMESTAMP
+                );
+            )";
+            if (!execMigrationSql(db, sql)) {
+                return false;
+            }
+            
+            // Databases created before the privacy feature lack the isPrivate column
+            sqlite3_stmt* stmt;
+            if (sqlite3_prepare_v2(db, "PRAGMA table_info(posts)", -1, &stmt, nullptr) != SQLITE_OK) {
+                std::cerr << "Error checking table schema: " << sqlite3_errmsg(db) << std::endl;
+                return false;
+            }
+            
+            bool hasPrivateColumn = false;
+            while (sqlite3_step(stmt) == SQLITE_ROW) {
+                std::string colName = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1));
+                if (colName == "isPrivate") {
+                    hasPrivateColumn = true;
+                    break;
+                }
+            }
+            sqlite3_finalize(stmt);
+            
+            if (!hasPrivateColumn) {
+                return execMigrationSql(db, "ALTER TABLE posts ADD COLUMN isPrivate BOOLEAN DEFAULT 0 NOT NULL");
+            }
+            return true;
+        }},
+        
+        {2, "Add keyset listing indexes on posts", [](sqlite3* db) -> bool {
+            // Ordered the same way as the listing, so a page is a bounded range scan
+            return execMigrationSql(db, R"(
+                CREATE INDEX IF NOT EXISTS idx_posts_updated
+                    ON posts (updated_at DESC, id DESC);
+                CREATE INDEX IF NOT EXISTS idx_posts_user_updated
+                    ON posts (user_id, updated_at DESC, id DESC);
+                CREATE INDEX IF NOT EXISTS idx_posts_private_updated
+                    ON posts (isPrivate, updated_at DESC, id DESC);
+            )");
+        }},
+        
+        {3, "Add covering index for post access checks", [](sqlite3* db) -> bool {
+            // Privacy, ownership and creator lookups only need these columns.
+            // Reading them from the table row means decoding past the large
+            // code columns (and their overflow pages) to reach isPrivate.
+            return execMigrationSql(db, R"(
+                CREATE INDEX IF NOT EXISTS idx_posts_access
+                    ON posts (id, user_id, isPrivate);
+            )");
+        }},
+        
+        {4, "Add full-text search index over post titles and code", [](sqlite3* db) -> bool {
+            // External-content FTS5 table: the index stores no copy of the
+            // text, and triggers keep it in step with every write to posts.
+            // The update trigger only fires for the indexed columns, so
+            // touching updated_at alone never re-tokenizes a post.
+            return execMigrationSql(db, R"(
+                CREATE VIRTUAL TABLE IF NOT EXISTS posts_fts USING fts5(
+                    title, html_code, css_code, js_code,
+                    content = 'posts', content_rowid = 'id',
+                    tokenize = 'unicode61'
+                );
+                
+                CREATE TRIGGER IF NOT EXISTS posts_fts_insert AFTER INSERT ON posts BEGIN
+                    INSERT INTO posts_fts (rowid, title, html_code, css_code, js_code)
+                    VALUES (new.id, new.title, new.html_code, new.css_code, new.js_code);
+                END;
+                
+                CREATE TRIGGER IF NOT EXISTS posts_fts_delete AFTER DELETE ON posts BEGIN
+                    INSERT INTO posts_fts (posts_fts, rowid, title, html_code, css_code, js_code)
+                    VALUES ('delete', old.id, old.title, old.html_code, old.css_code, old.js_code);
+                END;
+                
+                CREATE TRIGGER IF NOT EXISTS posts_fts_update
+                AFTER UPDATE OF title, html_code, css_code, js_code ON posts BEGIN
+                    INSERT INTO posts_fts (posts_fts, rowid, title, html_code, css_code, js_code)
+                    VALUES ('delete', old.id, old.title, old.html_code, old.css_code, old.js_code);
+                    INSERT INTO posts_fts (rowid, title, html_code, css_code, js_code)
+                    VALUES (new.id, new.title, new.html_code, new.css_code, new.js_code);
+                END;
+                
+                -- Index the posts that already exist
+                INSERT INTO posts_fts (posts_fts) VALUES ('rebuild');
+                
+                -- Rank title matches well above matches in code
+                INSERT INTO posts_fts (posts_fts, rank) VALUES ('rank', 'bm25(10.0, 1.0, 1.0, 1.0)');
+            )");
+        }},
+
+        {5, "Move post code into content-addressed blobs", [](sqlite3* db) -> bool {
+            // Existing code is hashed in SQL, so the hash function must be
+            // available on the migrating connection
+            if (!registerCodeHashFunction(db)) {
+                std::cerr << "Cannot register code_hash: " << sqlite3_errmsg(db) << std::endl;
+                return false;
+            }
+
+            // The search index and its triggers read the inline code
+            // columns; they are rebuilt on top of the blobs at the end
+            return execMigrationSql(db, R"(
+                DROP TRIGGER IF EXISTS posts_fts_insert;
+                DROP TRIGGER IF EXISTS posts_fts_delete;
+                DROP TRIGGER IF EXISTS posts_fts_update;
+                DROP TABLE IF EXISTS posts_fts;
+
+                CREATE TABLE code_blobs (
+                    hash BLOB PRIMARY KEY,
+                    content TEXT NOT NULL,
+                    refcount INTEGER NOT NULL DEFAULT 0
+                );
+
+                -- Lets the collector find garbage without scanning every blob
+                CREATE INDEX idx_code_blobs_unreferenced ON code_blobs (hash) WHERE refcount = 0;
+
+                ALTER TABLE posts ADD COLUMN html_hash BLOB;
+                ALTER TABLE posts ADD COLUMN css_hash BLOB;
+                ALTER TABLE posts ADD COLUMN js_hash BLOB;
+
+                UPDATE posts SET
+                    html_hash = code_hash(html_code),
+                    css_hash = code_hash(css_code),
+                    js_hash = code_hash(js_code);
+
+                INSERT OR IGNORE INTO code_blobs (hash, content)
+                    SELECT html_hash, COALESCE(html_code, '') FROM posts
+                    UNION ALL SELECT css_hash, COALESCE(css_code, '') FROM posts
+                    UNION ALL SELECT js_hash, COALESCE(js_code, '') FROM posts;
+
+                UPDATE code_blobs SET refcount = refs.total
+                FROM (
+                    SELECT hash, count(*) AS total FROM (
+                        SELECT html_hash AS hash FROM posts
+                        UNION ALL SELECT css_hash FROM posts
+                        UNION ALL SELECT js_hash FROM posts
+                    ) GROUP BY hash
+                ) AS refs
+                WHERE refs.hash = code_blobs.hash;
+
+                ALTER TABLE posts DROP COLUMN html_code;
+                ALTER TABLE posts DROP COLUMN css_code;
+                ALTER TABLE posts DROP COLUMN js_code;
+
+                -- Posts as they looked before, for reads that need the code
+                CREATE VIEW posts_with_code AS
+                    SELECT p.*, h.content AS html_code, c.content AS css_code, j.content AS js_code
+                    FROM posts p
+                    LEFT JOIN code_blobs h ON h.hash = p.html_hash
+                    LEFT JOIN code_blobs c ON c.hash = p.css_hash
+                    LEFT JOIN code_blobs j ON j.hash = p.js_hash;
+
+                -- Reference counts follow every write to the hash columns.
+                -- Nothing is deleted here: the search index triggers below
+                -- still read the old content of a deleted or edited post.
+                CREATE TRIGGER code_blobs_ref_insert AFTER INSERT ON posts BEGIN
+                    UPDATE code_blobs SET refcount = refcount + 1 WHERE hash = new.html_hash;
+                    UPDATE code_blobs SET refcount = refcount + 1 WHERE hash = new.css_hash;
+                    UPDATE code_blobs SET refcount = refcount + 1 WHERE hash = new.js_hash;
+                END;
+
+                CREATE TRIGGER code_blobs_ref_delete AFTER DELETE ON posts BEGIN
+                    UPDATE code_blobs SET refcount = refcount - 1 WHERE hash = old.html_hash;
+                    UPDATE code_blobs SET refcount = refcount - 1 WHERE hash = old.css_hash;
+                    UPDATE code_blobs SET refcount = refcount - 1 WHERE hash = old.js_hash;
+                END;
+
+                CREATE TRIGGER code_blobs_ref_update
+                AFTER UPDATE OF html_hash, css_hash, js_hash ON posts BEGIN
+                    UPDATE code_blobs SET refcount = refcount - 1
+                        WHERE hash = old.html_hash AND old.html_hash IS NOT new.html_hash;
+                    UPDATE code_blobs SET refcount = refcount + 1
+                        WHERE hash = new.html_hash AND old.html_hash IS NOT new.html_hash;
+                    UPDATE code_blobs SET refcount = refcount - 1
+                        WHERE hash = old.css_hash AND old.css_hash IS NOT new.css_hash;
+                    UPDATE code_blobs SET refcount = refcount + 1
+                        WHERE hash = new.css_hash AND old.css_hash IS NOT new.css_hash;
+                    UPDATE code_blobs SET refcount = refcount - 1
+                        WHERE hash = old.js_hash AND old.js_hash IS NOT new.js_hash;
+                    UPDATE code_blobs SET refcount = refcount + 1
+                        WHERE hash = new.js_hash AND old.js_hash IS NOT new.js_hash;
+                END;
+
+                -- Same search index as version 4, with its content read
+                -- through the view. A save that changes no indexed field
+                -- leaves the index alone.
+                CREATE VIRTUAL TABLE posts_fts USING fts5(
+                    title, html_code, css_code, js_code,
+                    content = 'posts_with_code', content_rowid = 'id',
+                    tokenize = 'unicode61'
+                );
+
+                CREATE TRIGGER posts_fts_insert AFTER INSERT ON posts BEGIN
+                    INSERT INTO posts_fts (rowid, title, html_code, css_code, js_code)
+                    VALUES (new.id, new.title,
+                            (SELECT content FROM code_blobs WHERE hash = new.html_hash),
+                            (SELECT content FROM code_blobs WHERE hash = new.css_hash),
+                            (SELECT content FROM code_blobs WHERE hash = new.js_hash));
+                END;
+
+                CREATE TRIGGER posts_fts_delete AFTER DELETE ON posts BEGIN
+                    INSERT INTO posts_fts (posts_fts, rowid, title, html_code, css_code, js_code)
+                    VALUES ('delete', old.id, old.title,
+                            (SELECT content FROM code_blobs WHERE hash = old.html_hash),
+                            (SELECT content FROM code_blobs WHERE hash = old.css_hash),
+                            (SELECT content FROM code_blobs WHERE hash = old.js_hash));
+                END;
+
+                CREATE TRIGGER posts_fts_update
+                AFTER UPDATE OF title, html_hash, css_hash, js_hash ON posts
+                WHEN old.title IS NOT new.title OR old.html_hash IS NOT new.html_hash
+                  OR old.css_hash IS NOT new.css_hash OR old.js_hash IS NOT new.js_hash BEGIN
+                    INSERT INTO posts_fts (posts_fts, rowid, title, html_code, css_code, js_code)
+                    VALUES ('delete', old.id, old.title,
+                            (SELECT content FROM code_blobs WHERE hash = old.html_hash),
+                            (SELECT content FROM code_blobs WHERE hash = old.css_hash),
+                            (SELECT content FROM code_blobs WHERE hash = old.js_hash));
+                    INSERT INTO posts_fts (rowid, title, html_code, css_code, js_code)
+                    VALUES (new.id, new.title,
+                            (SELECT content FROM code_blobs WHERE hash = new.html_hash),
+                            (SELECT content FROM code_blobs WHERE hash = new.css_hash),
+                            (SELECT content FROM code_blobs WHERE hash = new.js_hash));
+                END;
+
+                INSERT INTO posts_fts (posts_fts) VALUES ('rebuild');
+                INSERT INTO posts_fts (posts_fts, rank) VALUES ('rank', 'bm25(10.0, 1.0, 1.0, 1.0)');
+            )");
+        }},
+
+        {6, "Record which post a fork was made from", [](sqlite3* db) -> bool {
+            // Deleting a post keeps its forks and forgets their parent; the
+            // index serves that lookup as well as listing a post's forks
+            return execMigrationSql(db, R"(
+                ALTER TABLE posts ADD COLUMN parent_id INTEGER REFERENCES posts (id) ON DELETE SET NULL;
+                CREATE INDEX IF NOT EXISTS idx_posts_parent ON posts (parent_id) WHERE parent_id IS NOT NULL;
+            )");
+        }},
+
+        {7, "Add a version counter to posts", [](sqlite3* db) -> bool {
+            // Bumped by every content update; partial updates name the
+            // version they were made against
+            return execMigrationSql(db, "ALTER TABLE posts ADD COLUMN version INTEGER NOT NULL DEFAULT 0");
+        }},
+
+        {8, "Add post revision history", [](sqlite3* db) -> bool {
+            // See PostRevisions.h for the format. History lives outside
+            // posts and is never cascaded inline: deleting a post only
+            // queues its revisions for the background pruner.
+            return execMigrationSql(db, R"(
+                CREATE TABLE IF NOT EXISTS post_revisions (
+                    post_id INTEGER NOT NULL,
+                    version INTEGER NOT NULL,
+                    saved_at TIMESTAMP NOT NULL,
+                    kind INTEGER NOT NULL,
+                    raw_size INTEGER NOT NULL,
+                    compressed INTEGER NOT NULL,
+                    data BLOB NOT NULL,
+                    PRIMARY KEY (post_id, version)
+                );
+
+                CREATE INDEX IF NOT EXISTS idx_post_revisions_snapshots
+                    ON post_revisions (post_id, version) WHERE kind = 0;
+                CREATE INDEX IF NOT EXISTS idx_post_revisions_saved
+                    ON post_revisions (saved_at);
+
+                CREATE TABLE IF NOT EXISTS post_revision_purges (
+                    post_id INTEGER PRIMARY KEY
+                );
+
+                CREATE TRIGGER IF NOT EXISTS post_revisions_purge AFTER DELETE ON posts BEGIN
+                    INSERT OR IGNORE INTO post_revision_purges (post_id) VALUES (old.id);
+                END;
+            )");
+        }},
+
+        {9, "Store code previews at write time", [](sqlite3* db) -> bool {
+            // Blobs never change, so a preview is computed once when its
+            // blob is stored and dropped when the collector deletes it
+            const std::string chars = std::to_string(CODE_PREVIEW_CHARS);
+            std::string sql = R"(
+                CREATE TABLE IF NOT EXISTS code_previews (
+                    hash BLOB PRIMARY KEY,
+                    content_length INTEGER NOT NULL,
+                    preview TEXT NOT NULL
+                );
+
+                INSERT OR IGNORE INTO code_previews (hash, content_length, preview)
+                    SELECT hash, length(content), substr(content, 1, )" + chars + R"() FROM code_blobs;
+
+                CREATE TRIGGER IF NOT EXISTS code_previews_insert AFTER INSERT ON code_blobs BEGIN
+                    INSERT OR REPLACE INTO code_previews (hash, content_length, preview)
+                    VALUES (new.hash, length(new.content), substr(new.content, 1, )" + chars + R"());
+                END;
+
+                CREATE TRIGGER IF NOT EXISTS code_previews_delete AFTER DELETE ON code_blobs BEGIN
+                    DELETE FROM code_previews WHERE hash = old.hash;
+                END;
+            )";
+            return execMigrationSql(db, sql.c_str());
+        }},
+
+        {10, "Index two and three character prefixes for search", [](sqlite3* db) -> bool {
+            // The last search word is a prefix query. Without prefix indexes
+            // FTS5 merges the doclist of every term starting with it; with
+            // them a short prefix is a single lookup. The triggers of version
+            // 5 refer to the table by name and keep feeding the new one.
+            return execMigrationSql(db, R"(
+                DROP TABLE posts_fts;
+
+                CREATE VIRTUAL TABLE posts_fts USING fts5(
+                    title, html_code, css_code, js_code,
+                    content = 'posts_with_code', content_rowid = 'id',
+                    tokenize = 'unicode61', prefix = '2 3'
+                );
+
+                INSERT INTO posts_fts (posts_fts) VALUES ('rebuild');
+                INSERT INTO posts_fts (posts_fts, rank) VALUES ('rank', 'bm25(10.0, 1.0, 1.0, 1.0)');
+            )");
+        }},
+    };
+    return migrations;
+}
+
+/**
+ * Brings the database schema up to the latest version
+ * 
+ * Reads the current version from PRAGMA user_version and applies every
+ * newer migration in order. Stops at the first failure, leaving the
+ * database at the last successfully applied version.
+ * 
+ * @param db The SQLite database connection (must not be in a transaction)
+ * @return true if the schema is up to date, false if a migration failed
+ */
+inline bool runMigrations(sqlite3* db) {
+    int currentVersion = 0;
+    sqlite3_stmt* stmt;
+    if (sqlite3_prepare_v2(db, "PRAGMA user_version", -1, &stmt, nullptr) != SQLITE_OK) {
+        std::cerr << "Error reading schema version: " << sqlite3_errmsg(db) << std::endl;
+        return false;
+    }
+    if (sqlite3_step(stmt) == SQLITE_ROW) {
+        currentVersion = sqlite3_column_int(stmt, 0);
+    }
+    sqlite3_finalize(stmt);
+    
+    for (const Migration& migration : schemaMigrations()) {
+        if (migration.version <= currentVersion) {
+            continue;
+        }
+        
+        bool applied = executeTransaction(db, [&migration](sqlite3* db) -> bool {
+            if (!migration.apply(db)) {
+                return false;
+            }
+            std::string versionSql = "PRAGMA user_version = " + std::to_string(migration.version);
+            return execMigrationSql(db, versionSql.c_str());
+        });
+        
+        if (!applied) {
+            std::cerr << "Schema migration " << migration.version << " failed: "
+                      << migration.description << std::endl;
+            return false;
+        }
+        
+        std::cout << "Applied schema migration " << migration.version << ": "
+                  << migration.description << std::endl;
+        currentVersion = migration.version;
     }
     
+    // Refresh planner statistics for any indexes that were just created
+    sqlite3_exec(db, "PRAGMA optimize", nullptr, nullptr, nullptr);
     return true;
 }
 
-// Database helper functions
-void initializeDatabase(sqlite3* db) {
+/**
+ * Configures a connection and brings the schema up to date
+ * 
+ * Routes depend on the latest schema (views, indexes named in INDEXED BY,
+ * columns that replaced dropped ones), so a database that could not be
+ * migrated is not safe to serve from.
+ * 
+ * @return false if a migration failed
+ */
+bool initializeDatabase(sqlite3* db, const DatabaseSettings& settings = DatabaseSettings()) {
     // Configure SQLite for ACID compliance
-    if (!configureSQLiteForACID(db)) {
+    if (!configureSQLiteForACID(db, settings)) {
         std::cerr << "Warning: Failed to configure SQLite for optimal ACID compliance" << std::endl;
     }
     
+    // Create or upgrade the schema
+    if (!runMigrations(db)) {
+        std::cerr << "Database schema is not up to date" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+class StatementCache;
+
+using StatementMap = std::unordered_map<std::string, sqlite3_stmt*>;
+
+/**
+ * RAII handle to a statement checked out of a StatementCache
+ * 
+ * Converts implicitly to sqlite3_stmt* so it can be passed straight to the
+ * sqlite3_bind_* / sqlite3_step / sqlite3_column_* functions. When the handle
+ * goes out of scope the statement is reset, its bindings are cleared and it
+ * is returned to the cache instead of being finalized.
+ */
+class CachedStatement {
+private:
+    StatementCache* cache = nullptr;
+    StatementMap::node_type node;
+
+public:
+    CachedStatement() = default;
+    CachedStatement(StatementCache* cache, StatementMap::node_type node)
+        : cache(cache), node(std::move(node)) {}
+    
+    CachedStatement(CachedStatement&& other) noexcept
+        : cache(other.cache), node(std::move(other.node)) {
+        other.cache = nullptr;
+    }
+    
+    CachedStatement& operator=(CachedStatement&& other) noexcept;
+    CachedStatement(const CachedStatement&) = delete;
+    CachedStatement& operator=(const CachedStatement&) = delete;
+    
+    ~CachedStatement();
+    
+    sqlite3_stmt* get() const { return node ? node.mapped() : nullptr; }
+    operator sqlite3_stmt*() const { return get(); }
+    explicit operator bool() const { return get() != nullptr; }
+};
+
+/**
+ * Per-connection cache of prepared statements keyed by SQL text
+ * 
+ * Each statement is prepared once per connection and reused on later
+ * requests, which removes SQL parsing and query planning from the hot path.
+ * A statement is removed from the cache while it is checked out, so two
+ * overlapping uses of the same SQL on one connection never share a handle;
+ * the second use simply gets a freshly prepared statement.
+ * 
+ * Like the connection it belongs to, a cache must only be used by one
+ * thread at a time. The hit/miss counters may be read from any thread.
+ */
+class StatementCache {
+private:
+    sqlite3* db;
+    StatementMap statements;
+    std::atomic<uint64_t> hits{0};
+    std::atomic<uint64_t> misses{0};
+
+    friend class CachedStatement;
+    
+    // Returns a checked-out statement to the cache
+    void release(StatementMap::node_type node) {
+        sqlite3_reset(node.mapped());
+        sqlite3_clear_bindings(node.mapped());
+        
+        auto result = statements.insert(std::move(node));
+        if (!result.inserted) {
+            // Another copy of this statement was cached while this one was out
+            sqlite3_finalize(result.node.mapped());
+        }
+    }
+
+public:
+    explicit StatementCache(sqlite3* db) : db(db) {}
+    
+    ~StatementCache() {
+        clear();
+    }
+    
+    StatementCache(const StatementCache&) = delete;
+    StatementCache& operator=(const StatementCache&) = delete;
+    
     /**
-     * Create database tables using a transaction to ensure atomicity
+     * Checks out a prepared statement for the given SQL
+     * 
+     * @param sql The SQL text, which is also the cache key
+     * @return The statement handle; evaluates to false if preparation failed
+     *         (sqlite3_errmsg on the connection describes the error)
      */
-    executeTransaction(db, [](sqlite3* db) -> bool {
-        char* errMsg = nullptr;
-        const char* sql = R"(
-            CREATE TABLE IF NOT EXISTS posts (
-                id INTEGER PRIMARY KEY AUTOINCREMENT,
-                user_id INTEGER,
-                title TEXT NOT NULL,
-                html_code TEXT,
-                css_code TEXT, 
-                js_code TEXT,
-                isPrivate BOOLEAN DEFAULT 0 NOT NULL,
-                created_at TIMESTAMP DEFAULT CURRENT_TIMESTAMP,
-                updated_at TIMESTAMP DEFAULT CURRENT_TIMESTAMP,
-                FOREIGN KEY (user_id) REFERENCES users(user_id)
-            );
-            
-            CREATE TABLE IF NOT EXISTS users (
-                user_id INTEGER PRIMARY KEY AUTOINCREMENT,
-                username TEXT NOT NULL UNIQUE,
-                email TEXT NOT NULL UNIQUE,
-                password TEXT NOT NULL,
-                created_at TIMESTAMP DEFAULT CURRENT_TIMESTAMP
-            );
-        )";
-        
-        if (sqlite3_exec(db, sql, nullptr, nullptr, &errMsg) != SQLITE_OK) {
-            std::cerr << "SQL error: " << errMsg << std::endl;
-            sqlite3_free(errMsg);
-            return false;
+    CachedStatement prepare(const std::string& sql) {
+        auto node = statements.extract(sql);
+        if (node) {
+            hits.fetch_add(1, std::memory_order_relaxed);
+            return CachedStatement(this, std::move(node));
         }
         
-        // Add column to existing table if it doesn't exist (for compatibility with existing databases)
-        const char* alterSql = "PRAGMA table_info(posts)";
-        sqlite3_stmt* stmt;
+        misses.fetch_add(1, std::memory_order_relaxed);
         
-        if (sqlite3_prepare_v2(db, alterSql, -1, &stmt, nullptr) != SQLITE_OK) {
-            std::cerr << "Error checking table schema: " << sqlite3_errmsg(db) << std::endl;
-            return false;
-        }
+        static const Metrics::Histogram prepareTime = Metrics::instance().histogram(
+            "sqlite_prepare_duration_seconds", "Time spent compiling statements on a cache miss",
+            "", Metrics::fastBoundsUs());
         
-        bool hasPrivateColumn = false;
-        while (sqlite3_step(stmt) == SQLITE_ROW) {
-            std::string colName = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1));
-            if (colName == "isPrivate") {
-                hasPrivateColumn = true;
-                break;
-            }
+        sqlite3_stmt* stmt = nullptr;
+        int rc;
+        {
+            ScopedTimer timer(prepareTime);
+            rc = sqlite3_prepare_v3(db, sql.c_str(), -1, SQLITE_PREPARE_PERSISTENT, &stmt, nullptr);
         }
-        sqlite3_finalize(stmt);
-        
-        if (!hasPrivateColumn) {
-            const char* addColumnSql = "ALTER TABLE posts ADD COLUMN isPrivate BOOLEAN DEFAULT 0 NOT NULL";
-            if (sqlite3_exec(db, addColumnSql, nullptr, nullptr, &errMsg) != SQLITE_OK) {
-                std::cerr << "Error adding isPrivate column: " << errMsg << std::endl;
-                sqlite3_free(errMsg);
-                return false;
-            }
-            std::cout << "Added isPrivate column to existing posts table" << std::endl;
+        if (rc != SQLITE_OK) {
+            return CachedStatement();
         }
         
-        return true;
-    });
+        // Build a detached map node so the key is allocated only once
+        StatementMap holder;
+        holder.emplace(sql, stmt);
+        return CachedStatement(this, holder.extract(holder.begin()));
+    }
+    
+    /**
+     * Finalizes every cached statement
+     * 
+     * Must be called before the owning connection is closed.
+     */
+    void clear() {
+        for (auto& entry : statements) {
+            sqlite3_finalize(entry.second);
+        }
+        statements.clear();
+    }
+    
+    uint64_t hitCount() const { return hits.load(std::memory_order_relaxed); }
+    uint64_t missCount() const { return misses.load(std::memory_order_relaxed); }
+};
+
+inline CachedStatement& CachedStatement::operator=(CachedStatement&& other) noexcept {
+    if (this != &other) {
+        if (cache && node) {
+            cache->release(std::move(node));
+        }
+        cache = other.cache;
+        node = std::move(other.node);
+        other.cache = nullptr;
+    }
+    return *this;
+}
+
+inline CachedStatement::~CachedStatement() {
+    if (cache && node) {
+        cache->release(std::move(node));
+    }
 }
@@ -1,59 +1,232 @@
 #pragma once
 
+#include "Logger.h"
 #include <mutex>
 #include <chrono>
 #include <thread>
 #include <string>
-#include <iostream>
+#include <atomic>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+#include <cstdint>
+
+// Upper bounds (in microseconds) of the wait and hold time histogram buckets;
+// a final overflow bucket catches everything slower
+constexpr int64_t MUTEX_HISTOGRAM_BOUNDS_US[] = {10, 100, 1000, 10000, 100000, 1000000};
+constexpr size_t MUTEX_HISTOGRAM_BUCKETS = sizeof(MUTEX_HISTOGRAM_BOUNDS_US) / sizeof(int64_t) + 1;
+
+/**
+ * Counters shared by every DeadlockSafeMutex with the same name
+ *
+ * All fields are updated with relaxed atomics by the threads using the
+ * mutexes and read without locking when metrics are reported.
+ */
+struct MutexMetrics {
+    std::atomic<uint64_t> acquisitions{0};
+    std::atomic<uint64_t> contended{0};      // Acquisitions that had to wait
+    std::atomic<uint64_t> timeouts{0};
+    std::atomic<uint64_t> waitHistogram[MUTEX_HISTOGRAM_BUCKETS] = {};
+    std::atomic<uint64_t> holdHistogram[MUTEX_HISTOGRAM_BUCKETS] = {};
+    std::atomic<uint64_t> waitSumUs{0};
+    std::atomic<uint64_t> holdSumUs{0};
+    std::atomic<int64_t> maxHoldUs{0};
+
+    static size_t bucketFor(int64_t micros) {
+        size_t bucket = 0;
+        while (bucket < MUTEX_HISTOGRAM_BUCKETS - 1 && micros > MUTEX_HISTOGRAM_BOUNDS_US[bucket]) {
+            bucket++;
+        }
+        return bucket;
+    }
+
+    void recordWait(int64_t micros) {
+        waitHistogram[bucketFor(micros)].fetch_add(1, std::memory_order_relaxed);
+        waitSumUs.fetch_add(static_cast<uint64_t>(micros), std::memory_order_relaxed);
+    }
+
+    void recordHold(int64_t micros) {
+        holdHistogram[bucketFor(micros)].fetch_add(1, std::memory_order_relaxed);
+        holdSumUs.fetch_add(static_cast<uint64_t>(micros), std::memory_order_relaxed);
+        int64_t previous = maxHoldUs.load(std::memory_order_relaxed);
+        while (micros > previous &&
+               !maxHoldUs.compare_exchange_weak(previous, micros, std::memory_order_relaxed)) {
+        }
+    }
+};
+
+/**
+ * Process-wide table of mutex metrics, keyed by mutex name
+ *
+ * Entries are never removed, so the pointers it hands out stay valid for
+ * the lifetime of the program.
+ */
+class MutexMetricsRegistry {
+private:
+    std::mutex mtx;
+    std::unordered_map<std::string, std::unique_ptr<MutexMetrics>> metrics;
+
+public:
+    static MutexMetricsRegistry& instance() {
+        static MutexMetricsRegistry registry;
+        return registry;
+    }
+
+    MutexMetrics* get(const std::string& name) {
+        std::lock_guard<std::mutex> lock(mtx);
+        auto& entry = metrics[name];
+        if (!entry) {
+            entry = std::make_unique<MutexMetrics>();
+        }
+        return entry.get();
+    }
+
+    // Calls visit(name, metrics) for every registered name
+    template <typename Visitor>
+    void forEach(Visitor visit) {
+        std::lock_guard<std::mutex> lock(mtx);
+        for (auto& entry : metrics) {
+            visit(entry.first, *entry.second);
+        }
+    }
+};
 
 /**
  * Enhanced mutex with deadlock detection through timeouts
  * 
- * This class wraps a standard mutex but adds timeout capabilities that help detect
+ * This class wraps a timed mutex and adds timeout capabilities that help detect
  * and prevent deadlocks. If a lock cannot be acquired within the specified time,
  * it's likely due to a deadlock or high contention.
+ * 
+ * Waiters spin briefly, since most critical sections here are short, and then
+ * block in the kernel until the mutex is released or the timeout expires, so
+ * they wake up as soon as the lock is free. Wait times, hold times and
+ * timeouts are recorded in the MutexMetrics for the mutex's metrics name.
  */
 class DeadlockSafeMutex {
 private:
-    std::mutex mtx;
+    // try_lock attempts before falling back to a blocking timed wait
+    static constexpr int SPIN_ATTEMPTS = 64;
+
+    std::timed_mutex mtx;
     std::string name;
-    
+    MutexMetrics* metrics;
+    std::chrono::steady_clock::time_point acquiredAt;  // Only touched by the holder
+
+    static int64_t microsSince(std::chrono::steady_clock::time_point start) {
+        return std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - start).count();
+    }
+
+    void onAcquired(std::chrono::steady_clock::time_point waitStart, bool waited) {
+        acquiredAt = std::chrono::steady_clock::now();
+        metrics->acquisitions.fetch_add(1, std::memory_order_relaxed);
+        if (waited) {
+            metrics->contended.fetch_add(1, std::memory_order_relaxed);
+        }
+        metrics->recordWait(std::chrono::duration_cast<std::chrono::microseconds>(acquiredAt - waitStart).count());
+    }
+
 public:
-    // Constructor with optional name for better debugging
-    DeadlockSafeMutex(const std::string& name = "unnamed") : name(name) {}
-    
+    /**
+     * @param name Name used in deadlock warnings
+     * @param metricsName Name the metrics are aggregated under; defaults to name.
+     *                    Mutexes created per object should share one metrics
+     *                    name so the number of series stays bounded.
+     */
+    DeadlockSafeMutex(const std::string& name = "unnamed", const std::string& metricsName = "")
+        : name(name),
+          metrics(MutexMetricsRegistry::instance().get(metricsName.empty() ? name : metricsName)) {}
+
     /**
      * Attempt to lock the mutex with a timeout
-     * 
+     *
      * @param timeout_ms Maximum time to wait for lock acquisition (in milliseconds)
      * @return true if lock acquired, false if timeout occurred
      */
     bool tryLockWithTimeout(int timeout_ms) {
         auto start = std::chrono::steady_clock::now();
-        
-        while (true) {
-            // Try to get the lock
+
+        // Uncontended or about to be released: no syscall needed
+        for (int attempt = 0; attempt < SPIN_ATTEMPTS; attempt++) {
             if (mtx.try_lock()) {
+                onAcquired(start, attempt > 0);
                 return true;
             }
-            
-            // Check if we've waited too long
-            auto now = std::chrono::steady_clock::now();
-            auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(now - start);
-            
-            if (elapsed.count() >= timeout_ms) {
-                std::cerr << "Deadlock warning: Failed to acquire lock on '" 
-                          << name << "' after " << timeout_ms << "ms" << std::endl;
-                return false;
-            }
-            
-            // Sleep briefly to avoid CPU spin
-            std::this_thread::sleep_for(std::chrono::milliseconds(10));
         }
+
+        // Block until the holder unlocks or the deadline passes
+        if (mtx.try_lock_until(start + std::chrono::milliseconds(timeout_ms))) {
+            onAcquired(start, true);
+            return true;
+        }
+
+        metrics->timeouts.fetch_add(1, std::memory_order_relaxed);
+        metrics->recordWait(microsSince(start));
+        Logger::instance().warn("mutex_timeout", {{"mutex", name}, {"timeout_ms", timeout_ms}});
+        return false;
     }
-    
+
     // Regular mutex operations
-    void lock() { mtx.lock(); }
-    bool try_lock() { return mtx.try_lock(); }
-    void unlock() { mtx.unlock(); }
+    void lock() {
+        auto start = std::chrono::steady_clock::now();
+        if (mtx.try_lock()) {
+            onAcquired(start, false);
+            return;
+        }
+        mtx.lock();
+        onAcquired(start, true);
+    }
+
+    bool try_lock() {
+        auto start = std::chrono::steady_clock::now();
+        if (!mtx.try_lock()) {
+            return false;
+        }
+        onAcquired(start, false);
+        return true;
+    }
+
+    void unlock() {
+        metrics->recordHold(microsSince(acquiredAt));
+        mtx.unlock();
+    }
+
+    const std::string& getName() const { return name; }
+};
+
+/**
+ * Fixed pool of DeadlockSafeMutexes that keys are hashed onto
+ * 
+ * Gives every key (e.g. a post id) a mutex without allocating one per key:
+ * the set of stripes is created once and never grows, so memory stays flat
+ * no matter how many distinct keys are used, and finding a key's mutex is
+ * a modulo with no shared lock. Two keys on the same stripe serialize
+ * against each other, which is harmless as long as the stripe count is
+ * well above the number of concurrent holders.
+ */
+class StripedMutex {
+private:
+    std::vector<std::unique_ptr<DeadlockSafeMutex>> stripes;
+    
+public:
+    /**
+     * @param name Base name; stripes are named name_<index> in warnings and
+     *             share one set of metrics under name
+     * @param stripeCount Number of mutexes in the pool
+     */
+    explicit StripedMutex(const std::string& name, size_t stripeCount = 256) {
+        if (stripeCount == 0) {
+            stripeCount = 1;
+        }
+        stripes.reserve(stripeCount);
+        for (size_t i = 0; i < stripeCount; i++) {
+            stripes.push_back(std::make_unique<DeadlockSafeMutex>(name + "_" + std::to_string(i), name));
+        }
+    }
+    
+    // The mutex guarding a key
+    DeadlockSafeMutex& forKey(int key) {
+        return *stripes[static_cast<size_t>(key) % stripes.size()];
+    }
 };
@@ -0,0 +1,394 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <initializer_list>
+#include <cstdint>
+#include <cstdio>
+#include <ctime>
+
+enum class LogLevel {
+    Debug,
+    Info,
+    Warn,
+    Error
+};
+
+inline const char* logLevelName(LogLevel level) {
+    switch (level) {
+        case LogLevel::Debug: return "debug";
+        case LogLevel::Info: return "info";
+        case LogLevel::Warn: return "warn";
+        default: return "error";
+    }
+}
+
+/**
+ * One key/value pair of a structured log line
+ */
+struct LogField {
+    const char* key;
+    std::string value;
+    bool quoted;  // Strings are JSON-escaped and quoted, numbers written as is
+
+    LogField(const char* key, const std::string& value) : key(key), value(value), quoted(true) {}
+    LogField(const char* key, const char* value) : key(key), value(value ? value : ""), quoted(true) {}
+    LogField(const char* key, int value) : key(key), value(std::to_string(value)), quoted(false) {}
+    LogField(const char* key, long value) : key(key), value(std::to_string(value)), quoted(false) {}
+    LogField(const char* key, long long value) : key(key), value(std::to_string(value)), quoted(false) {}
+    LogField(const char* key, unsigned long value) : key(key), value(std::to_string(value)), quoted(false) {}
+    LogField(const char* key, unsigned long long value) : key(key), value(std::to_string(value)), quoted(false) {}
+    LogField(const char* key, bool value) : key(key), value(value ? "true" : "false"), quoted(false) {}
+};
+
+/**
+ * Asynchronous structured logger writing one JSON object per line
+ *
+ * Request threads never touch the output stream: a log call checks the
+ * level, captures the event and its fields and pushes them onto a bounded
+ * lock-free ring buffer (Vyukov's MPMC queue, used here with a single
+ * consumer). A background thread drains the ring, renders the JSON and
+ * writes it to stderr in large chunks.
+ *
+ * Logging must never slow down or block a request, so when the ring is full
+ * or more than the configured number of lines per second are logged, the
+ * line is dropped and counted instead; the drain thread reports the number
+ * of dropped lines in a "log_dropped" line once the pressure is gone.
+ * Debug lines, which sit on the hottest paths, can additionally be sampled
+ * so that only one in every N is kept.
+ *
+ * Until start() is called (and after stop()), lines are written directly.
+ */
+class Logger {
+private:
+    struct Record {
+        LogLevel level;
+        std::chrono::system_clock::time_point time;
+        const char* event;
+        std::vector<LogField> fields;
+    };
+
+    struct Slot {
+        std::atomic<size_t> sequence;
+        Record record;
+    };
+
+    std::unique_ptr<Slot[]> ring;
+    size_t mask = 0;
+    std::atomic<size_t> enqueuePos{0};
+    size_t dequeuePos = 0;  // Only used by the drain thread
+
+    std::atomic<int> minLevel{static_cast<int>(LogLevel::Info)};
+    std::atomic<bool> bodies{false};
+    std::atomic<uint64_t> maxPerSecond{0};
+    std::atomic<uint64_t> debugSampleEvery{1};
+    std::atomic<uint64_t> debugCalls{0};
+
+    // Rate limiting window: the current second and lines logged in it
+    std::atomic<int64_t> windowSecond{0};
+    std::atomic<uint64_t> windowCount{0};
+
+    std::atomic<uint64_t> dropped{0};
+    std::atomic<bool> running{false};
+
+    std::mutex wakeMutex;
+    std::condition_variable wake;
+    bool stopping = false;
+    std::thread drainThread;
+
+    static void appendEscaped(std::string& out, const std::string& value) {
+        for (char c : value) {
+            switch (c) {
+                case '"': out += "\\\""; break;
+                case '\\': out += "\\\\"; break;
+                case '\n': out += "\\n"; break;
+                case '\r': out += "\\r"; break;
+                case '\t': out += "\\t"; break;
+                default:
+                    if (static_cast<unsigned char>(c) < 0x20) {
+                        char escaped[8];
+                        std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+                        out += escaped;
+                    } else {
+                        out += c;
+                    }
+            }
+        }
+    }
+
+    static void render(std::string& out, const Record& record) {
+        auto millis = std::chrono::duration_cast<std::chrono::milliseconds>(
+            record.time.time_since_epoch()).count();
+        std::time_t seconds = static_cast<std::time_t>(millis / 1000);
+        std::tm utc{};
+        gmtime_r(&seconds, &utc);
+        char timestamp[32];
+        std::strftime(timestamp, sizeof(timestamp), "%Y-%m-%dT%H:%M:%S", &utc);
+
+        char prefix[64];
+        std::snprintf(prefix, sizeof(prefix), "{\"ts\":\"%s.%03dZ\",\"level\":\"", timestamp,
+                      static_cast<int>(millis % 1000));
+        out += prefix;
+        out += logLevelName(record.level);
+        out += "\",\"event\":\"";
+        appendEscaped(out, record.event);
+        out += '"';
+        for (const LogField& field : record.fields) {
+            out += ",\"";
+            appendEscaped(out, field.key);
+            out += "\":";
+            if (field.quoted) {
+                out += '"';
+                appendEscaped(out, field.value);
+                out += '"';
+            } else {
+                out += field.value;
+            }
+        }
+        out += "}\n";
+    }
+
+    static void writeOut(const std::string& text) {
+        std::fwrite(text.data(), 1, text.size(), stderr);
+        std::fflush(stderr);
+    }
+
+    // Claims a line in the current one-second window
+    bool withinRate() {
+        uint64_t limit = maxPerSecond.load(std::memory_order_relaxed);
+        if (limit == 0) {
+            return true;
+        }
+        int64_t now = std::chrono::duration_cast<std::chrono::seconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+        int64_t window = windowSecond.load(std::memory_order_relaxed);
+        if (window != now && windowSecond.compare_exchange_strong(window, now, std::memory_order_relaxed)) {
+            windowCount.store(0, std::memory_order_relaxed);
+        }
+        return windowCount.fetch_add(1, std::memory_order_relaxed) < limit;
+    }
+
+    bool tryPush(Record&& record) {
+        size_t pos = enqueuePos.load(std::memory_order_relaxed);
+        while (true) {
+            Slot& slot = ring[pos & mask];
+            size_t sequence = slot.sequence.load(std::memory_order_acquire);
+            intptr_t difference = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+            if (difference == 0) {
+                if (enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    slot.record = std::move(record);
+                    slot.sequence.store(pos + 1, std::memory_order_release);
+                    // Wake the drain thread early during bursts, once per half ring
+                    if (((pos + 1) & (mask >> 1)) == 0) {
+                        wake.notify_one();
+                    }
+                    return true;
+                }
+            } else if (difference < 0) {
+                return false;  // Full
+            } else {
+                pos = enqueuePos.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    bool tryPop(Record& record) {
+        Slot& slot = ring[dequeuePos & mask];
+        size_t sequence = slot.sequence.load(std::memory_order_acquire);
+        if (sequence != dequeuePos + 1) {
+            return false;  // Empty
+        }
+        record = std::move(slot.record);
+        slot.sequence.store(dequeuePos + mask + 1, std::memory_order_release);
+        dequeuePos++;
+        return true;
+    }
+
+    // Renders everything queued; returns false if there was nothing
+    bool drain(std::string& buffer) {
+        Record record;
+        bool any = false;
+        while (tryPop(record)) {
+            render(buffer, record);
+            any = true;
+            if (buffer.size() >= 64 * 1024) {
+                writeOut(buffer);
+                buffer.clear();
+            }
+        }
+        return any;
+    }
+
+    void reportDropped(std::string& buffer) {
+        uint64_t count = dropped.exchange(0, std::memory_order_relaxed);
+        if (count > 0) {
+            render(buffer, Record{LogLevel::Warn, std::chrono::system_clock::now(), "log_dropped",
+                                  {LogField("count", static_cast<unsigned long long>(count))}});
+        }
+    }
+
+    void run() {
+        std::string buffer;
+        while (true) {
+            bool any = drain(buffer);
+            if (!any) {
+                reportDropped(buffer);
+            }
+            if (!buffer.empty()) {
+                writeOut(buffer);
+                buffer.clear();
+            }
+            if (any) {
+                continue;
+            }
+
+            // Producers only signal during bursts, so also poll at a short interval
+            std::unique_lock<std::mutex> lock(wakeMutex);
+            if (stopping) {
+                break;
+            }
+            wake.wait_for(lock, std::chrono::milliseconds(10));
+        }
+
+        drain(buffer);
+        reportDropped(buffer);
+        if (!buffer.empty()) {
+            writeOut(buffer);
+        }
+    }
+
+    Logger() = default;
+
+public:
+    static Logger& instance() {
+        static Logger logger;
+        return logger;
+    }
+
+    ~Logger() {
+        stop();
+    }
+
+    Logger(const Logger&) = delete;
+    Logger& operator=(const Logger&) = delete;
+
+    /**
+     * Sets which lines are kept; safe to change at any time
+     *
+     * @param level Lines below this level are discarded at the call site
+     * @param maxLinesPerSecond Lines allowed per second before dropping (0 = unlimited)
+     * @param logBodies Whether request bodies may be logged (see logBodies())
+     * @param debugSample Keep one in this many debug lines
+     */
+    void configure(LogLevel level, uint64_t maxLinesPerSecond, bool logBodies, uint64_t debugSample = 1) {
+        minLevel.store(static_cast<int>(level), std::memory_order_relaxed);
+        maxPerSecond.store(maxLinesPerSecond, std::memory_order_relaxed);
+        bodies.store(logBodies, std::memory_order_relaxed);
+        debugSampleEvery.store(debugSample == 0 ? 1 : debugSample, std::memory_order_relaxed);
+    }
+
+    /**
+     * Starts the drain thread; lines are queued from now on
+     *
+     * @param capacity Ring size in lines, rounded up to a power of two
+     */
+    void start(size_t capacity = 8192) {
+        if (running.load()) {
+            return;
+        }
+        size_t size = 2;
+        while (size < capacity) {
+            size <<= 1;
+        }
+        ring.reset(new Slot[size]);
+        for (size_t i = 0; i < size; i++) {
+            ring[i].sequence.store(i, std::memory_order_relaxed);
+        }
+        mask = size - 1;
+        enqueuePos.store(0);
+        dequeuePos = 0;
+        stopping = false;
+        drainThread = std::thread(&Logger::run, this);
+        running.store(true, std::memory_order_release);
+    }
+
+    /**
+     * Writes out everything queued and joins the drain thread
+     *
+     * Only call once no other thread logs anymore.
+     */
+    void stop() {
+        if (!running.exchange(false)) {
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(wakeMutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        if (drainThread.joinable()) {
+            drainThread.join();
+        }
+    }
+
+    bool enabled(LogLevel level) const {
+        return static_cast<int>(level) >= minLevel.load(std::memory_order_relaxed);
+    }
+
+    // Whether request bodies may be logged; off by default since they can be large and private
+    bool logBodies() const {
+        return bodies.load(std::memory_order_relaxed);
+    }
+
+    // Lines dropped so far and not yet reported
+    uint64_t droppedLines() const {
+        return dropped.load(std::memory_order_relaxed);
+    }
+
+    void log(LogLevel level, const char* event, std::initializer_list<LogField> fields = {}) {
+        if (!enabled(level)) {
+            return;
+        }
+        if (level == LogLevel::Debug) {
+            uint64_t every = debugSampleEvery.load(std::memory_order_relaxed);
+            if (every > 1 && debugCalls.fetch_add(1, std::memory_order_relaxed) % every != 0) {
+                return;
+            }
+        }
+        if (!withinRate()) {
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+
+        Record record{level, std::chrono::system_clock::now(), event, std::vector<LogField>(fields)};
+        if (!running.load(std::memory_order_acquire)) {
+            std::string line;
+            render(line, record);
+            writeOut(line);
+            return;
+        }
+        if (!tryPush(std::move(record))) {
+            dropped.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    void debug(const char* event, std::initializer_list<LogField> fields = {}) { log(LogLevel::Debug, event, fields); }
+    void info(const char* event, std::initializer_list<LogField> fields = {}) { log(LogLevel::Info, event, fields); }
+    void warn(const char* event, std::initializer_list<LogField> fields = {}) { log(LogLevel::Warn, event, fields); }
+    void error(const char* event, std::initializer_list<LogField> fields = {}) { log(LogLevel::Error, event, fields); }
+};
+
+/**
+ * Parses a log level name, falling back to info for unknown names
+ */
+inline LogLevel parseLogLevel(const std::string& name) {
+    if (name == "debug") return LogLevel::Debug;
+    if (name == "warn") return LogLevel::Warn;
+    if (name == "error") return LogLevel::Error;
+    return LogLevel::Info;
+}
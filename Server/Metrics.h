@@ -0,0 +1,336 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <functional>
+#include <chrono>
+#include <stdexcept>
+#include <cstdint>
+#include <cstdio>
+
+/**
+ * Process-wide counters and histograms, exported in Prometheus text format
+ *
+ * Every thread that records a metric gets its own block of counter slots,
+ * and only that thread ever writes to it, so recording is a plain relaxed
+ * load and store on a thread-private cache line: no locks, no atomic
+ * read-modify-write and no contention however many threads record at once.
+ * A scrape sums the slot across all blocks. Blocks of exited threads are
+ * recycled by new threads with their counts intact, so totals never drop.
+ *
+ * Metrics are registered (usually at startup or in a function-local static)
+ * under the registry mutex, which recording never takes. Values that
+ * already live elsewhere, like the size of a table, are reported through
+ * collectors that run at scrape time.
+ */
+class Metrics {
+public:
+    // Slots available per thread block; each counter takes one, each
+    // histogram one per bucket plus one for the sum
+    static constexpr size_t MAX_SLOTS = 8192;
+
+    struct Counter {
+        size_t slot;
+    };
+
+    struct Histogram {
+        size_t firstSlot;
+        const std::vector<int64_t>* boundsUs;  // Owned by the registry
+    };
+
+    // Bucket bounds for request-style latencies, in microseconds
+    static const std::vector<int64_t>& latencyBoundsUs() {
+        static const std::vector<int64_t> bounds = {
+            100, 250, 500, 1000, 2500, 5000, 10000, 25000, 50000,
+            100000, 250000, 500000, 1000000, 2500000, 5000000
+        };
+        return bounds;
+    }
+
+    // Bucket bounds for fast operations such as single SQLite calls, in microseconds
+    static const std::vector<int64_t>& fastBoundsUs() {
+        static const std::vector<int64_t> bounds = {
+            5, 10, 25, 50, 100, 250, 500, 1000, 2500, 5000, 10000, 50000, 100000, 1000000
+        };
+        return bounds;
+    }
+
+    // Appends Prometheus text to the scrape output
+    using Collector = std::function<void(std::string&)>;
+
+private:
+    struct ThreadBlock {
+        std::atomic<uint64_t> slots[MAX_SLOTS] = {};
+    };
+
+    enum class Kind { Counter, Histogram };
+
+    struct Series {
+        std::string labels;    // Rendered label pairs without braces, may be empty
+        size_t slot;
+        const std::vector<int64_t>* boundsUs;
+    };
+
+    struct Family {
+        std::string name;
+        std::string help;
+        Kind kind;
+        std::vector<Series> series;
+    };
+
+    std::mutex mtx;
+    std::vector<std::unique_ptr<ThreadBlock>> blocks;
+    std::vector<ThreadBlock*> freeBlocks;
+    std::vector<std::unique_ptr<Family>> families;
+    std::vector<std::unique_ptr<std::vector<int64_t>>> boundSets;
+    std::vector<Collector> collectors;
+    size_t nextSlot = 0;
+
+    // Lends the calling thread a block for as long as it runs
+    class ThreadHandle {
+    public:
+        ThreadBlock* block;
+
+        ThreadHandle() {
+            Metrics& metrics = instance();
+            std::lock_guard<std::mutex> lock(metrics.mtx);
+            if (!metrics.freeBlocks.empty()) {
+                block = metrics.freeBlocks.back();
+                metrics.freeBlocks.pop_back();
+            } else {
+                metrics.blocks.push_back(std::make_unique<ThreadBlock>());
+                block = metrics.blocks.back().get();
+            }
+        }
+
+        ~ThreadHandle() {
+            Metrics& metrics = instance();
+            std::lock_guard<std::mutex> lock(metrics.mtx);
+            metrics.freeBlocks.push_back(block);
+        }
+    };
+
+    static ThreadBlock& localBlock() {
+        thread_local ThreadHandle handle;
+        return *handle.block;
+    }
+
+    static void add(size_t slot, uint64_t amount) {
+        std::atomic<uint64_t>& value = localBlock().slots[slot];
+        value.store(value.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+    }
+
+    Family& family(const std::string& name, const std::string& help, Kind kind) {
+        for (auto& existing : families) {
+            if (existing->name == name) {
+                if (existing->kind != kind) {
+                    throw std::invalid_argument("Metric " + name + " registered with two types");
+                }
+                return *existing;
+            }
+        }
+        families.push_back(std::make_unique<Family>(Family{name, help, kind, {}}));
+        return *families.back();
+    }
+
+    size_t allocate(size_t count) {
+        if (nextSlot + count > MAX_SLOTS) {
+            throw std::length_error("Metrics: out of counter slots");
+        }
+        size_t first = nextSlot;
+        nextSlot += count;
+        return first;
+    }
+
+    uint64_t sum(size_t slot) const {
+        uint64_t total = 0;
+        for (const auto& block : blocks) {
+            total += block->slots[slot].load(std::memory_order_relaxed);
+        }
+        return total;
+    }
+
+    static std::string withLabels(const std::string& name, const std::string& labels, const std::string& extra = "") {
+        std::string combined = labels;
+        if (!extra.empty()) {
+            combined += combined.empty() ? extra : "," + extra;
+        }
+        return combined.empty() ? name : name + "{" + combined + "}";
+    }
+
+    Metrics() = default;
+
+public:
+    static Metrics& instance() {
+        static Metrics metrics;
+        return metrics;
+    }
+
+    Metrics(const Metrics&) = delete;
+    Metrics& operator=(const Metrics&) = delete;
+
+    /**
+     * Registers a counter series
+     *
+     * @param name Metric name, shared by every series of the family
+     * @param help Description exported with the family
+     * @param labels Label pairs such as route="/posts",method="GET"
+     */
+    Counter counter(const std::string& name, const std::string& help, const std::string& labels = "") {
+        std::lock_guard<std::mutex> lock(mtx);
+        Family& target = family(name, help, Kind::Counter);
+        for (const Series& series : target.series) {
+            if (series.labels == labels) {
+                return Counter{series.slot};
+            }
+        }
+        size_t slot = allocate(1);
+        target.series.push_back(Series{labels, slot, nullptr});
+        return Counter{slot};
+    }
+
+    /**
+     * Registers a histogram series recorded in microseconds and exported in seconds
+     *
+     * @param boundsUs Ascending bucket upper bounds in microseconds
+     */
+    Histogram histogram(const std::string& name, const std::string& help, const std::string& labels = "",
+                        const std::vector<int64_t>& boundsUs = latencyBoundsUs()) {
+        std::lock_guard<std::mutex> lock(mtx);
+        Family& target = family(name, help, Kind::Histogram);
+        for (const Series& series : target.series) {
+            if (series.labels == labels) {
+                return Histogram{series.slot, series.boundsUs};
+            }
+        }
+
+        const std::vector<int64_t>* bounds = nullptr;
+        for (const auto& existing : boundSets) {
+            if (*existing == boundsUs) {
+                bounds = existing.get();
+            }
+        }
+        if (bounds == nullptr) {
+            boundSets.push_back(std::make_unique<std::vector<int64_t>>(boundsUs));
+            bounds = boundSets.back().get();
+        }
+
+        // One slot per bucket, one overflow bucket and the sum
+        size_t slot = allocate(bounds->size() + 2);
+        target.series.push_back(Series{labels, slot, bounds});
+        return Histogram{slot, bounds};
+    }
+
+    /**
+     * Adds a function that writes metrics owned by other components at scrape time
+     */
+    void addCollector(Collector collector) {
+        std::lock_guard<std::mutex> lock(mtx);
+        collectors.push_back(std::move(collector));
+    }
+
+    static void increment(Counter counter, uint64_t amount = 1) {
+        add(counter.slot, amount);
+    }
+
+    static void observe(Histogram histogram, int64_t micros) {
+        if (micros < 0) {
+            micros = 0;
+        }
+        const std::vector<int64_t>& bounds = *histogram.boundsUs;
+        size_t bucket = 0;
+        while (bucket < bounds.size() && micros > bounds[bucket]) {
+            bucket++;
+        }
+        add(histogram.firstSlot + bucket, 1);
+        add(histogram.firstSlot + bounds.size() + 1, static_cast<uint64_t>(micros));
+    }
+
+    /**
+     * Writes the HELP and TYPE header of a family, for use in collectors
+     */
+    static void writeHeader(std::string& out, const std::string& name, const std::string& help, const char* type) {
+        out += "# HELP " + name + " " + help + "\n";
+        out += "# TYPE " + name + " " + type + "\n";
+    }
+
+    /**
+     * Writes one sample line, for use in collectors
+     */
+    static void writeSample(std::string& out, const std::string& name, const std::string& labels, double value) {
+        char number[32];
+        std::snprintf(number, sizeof(number), "%.17g", value);
+        out += withLabels(name, labels) + " " + number + "\n";
+    }
+
+    /**
+     * Renders every registered metric in the Prometheus text exposition format
+     */
+    std::string scrape() {
+        std::string out;
+        std::vector<Collector> pending;
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            for (const auto& target : families) {
+                if (target->kind == Kind::Counter) {
+                    writeHeader(out, target->name, target->help, "counter");
+                    for (const Series& series : target->series) {
+                        writeSample(out, target->name, series.labels, static_cast<double>(sum(series.slot)));
+                    }
+                    continue;
+                }
+
+                writeHeader(out, target->name, target->help, "histogram");
+                for (const Series& series : target->series) {
+                    const std::vector<int64_t>& bounds = *series.boundsUs;
+                    uint64_t cumulative = 0;
+                    for (size_t bucket = 0; bucket <= bounds.size(); bucket++) {
+                        cumulative += sum(series.slot + bucket);
+                        char le[32];
+                        if (bucket < bounds.size()) {
+                            std::snprintf(le, sizeof(le), "le=\"%g\"", bounds[bucket] / 1e6);
+                        } else {
+                            std::snprintf(le, sizeof(le), "le=\"+Inf\"");
+                        }
+                        out += withLabels(target->name + "_bucket", series.labels, le) + " " +
+                               std::to_string(cumulative) + "\n";
+                    }
+                    writeSample(out, target->name + "_sum", series.labels,
+                                sum(series.slot + bounds.size() + 1) / 1e6);
+                    out += withLabels(target->name + "_count", series.labels) + " " +
+                           std::to_string(cumulative) + "\n";
+                }
+            }
+            pending = collectors;
+        }
+
+        // Collectors take their components' own locks, so run them unlocked
+        for (const Collector& collector : pending) {
+            collector(out);
+        }
+        return out;
+    }
+};
+
+/**
+ * Records the time from construction to destruction in a histogram
+ */
+class ScopedTimer {
+private:
+    Metrics::Histogram histogram;
+    std::chrono::steady_clock::time_point start;
+
+public:
+    explicit ScopedTimer(Metrics::Histogram histogram)
+        : histogram(histogram), start(std::chrono::steady_clock::now()) {}
+
+    ~ScopedTimer() {
+        Metrics::observe(histogram, std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - start).count());
+    }
+
+    ScopedTimer(const ScopedTimer&) = delete;
+    ScopedTimer& operator=(const ScopedTimer&) = delete;
+};
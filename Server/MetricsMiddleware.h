@@ -0,0 +1,139 @@
+#pragma once
+#include "crow.h"
+#include "Metrics.h"
+#include <string>
+#include <vector>
+#include <chrono>
+#include <unordered_map>
+
+/**
+ * Crow middleware that records the latency and status of every request
+ *
+ * Requests are attributed to a route template such as "/posts/<int>",
+ * obtained by replacing every numeric path segment of the URL with <int>.
+ * Only routes registered with trackRoutes get their own series; any other
+ * URL is counted under route="other", so scanners probing random paths
+ * cannot grow the number of series.
+ *
+ * All series are registered up front, so handling a request only does an
+ * unlocked lookup in an immutable map plus two Metrics updates.
+ */
+struct MetricsMiddleware {
+    struct context {
+        std::chrono::steady_clock::time_point start;
+    };
+
+    /**
+     * Registers the route templates that get their own series
+     *
+     * Must be called before the server starts handling requests.
+     */
+    void trackRoutes(const std::vector<std::string>& routes) {
+        for (const std::string& route : routes) {
+            if (routeIndex.find(route) == routeIndex.end()) {
+                routeIndex[route] = addRoute(route);
+            }
+        }
+    }
+
+    void before_handle(crow::request& /*req*/, crow::response& /*res*/, context& ctx) {
+        ctx.start = std::chrono::steady_clock::now();
+    }
+
+    void after_handle(crow::request& req, crow::response& res, context& ctx) {
+        if (routes.empty()) {
+            return;
+        }
+        auto it = routeIndex.find(routeTemplate(req.url));
+        const RouteMetrics& route = routes[it == routeIndex.end() ? 0 : it->second];
+        size_t method = methodIndex(req.method);
+
+        int statusClass = res.code / 100;
+        if (statusClass < 1 || statusClass > 5) {
+            statusClass = 5;
+        }
+
+        Metrics::increment(route.responses[method][statusClass - 1]);
+        Metrics::observe(route.latency[method], std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - ctx.start).count());
+    }
+
+    /**
+     * Reduces a request path to its route template
+     */
+    static std::string routeTemplate(const std::string& url) {
+        std::string path = url.substr(0, url.find('?'));
+        std::string result;
+        result.reserve(path.size());
+
+        size_t start = 0;
+        while (start < path.size()) {
+            size_t end = path.find('/', start + 1);
+            if (end == std::string::npos) {
+                end = path.size();
+            }
+            // Segment including its leading slash
+            std::string segment = path.substr(start, end - start);
+            bool numeric = segment.size() > 1;
+            for (size_t i = 1; i < segment.size() && numeric; i++) {
+                numeric = segment[i] >= '0' && segment[i] <= '9';
+            }
+            result += numeric ? "/<int>" : segment;
+            start = end;
+        }
+        return result.empty() ? "/" : result;
+    }
+
+private:
+    static constexpr size_t METHOD_COUNT = 7;
+    static constexpr size_t STATUS_CLASSES = 5;
+
+    struct RouteMetrics {
+        Metrics::Histogram latency[METHOD_COUNT];
+        Metrics::Counter responses[METHOD_COUNT][STATUS_CLASSES];
+    };
+
+    static const char* methodName(size_t index) {
+        static const char* names[METHOD_COUNT] = {"GET", "POST", "PUT", "PATCH", "DELETE", "OPTIONS", "OTHER"};
+        return names[index];
+    }
+
+    static size_t methodIndex(crow::HTTPMethod method) {
+        switch (method) {
+            case crow::HTTPMethod::Get: return 0;
+            case crow::HTTPMethod::Post: return 1;
+            case crow::HTTPMethod::Put: return 2;
+            case crow::HTTPMethod::Patch: return 3;
+            case crow::HTTPMethod::Delete: return 4;
+            case crow::HTTPMethod::Options: return 5;
+            default: return 6;
+        }
+    }
+
+    std::vector<RouteMetrics> routes;  // routes[0] collects untracked URLs
+    std::unordered_map<std::string, size_t> routeIndex;
+
+    size_t addRoute(const std::string& route) {
+        if (routes.empty()) {
+            routes.push_back(registerRoute("other"));
+        }
+        routes.push_back(registerRoute(route));
+        return routes.size() - 1;
+    }
+
+    static RouteMetrics registerRoute(const std::string& route) {
+        Metrics& metrics = Metrics::instance();
+        RouteMetrics result;
+        for (size_t method = 0; method < METHOD_COUNT; method++) {
+            std::string labels = "route=\"" + route + "\",method=\"" + methodName(method) + "\"";
+            result.latency[method] = metrics.histogram(
+                "http_request_duration_seconds", "Time spent handling HTTP requests", labels);
+            for (size_t statusClass = 0; statusClass < STATUS_CLASSES; statusClass++) {
+                result.responses[method][statusClass] = metrics.counter(
+                    "http_requests_total", "HTTP requests by route, method and status class",
+                    labels + ",status=\"" + std::to_string(statusClass + 1) + "xx\"");
+            }
+        }
+        return result;
+    }
+};
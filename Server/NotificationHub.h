@@ -0,0 +1,293 @@
+#pragma once
+#include "crow.h"
+#include "PostLockSystem.h"
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include <unordered_map>
+#include <unordered_set>
+#include <cstdint>
+
+/**
+ * Per-post publish/subscribe hub for WebSocket clients
+ *
+ * Subscribers are indexed by post id in independently locked shards, so a
+ * publish only touches the shard of its post and walks that post's
+ * subscriber list; publishing to one post never blocks subscribers or
+ * publishers of posts in other shards. Each message is serialized once
+ * and handed to every subscriber, and Crow queues the actual socket write
+ * on the connection's own I/O thread.
+ *
+ * Connections must be removed (removeConnection) from the WebSocket close
+ * and error handlers. Removal takes the same shard mutexes as publish, so
+ * once it returns no publisher can still be using the connection.
+ *
+ * Each subscription remembers the user it was authorized for, so when a
+ * post turns private, revokeExcept can drop everyone but its owner.
+ */
+class NotificationHub {
+private:
+    using Connection = crow::websocket::connection;
+
+    struct Subscriber {
+        Connection* conn;
+        int userId;     // -1 for anonymous subscribers
+    };
+
+    struct Shard {
+        std::mutex mtx;
+        std::unordered_map<int, std::vector<Subscriber>> subscribers;
+    };
+
+    std::vector<std::unique_ptr<Shard>> shards;
+
+    // Posts each open connection is subscribed to; lock before any shard mutex
+    std::mutex connectionsMutex;
+    std::unordered_map<Connection*, std::unordered_set<int>> connections;
+
+    std::atomic<uint64_t> published{0};
+    std::atomic<uint64_t> delivered{0};
+
+    Shard& shardFor(int postId) {
+        return *shards[static_cast<size_t>(postId) % shards.size()];
+    }
+
+    // Removes a connection from one post's subscriber list
+    void detach(Connection* conn, int postId) {
+        Shard& shard = shardFor(postId);
+        std::lock_guard<std::mutex> lock(shard.mtx);
+
+        auto it = shard.subscribers.find(postId);
+        if (it == shard.subscribers.end()) {
+            return;
+        }
+        auto& list = it->second;
+        auto pos = std::find_if(list.begin(), list.end(),
+                                [conn](const Subscriber& subscriber) { return subscriber.conn == conn; });
+        if (pos != list.end()) {
+            // Order does not matter, so swap-and-pop instead of shifting
+            *pos = list.back();
+            list.pop_back();
+        }
+        if (list.empty()) {
+            shard.subscribers.erase(it);
+        }
+    }
+
+public:
+    // Upper bound on posts a single connection may follow
+    static constexpr size_t MAX_SUBSCRIPTIONS_PER_CONNECTION = 64;
+
+    struct Stats {
+        size_t connections;
+        size_t subscriptions;
+        uint64_t published;
+        uint64_t delivered;
+    };
+
+    /**
+     * @param shardCount Number of independently locked shards
+     */
+    explicit NotificationHub(size_t shardCount = 64) {
+        if (shardCount == 0) {
+            shardCount = 1;
+        }
+        for (size_t i = 0; i < shardCount; i++) {
+            shards.push_back(std::make_unique<Shard>());
+        }
+    }
+
+    NotificationHub(const NotificationHub&) = delete;
+    NotificationHub& operator=(const NotificationHub&) = delete;
+
+    void addConnection(Connection& conn) {
+        std::lock_guard<std::mutex> lock(connectionsMutex);
+        connections[&conn];
+    }
+
+    /**
+     * Drops a connection and all of its subscriptions
+     */
+    void removeConnection(Connection& conn) {
+        std::unordered_set<int> posts;
+        {
+            std::lock_guard<std::mutex> lock(connectionsMutex);
+            auto it = connections.find(&conn);
+            if (it == connections.end()) {
+                return;
+            }
+            posts = std::move(it->second);
+            connections.erase(it);
+        }
+
+        for (int postId : posts) {
+            detach(&conn, postId);
+        }
+    }
+
+    /**
+     * Subscribes a connection to the events of a post
+     *
+     * @param userId The user the subscription was authorized for, or -1
+     * @return false if the connection is unknown or already follows the
+     *         maximum number of posts
+     */
+    bool subscribe(Connection& conn, int postId, int userId = -1) {
+        std::lock_guard<std::mutex> lock(connectionsMutex);
+        auto it = connections.find(&conn);
+        if (it == connections.end()) {
+            return false;
+        }
+        if (it->second.count(postId)) {
+            // A repeated subscribe may come with a different token
+            Shard& shard = shardFor(postId);
+            std::lock_guard<std::mutex> shardLock(shard.mtx);
+            for (Subscriber& subscriber : shard.subscribers[postId]) {
+                if (subscriber.conn == &conn) {
+                    subscriber.userId = userId;
+                }
+            }
+            return true;
+        }
+        if (it->second.size() >= MAX_SUBSCRIPTIONS_PER_CONNECTION) {
+            return false;
+        }
+        it->second.insert(postId);
+
+        Shard& shard = shardFor(postId);
+        std::lock_guard<std::mutex> shardLock(shard.mtx);
+        shard.subscribers[postId].push_back(Subscriber{&conn, userId});
+        return true;
+    }
+
+    void unsubscribe(Connection& conn, int postId) {
+        std::lock_guard<std::mutex> lock(connectionsMutex);
+        auto it = connections.find(&conn);
+        if (it == connections.end() || it->second.erase(postId) == 0) {
+            return;
+        }
+        detach(&conn, postId);
+    }
+
+    /**
+     * Drops every subscription to a post except those of one user
+     *
+     * Called when a post turns private, with its owner's id. Each dropped
+     * connection is sent `notice` so the client knows it stopped following
+     * the post.
+     *
+     * @return Number of subscriptions dropped
+     */
+    size_t revokeExcept(int postId, int userId, const std::string& notice) {
+        std::lock_guard<std::mutex> lock(connectionsMutex);
+        Shard& shard = shardFor(postId);
+        std::lock_guard<std::mutex> shardLock(shard.mtx);
+
+        auto it = shard.subscribers.find(postId);
+        if (it == shard.subscribers.end()) {
+            return 0;
+        }
+        auto& list = it->second;
+        size_t revoked = 0;
+        for (size_t i = 0; i < list.size();) {
+            if (list[i].userId == userId) {
+                i++;
+                continue;
+            }
+            auto conn = connections.find(list[i].conn);
+            if (conn != connections.end()) {
+                conn->second.erase(postId);
+            }
+            list[i].conn->send_text(notice);
+            list[i] = list.back();
+            list.pop_back();
+            revoked++;
+        }
+        if (list.empty()) {
+            shard.subscribers.erase(it);
+        }
+        return revoked;
+    }
+
+    /**
+     * Sends a message to every subscriber of a post
+     *
+     * @return Number of connections the message was queued for
+     */
+    size_t publish(int postId, const std::string& message) {
+        published.fetch_add(1, std::memory_order_relaxed);
+
+        Shard& shard = shardFor(postId);
+        std::lock_guard<std::mutex> lock(shard.mtx);
+
+        auto it = shard.subscribers.find(postId);
+        if (it == shard.subscribers.end()) {
+            return 0;
+        }
+        for (const Subscriber& subscriber : it->second) {
+            subscriber.conn->send_text(message);
+        }
+        delivered.fetch_add(it->second.size(), std::memory_order_relaxed);
+        return it->second.size();
+    }
+
+    Stats stats() {
+        Stats result{};
+        result.published = published.load(std::memory_order_relaxed);
+        result.delivered = delivered.load(std::memory_order_relaxed);
+
+        std::lock_guard<std::mutex> lock(connectionsMutex);
+        result.connections = connections.size();
+        for (const auto& entry : connections) {
+            result.subscriptions += entry.second.size();
+        }
+        return result;
+    }
+};
+
+/**
+ * Builds a lock event for subscribers of a post
+ *
+ * @param event One of "acquired", "extended", "released" or "expired"
+ * @param lock The lock the event is about
+ */
+inline std::string lockEventMessage(int postId, const char* event, const PostLock& lock) {
+    crow::json::wvalue message;
+    message["type"] = "lock";
+    message["event"] = event;
+    message["post_id"] = postId;
+    message["user_id"] = lock.user_id;
+    message["username"] = lock.username;
+    message["expires_at"] = std::chrono::duration_cast<std::chrono::seconds>(
+        lock.expires_at.time_since_epoch()).count();
+    return message.dump();
+}
+
+/**
+ * Builds a post change event for subscribers of a post
+ *
+ * @param event Either "updated" or "deleted"
+ */
+inline std::string postEventMessage(int postId, const char* event) {
+    crow::json::wvalue message;
+    message["type"] = "post";
+    message["event"] = event;
+    message["post_id"] = postId;
+    return message.dump();
+}
+
+/**
+ * Tells a subscriber it no longer receives the events of a post that
+ * turned private; shaped like the errors of the /ws route
+ */
+inline std::string accessRevokedMessage(int postId) {
+    crow::json::wvalue message;
+    message["type"] = "error";
+    message["message"] = "Access denied: This post is private";
+    message["post_id"] = postId;
+    return message.dump();
+}
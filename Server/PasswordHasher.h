@@ -0,0 +1,337 @@
+#pragma once
+#include <openssl/evp.h>
+#include <openssl/crypto.h>
+#include <openssl/rand.h>
+#include <string>
+#include <vector>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <cstdint>
+
+/**
+ * PBKDF2-HMAC-SHA256 password hashing on a dedicated, bounded worker pool
+ *
+ * Hashing is deliberately expensive, so it never runs on the caller's
+ * thread: requests queue it for a fixed set of hashing threads and wait for
+ * the result. However many logins arrive at once, hashing occupies at most
+ * that many cores. When the queue is full new work is refused (Busy)
+ * instead of piling up.
+ *
+ * A caller waiting for its result still holds the request thread it runs
+ * on, so at most maxWaiting callers may wait at once and any more are
+ * refused (Busy) straight away. Kept below the number of request threads,
+ * a burst of logins cannot park every one of them, and the rest stay free
+ * for serving other requests. Background hashes have no waiter and only
+ * count against the queue.
+ *
+ * Hashes are stored as "pbkdf2_sha256$<iterations>$<hex salt>$<hex hash>".
+ * Rows written before hashing existed hold the plaintext password; they
+ * still verify, and are reported as needing a rehash, as are hashes made
+ * with a different iteration count than the current one.
+ */
+class PasswordHasher {
+public:
+    enum class VerifyResult {
+        Match,
+        MatchNeedsRehash,   // Correct, but stored as plaintext or with another cost
+        Mismatch,
+        Busy                // The hashing queue is full
+    };
+
+    struct Stats {
+        uint64_t hashed;
+        uint64_t rejected;  // Requests refused because the queue or the waiters were full
+        size_t queued;
+        size_t waiting;     // Callers blocked on a result
+    };
+
+private:
+    static constexpr const char* PREFIX = "pbkdf2_sha256$";
+    static constexpr size_t SALT_BYTES = 16;
+    static constexpr size_t HASH_BYTES = 32;
+
+    int iterations;
+    size_t maxQueued;
+    size_t maxWaiting;
+
+    std::mutex mtx;
+    std::condition_variable ready;
+    std::deque<std::function<void()>> tasks;
+    bool stopping = false;
+    size_t waiting = 0;
+    std::vector<std::thread> workers;
+
+    std::atomic<uint64_t> hashed{0};
+    std::atomic<uint64_t> rejected{0};
+
+    // Verified against when a username does not exist, so that a failed
+    // login takes as long whether or not the user exists
+    std::string dummyHash;
+
+    static std::string toHex(const unsigned char* data, size_t length) {
+        static const char digits[] = "0123456789abcdef";
+        std::string hex;
+        hex.reserve(length * 2);
+        for (size_t i = 0; i < length; i++) {
+            hex.push_back(digits[data[i] >> 4]);
+            hex.push_back(digits[data[i] & 0x0f]);
+        }
+        return hex;
+    }
+
+    static bool fromHex(const std::string& hex, std::vector<unsigned char>& bytes) {
+        if (hex.size() % 2 != 0) {
+            return false;
+        }
+        auto nibble = [](char c) -> int {
+            if (c >= '0' && c <= '9') return c - '0';
+            if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+            return -1;
+        };
+        bytes.resize(hex.size() / 2);
+        for (size_t i = 0; i < bytes.size(); i++) {
+            int high = nibble(hex[2 * i]);
+            int low = nibble(hex[2 * i + 1]);
+            if (high < 0 || low < 0) {
+                return false;
+            }
+            bytes[i] = static_cast<unsigned char>(high << 4 | low);
+        }
+        return true;
+    }
+
+    static bool derive(const std::string& password, const unsigned char* salt, size_t saltLength,
+                       int rounds, unsigned char* out, size_t outLength) {
+        return PKCS5_PBKDF2_HMAC(password.data(), static_cast<int>(password.size()),
+                                 salt, static_cast<int>(saltLength), rounds, EVP_sha256(),
+                                 static_cast<int>(outLength), out) == 1;
+    }
+
+    // Hashes on the calling thread; empty on failure
+    std::string hashNow(const std::string& password) {
+        unsigned char salt[SALT_BYTES];
+        unsigned char hash[HASH_BYTES];
+        if (RAND_bytes(salt, sizeof(salt)) != 1 ||
+            !derive(password, salt, sizeof(salt), iterations, hash, sizeof(hash))) {
+            return "";
+        }
+        hashed.fetch_add(1, std::memory_order_relaxed);
+        return std::string(PREFIX) + std::to_string(iterations) + "$" +
+               toHex(salt, sizeof(salt)) + "$" + toHex(hash, sizeof(hash));
+    }
+
+    // Verifies on the calling thread
+    VerifyResult verifyNow(const std::string& password, const std::string& stored) {
+        if (stored.compare(0, std::char_traits<char>::length(PREFIX), PREFIX) != 0) {
+            // Legacy plaintext row
+            bool equal = password.size() == stored.size() &&
+                         CRYPTO_memcmp(password.data(), stored.data(), stored.size()) == 0;
+            return equal ? VerifyResult::MatchNeedsRehash : VerifyResult::Mismatch;
+        }
+
+        size_t iterStart = std::char_traits<char>::length(PREFIX);
+        size_t saltStart = stored.find('$', iterStart);
+        size_t hashStart = saltStart == std::string::npos ? std::string::npos : stored.find('$', saltStart + 1);
+        if (hashStart == std::string::npos) {
+            return VerifyResult::Mismatch;
+        }
+
+        int rounds = 0;
+        try {
+            rounds = std::stoi(stored.substr(iterStart, saltStart - iterStart));
+        } catch (...) {
+            return VerifyResult::Mismatch;
+        }
+        std::vector<unsigned char> salt;
+        std::vector<unsigned char> expected;
+        if (rounds <= 0 ||
+            !fromHex(stored.substr(saltStart + 1, hashStart - saltStart - 1), salt) ||
+            !fromHex(stored.substr(hashStart + 1), expected) || expected.empty()) {
+            return VerifyResult::Mismatch;
+        }
+
+        std::vector<unsigned char> actual(expected.size());
+        if (!derive(password, salt.data(), salt.size(), rounds, actual.data(), actual.size())) {
+            return VerifyResult::Mismatch;
+        }
+        hashed.fetch_add(1, std::memory_order_relaxed);
+        if (CRYPTO_memcmp(actual.data(), expected.data(), expected.size()) != 0) {
+            return VerifyResult::Mismatch;
+        }
+        return rounds == iterations ? VerifyResult::Match : VerifyResult::MatchNeedsRehash;
+    }
+
+    void run() {
+        while (true) {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(mtx);
+                ready.wait(lock, [this] { return stopping || !tasks.empty(); });
+                if (tasks.empty()) {
+                    return;  // Stopping and fully drained
+                }
+                task = std::move(tasks.front());
+                tasks.pop_front();
+            }
+            task();
+        }
+    }
+
+    /**
+     * Queues a task for the hashing threads
+     *
+     * @return false if the queue was full and the task was dropped
+     */
+    bool enqueue(std::function<void()> task) {
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            if (stopping || tasks.size() >= maxQueued) {
+                rejected.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+            tasks.push_back(std::move(task));
+        }
+        ready.notify_one();
+        return true;
+    }
+
+    /**
+     * Runs work on the pool and waits for its result
+     *
+     * @return false if maxWaiting callers were already waiting or the queue
+     *         was full, and the work was not run
+     */
+    template <typename Result>
+    bool runOnPool(std::function<Result()> work, Result& result) {
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            if (waiting >= maxWaiting) {
+                rejected.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+            waiting++;
+        }
+
+        auto task = std::make_shared<std::packaged_task<Result()>>(std::move(work));
+        std::future<Result> future = task->get_future();
+        bool queued = enqueue([task] { (*task)(); });
+        if (queued) {
+            result = future.get();
+        }
+
+        std::lock_guard<std::mutex> lock(mtx);
+        waiting--;
+        return queued;
+    }
+
+public:
+    /**
+     * @param iterations PBKDF2 iteration count for new hashes (the cost)
+     * @param threads Number of hashing threads
+     * @param maxQueued Hashing requests allowed to wait before new ones are refused
+     * @param maxWaiting Callers allowed to block on a result at once; keep it
+     *                   below the number of request threads
+     */
+    PasswordHasher(int iterations, size_t threads, size_t maxQueued, size_t maxWaiting)
+        : iterations(iterations > 0 ? iterations : 1),
+          maxQueued(maxQueued == 0 ? 1 : maxQueued),
+          maxWaiting(maxWaiting == 0 ? 1 : maxWaiting) {
+        dummyHash = hashNow("");
+        if (threads == 0) {
+            threads = 1;
+        }
+        for (size_t i = 0; i < threads; i++) {
+            workers.emplace_back(&PasswordHasher::run, this);
+        }
+    }
+
+    ~PasswordHasher() {
+        stop();
+    }
+
+    PasswordHasher(const PasswordHasher&) = delete;
+    PasswordHasher& operator=(const PasswordHasher&) = delete;
+
+    /**
+     * Finishes queued work and joins the hashing threads
+     */
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            stopping = true;
+        }
+        ready.notify_all();
+        for (auto& worker : workers) {
+            if (worker.joinable()) {
+                worker.join();
+            }
+        }
+    }
+
+    /**
+     * Hashes a password for storage
+     *
+     * @param encoded Receives the encoded hash
+     * @return false if the hasher is busy (see the class comment) or hashing failed
+     */
+    bool hash(const std::string& password, std::string& encoded) {
+        std::function<std::string()> work = [this, &password] { return hashNow(password); };
+        return runOnPool(std::move(work), encoded) && !encoded.empty();
+    }
+
+    /**
+     * Hashes a password on the pool without waiting for the result
+     *
+     * For hashes nobody waits on, such as upgrading a stored hash after a
+     * login. `done` runs on a hashing thread with the encoded hash, and is
+     * not called if hashing fails. Work still queued when the hasher stops
+     * is finished first, so whatever `done` uses must outlive the hasher.
+     *
+     * @return false if the hashing queue is full
+     */
+    bool hashInBackground(std::string password, std::function<void(std::string)> done) {
+        return enqueue([this, password = std::move(password), done = std::move(done)] {
+            std::string encoded = hashNow(password);
+            if (!encoded.empty()) {
+                done(std::move(encoded));
+            }
+        });
+    }
+
+    /**
+     * Checks a password against a stored hash (or legacy plaintext)
+     */
+    VerifyResult verify(const std::string& password, const std::string& stored) {
+        VerifyResult result = VerifyResult::Mismatch;
+        std::function<VerifyResult()> work = [this, &password, &stored] { return verifyNow(password, stored); };
+        return runOnPool(std::move(work), result) ? result : VerifyResult::Busy;
+    }
+
+    /**
+     * Spends the same work as verify() on a user that does not exist
+     *
+     * @return Busy if the hashing queue is full, Mismatch otherwise
+     */
+    VerifyResult verifyUnknownUser(const std::string& password) {
+        VerifyResult result = verify(password, dummyHash);
+        return result == VerifyResult::Busy ? result : VerifyResult::Mismatch;
+    }
+
+    int getIterations() const { return iterations; }
+
+    Stats stats() {
+        std::lock_guard<std::mutex> lock(mtx);
+        return Stats{
+            hashed.load(std::memory_order_relaxed),
+            rejected.load(std::memory_order_relaxed),
+            tasks.size(),
+            waiting
+        };
+    }
+};
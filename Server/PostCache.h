@@ -0,0 +1,315 @@
+#pragma once
+#include "Compression.h"
+#include <list>
+#include <iterator>
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <cstdint>
+#include <optional>
+
+/**
+ * A fully serialized GET /posts/<int> response plus the fields needed to
+ * authorize it without touching the database
+ */
+struct CachedPost {
+    int userId;
+    bool isPrivate;
+    std::string updatedAt;
+    std::string body;   // JSON response body, served as-is on a hit
+    std::string etag;   // Strong validator for body
+
+    // Compressed copies of body indexed by ContentEncoding; each is filled
+    // the first time a client asks for that coding and empty until then
+    std::string encoded[CONTENT_ENCODING_COUNT];
+};
+
+/**
+ * Just enough about a post to answer a conditional GET
+ *
+ * Validators are tiny compared to response bodies, so they are kept for
+ * many more posts than fit in the body cache. A body evicted under byte
+ * pressure can therefore still be revalidated with a 304 without any
+ * SQLite read.
+ */
+struct PostValidator {
+    std::string etag;
+    int userId;
+    bool isPrivate;
+    size_t bodySize;    // Decides whether the response would be compressed
+};
+
+/**
+ * Sharded, byte-bounded LRU cache of serialized post responses
+ *
+ * Posts are spread over independent shards by id, each with its own mutex
+ * and LRU list, so concurrent readers of different posts rarely contend.
+ * Every shard gets an equal slice of the byte budget and evicts its least
+ * recently used entries when a new entry would exceed it.
+ *
+ * Fills are guarded by a per-shard generation counter: a reader takes a
+ * fill token before querying SQLite, and put() discards the result if the
+ * shard was invalidated in the meantime. This keeps a slow reader from
+ * re-caching a version that a concurrent PUT or DELETE has just replaced.
+ * The same generation check protects the validator table.
+ */
+class PostCache {
+private:
+    using Entry = std::pair<int, std::shared_ptr<const CachedPost>>;
+
+    struct Shard {
+        std::mutex mtx;
+        std::list<Entry> lru;   // Most recently used at the front
+        std::unordered_map<int, std::list<Entry>::iterator> index;
+        std::unordered_map<int, PostValidator> validators;
+        size_t bytes = 0;
+        uint64_t generation = 0;
+    };
+
+    // Approximate bookkeeping cost of one entry beyond its strings
+    static constexpr size_t ENTRY_OVERHEAD = 128;
+
+    std::vector<std::unique_ptr<Shard>> shards;
+    size_t shardCapacity;
+    size_t shardValidatorCapacity;
+
+    std::atomic<uint64_t> hits{0};
+    std::atomic<uint64_t> misses{0};
+    std::atomic<uint64_t> evictions{0};
+    std::atomic<uint64_t> invalidations{0};
+    std::atomic<uint64_t> validatorHits{0};
+    std::atomic<uint64_t> validatorMisses{0};
+
+    Shard& shardFor(int id) {
+        return *shards[static_cast<size_t>(id) % shards.size()];
+    }
+
+    static size_t entrySize(const CachedPost& post) {
+        size_t size = post.body.size() + post.updatedAt.size() + post.etag.size() + ENTRY_OVERHEAD;
+        for (const std::string& encoded : post.encoded) {
+            size += encoded.size();
+        }
+        return size;
+    }
+
+    // Evicts least recently used entries other than keep until extra bytes fit;
+    // caller must hold the shard mutex
+    void makeRoomLocked(Shard& shard, size_t extra, int keep) {
+        while (!shard.lru.empty() && shard.bytes + extra > shardCapacity) {
+            auto victim = std::prev(shard.lru.end());
+            if (victim->first == keep) {
+                if (victim == shard.lru.begin()) {
+                    return;
+                }
+                victim = std::prev(victim);
+            }
+            eraseLocked(shard, victim);
+            evictions.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    // Removes an entry; caller must hold the shard mutex
+    static void eraseLocked(Shard& shard, std::list<Entry>::iterator it) {
+        shard.bytes -= entrySize(*it->second);
+        shard.index.erase(it->first);
+        shard.lru.erase(it);
+    }
+
+public:
+    struct Stats {
+        uint64_t hits;
+        uint64_t misses;
+        uint64_t evictions;
+        uint64_t invalidations;
+        uint64_t validatorHits;
+        uint64_t validatorMisses;
+        size_t validators;
+        size_t entries;
+        size_t bytes;
+        size_t capacity;
+    };
+
+    /**
+     * @param capacityBytes Total byte budget for response bodies across all shards
+     * @param validatorCapacity Total number of validators kept across all shards
+     * @param shardCount Number of independently locked shards
+     */
+    PostCache(size_t capacityBytes, size_t validatorCapacity = 100000, size_t shardCount = 16) {
+        if (shardCount == 0) {
+            shardCount = 1;
+        }
+        shardCapacity = capacityBytes / shardCount;
+        shardValidatorCapacity = std::max<size_t>(1, validatorCapacity / shardCount);
+        for (size_t i = 0; i < shardCount; i++) {
+            shards.push_back(std::make_unique<Shard>());
+        }
+    }
+
+    /**
+     * Looks up a post and marks it as most recently used
+     *
+     * @return The cached post, or nullptr on a miss
+     */
+    std::shared_ptr<const CachedPost> get(int id) {
+        Shard& shard = shardFor(id);
+        std::lock_guard<std::mutex> lock(shard.mtx);
+
+        auto it = shard.index.find(id);
+        if (it == shard.index.end()) {
+            misses.fetch_add(1, std::memory_order_relaxed);
+            return nullptr;
+        }
+
+        shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+        hits.fetch_add(1, std::memory_order_relaxed);
+        return it->second->second;
+    }
+
+    /**
+     * Looks up the validator of a post, even if its body is not cached
+     *
+     * @return The validator, or nothing if the post's version is unknown
+     */
+    std::optional<PostValidator> validator(int id) {
+        Shard& shard = shardFor(id);
+        std::lock_guard<std::mutex> lock(shard.mtx);
+
+        auto it = shard.validators.find(id);
+        if (it == shard.validators.end()) {
+            validatorMisses.fetch_add(1, std::memory_order_relaxed);
+            return std::nullopt;
+        }
+        validatorHits.fetch_add(1, std::memory_order_relaxed);
+        return it->second;
+    }
+
+    /**
+     * Takes a fill token before reading a post from the database
+     *
+     * @return The token to pass to put() once the read completes
+     */
+    uint64_t fillToken(int id) {
+        Shard& shard = shardFor(id);
+        std::lock_guard<std::mutex> lock(shard.mtx);
+        return shard.generation;
+    }
+
+    /**
+     * Caches a post read from the database
+     *
+     * The entry is dropped if the shard was invalidated after the token was
+     * taken. A body that alone exceeds the shard's byte budget is not cached,
+     * but its validator still is.
+     *
+     * @param id The post ID
+     * @param post The serialized post
+     * @param token The token returned by fillToken() before the read
+     */
+    void put(int id, std::shared_ptr<const CachedPost> post, uint64_t token) {
+        size_t size = entrySize(*post);
+
+        Shard& shard = shardFor(id);
+        std::lock_guard<std::mutex> lock(shard.mtx);
+
+        if (shard.generation != token) {
+            return;  // A write raced with this fill; the data may be stale
+        }
+
+        if (shard.validators.size() >= shardValidatorCapacity && !shard.validators.count(id)) {
+            // Validators are cheap to rebuild, so any victim will do
+            shard.validators.erase(shard.validators.begin());
+        }
+        shard.validators[id] = PostValidator{post->etag, post->userId, post->isPrivate, post->body.size()};
+
+        if (size > shardCapacity) {
+            return;
+        }
+
+        auto existing = shard.index.find(id);
+        if (existing != shard.index.end()) {
+            eraseLocked(shard, existing->second);
+        }
+
+        makeRoomLocked(shard, size, id);
+
+        shard.lru.emplace_front(id, std::move(post));
+        shard.index[id] = shard.lru.begin();
+        shard.bytes += size;
+    }
+
+    /**
+     * Swaps a cached entry for an enriched copy of itself
+     *
+     * Used to attach a freshly compressed body. The swap only happens if
+     * the entry is still exactly the one the caller read, so it can never
+     * resurrect a post that was invalidated in the meantime.
+     *
+     * @param id The post ID
+     * @param expected The entry previously returned by get() or put()
+     * @param replacement The new entry for the same post version
+     * @return true if the entry was replaced
+     */
+    bool replace(int id, const std::shared_ptr<const CachedPost>& expected,
+                 std::shared_ptr<const CachedPost> replacement) {
+        size_t oldSize = entrySize(*expected);
+        size_t newSize = entrySize(*replacement);
+        if (newSize > shardCapacity) {
+            return false;
+        }
+
+        Shard& shard = shardFor(id);
+        std::lock_guard<std::mutex> lock(shard.mtx);
+
+        auto it = shard.index.find(id);
+        if (it == shard.index.end() || it->second->second != expected) {
+            return false;
+        }
+
+        shard.bytes -= oldSize;
+        it->second->second = std::move(replacement);
+        makeRoomLocked(shard, newSize, id);
+        shard.bytes += newSize;
+        return true;
+    }
+
+    /**
+     * Drops a post after it has been updated or deleted
+     *
+     * Must be called after the write has committed.
+     */
+    void invalidate(int id) {
+        Shard& shard = shardFor(id);
+        std::lock_guard<std::mutex> lock(shard.mtx);
+
+        shard.generation++;
+        shard.validators.erase(id);
+        auto it = shard.index.find(id);
+        if (it != shard.index.end()) {
+            eraseLocked(shard, it->second);
+            invalidations.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    Stats stats() {
+        Stats result{};
+        result.hits = hits.load(std::memory_order_relaxed);
+        result.misses = misses.load(std::memory_order_relaxed);
+        result.evictions = evictions.load(std::memory_order_relaxed);
+        result.invalidations = invalidations.load(std::memory_order_relaxed);
+        result.validatorHits = validatorHits.load(std::memory_order_relaxed);
+        result.validatorMisses = validatorMisses.load(std::memory_order_relaxed);
+        result.capacity = shardCapacity * shards.size();
+
+        for (auto& shard : shards) {
+            std::lock_guard<std::mutex> lock(shard->mtx);
+            result.entries += shard->index.size();
+            result.bytes += shard->bytes;
+            result.validators += shard->validators.size();
+        }
+        return result;
+    }
+};
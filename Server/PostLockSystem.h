@@ -1,9 +1,17 @@
 #pragma once
-#include "DeadlockSafeMutex.h"
 #include <unordered_map>
 #include <chrono>
 #include <string>
 #include <memory>
+#include <mutex>
+#include <vector>
+#include <optional>
+#include <queue>
+#include <functional>
+#include <thread>
+#include <condition_variable>
+#include <atomic>
+#include <cstdint>
 
 // Post editing lock system
 struct PostLock {
@@ -15,28 +23,288 @@ struct PostLock {
 // Default lock duration in seconds
 constexpr int DEFAULT_LOCK_DURATION = 300; // 5 minutes
 
-// Function to clean up expired locks
-inline void cleanupExpiredLocks(
-    std::unordered_map<int, PostLock>& postLocks,
-    DeadlockSafeMutex& locksMapMutex) 
-{
-    if (!locksMapMutex.tryLockWithTimeout(100)) {
-        return;  // Skip cleanup if can't acquire lock quickly
-    }
-    
-    try {
-        auto now = std::chrono::system_clock::now();
-        for (auto it = postLocks.begin(); it != postLocks.end();) {
-            if (it->second.expires_at <= now) {
-                it = postLocks.erase(it);
+/**
+ * Concurrent table of post editing locks
+ *
+ * Locks are spread over independent shards by post id, each guarded by its
+ * own mutex, so lock checks on unrelated posts almost never contend. Every
+ * critical section is a handful of map operations with no I/O, so callers
+ * simply block instead of timing out.
+ *
+ * Expired locks are treated as absent by every operation. They are removed
+ * by an expiry thread that keeps a min-heap of expiry times and sleeps
+ * until the earliest one, so each lock is evicted when it expires at a
+ * cost of O(log n) per expiry instead of periodic full-table sweeps.
+ * Heap entries are not updated when a lock is extended or released; the
+ * stale entry is simply skipped when it comes due.
+ */
+class PostLockTable {
+private:
+    struct Shard {
+        std::mutex mtx;
+        std::unordered_map<int, PostLock> locks;
+    };
+
+    using Clock = std::chrono::system_clock;
+    using Expiry = std::pair<Clock::time_point, int>;  // (expires_at, post id)
+
+    std::vector<std::unique_ptr<Shard>> shards;
+
+    // Guards the expiry heap; never held while taking a shard mutex
+    std::mutex expiryMutex;
+    std::condition_variable expiryChanged;
+    std::priority_queue<Expiry, std::vector<Expiry>, std::greater<Expiry>> expiries;
+    bool stopping = false;
+    std::thread expiryThread;
+
+    std::atomic<uint64_t> expiredCount{0};
+
+    // Called with every lock that is dropped because it expired
+    std::function<void(int, const PostLock&)> expiryListener;
+
+    Shard& shardFor(int postId) {
+        return *shards[static_cast<size_t>(postId) % shards.size()];
+    }
+
+    // Queues an expiry, waking the expiry thread if it is now the earliest
+    void scheduleExpiry(int postId, Clock::time_point expiresAt) {
+        bool earliest;
+        {
+            std::lock_guard<std::mutex> lock(expiryMutex);
+            earliest = expiries.empty() || expiresAt < expiries.top().first;
+            expiries.emplace(expiresAt, postId);
+        }
+        if (earliest) {
+            expiryChanged.notify_one();
+        }
+    }
+
+    // Removes the lock on a post if it has really expired by now
+    void expire(int postId) {
+        std::optional<PostLock> expired;
+        {
+            Shard& shard = shardFor(postId);
+            std::lock_guard<std::mutex> lock(shard.mtx);
+
+            auto it = shard.locks.find(postId);
+            if (it == shard.locks.end() || it->second.expires_at > Clock::now()) {
+                return;
+            }
+            expired = std::move(it->second);
+            shard.locks.erase(it);
+        }
+
+        expiredCount.fetch_add(1, std::memory_order_relaxed);
+        if (expiryListener) {
+            expiryListener(postId, *expired);
+        }
+    }
+
+    void runExpiry() {
+        std::vector<int> due;
+        std::unique_lock<std::mutex> lock(expiryMutex);
+
+        while (!stopping) {
+            if (expiries.empty()) {
+                expiryChanged.wait(lock);
+                continue;
+            }
+
+            auto now = Clock::now();
+            if (expiries.top().first > now) {
+                expiryChanged.wait_for(lock, expiries.top().first - now);
+                continue;
+            }
+
+            while (!expiries.empty() && expiries.top().first <= now) {
+                due.push_back(expiries.top().second);
+                expiries.pop();
+            }
+
+            lock.unlock();
+            for (int postId : due) {
+                expire(postId);
+            }
+            due.clear();
+            lock.lock();
+        }
+    }
+
+public:
+    enum class AcquireResult {
+        Acquired,       // The post was not locked
+        Reacquired,     // The previous holder's lock had expired
+        Extended,       // The caller already held the lock
+        HeldByOther     // Someone else holds a valid lock
+    };
+
+    enum class ReleaseResult {
+        Released,
+        NotFound,
+        NotOwner
+    };
+
+    /**
+     * @param shardCount Number of independently locked shards
+     */
+    explicit PostLockTable(size_t shardCount = 64) {
+        if (shardCount == 0) {
+            shardCount = 1;
+        }
+        for (size_t i = 0; i < shardCount; i++) {
+            shards.push_back(std::make_unique<Shard>());
+        }
+        expiryThread = std::thread(&PostLockTable::runExpiry, this);
+    }
+
+    ~PostLockTable() {
+        stop();
+    }
+
+    PostLockTable(const PostLockTable&) = delete;
+    PostLockTable& operator=(const PostLockTable&) = delete;
+
+    /**
+     * Registers a callback for locks evicted by the expiry thread
+     *
+     * Must be set before the table is shared between threads. The callback
+     * runs on the expiry thread with no table mutex held.
+     */
+    void setExpiryListener(std::function<void(int, const PostLock&)> listener) {
+        expiryListener = std::move(listener);
+    }
+
+    /**
+     * Stops the expiry thread; safe to call more than once
+     *
+     * Locks stay in the table but are no longer evicted in the background.
+     */
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(expiryMutex);
+            stopping = true;
+        }
+        expiryChanged.notify_all();
+        if (expiryThread.joinable()) {
+            expiryThread.join();
+        }
+    }
+
+    /**
+     * Acquires or extends the lock on a post
+     *
+     * @param postId The post to lock
+     * @param userId The user asking for the lock
+     * @param username Display name stored with a new lock
+     * @param duration How long the lock lasts from now
+     * @param holder Receives the lock as it stands afterwards (the caller's
+     *               lock, or the other user's on HeldByOther)
+     * @return What happened
+     */
+    AcquireResult tryAcquire(int postId, int userId, const std::string& username,
+                             std::chrono::seconds duration, PostLock& holder) {
+        auto now = Clock::now();
+        AcquireResult result;
+        {
+            Shard& shard = shardFor(postId);
+            std::lock_guard<std::mutex> lock(shard.mtx);
+
+            auto it = shard.locks.find(postId);
+            if (it == shard.locks.end()) {
+                shard.locks[postId] = PostLock{userId, now + duration, username};
+                result = AcquireResult::Acquired;
+            } else if (it->second.user_id == userId) {
+                it->second.expires_at = now + duration;
+                result = AcquireResult::Extended;
+            } else if (it->second.expires_at <= now) {
+                it->second = PostLock{userId, now + duration, username};
+                result = AcquireResult::Reacquired;
             } else {
-                ++it;
+                holder = it->second;
+                return AcquireResult::HeldByOther;
             }
+            holder = shard.locks[postId];
         }
-        locksMapMutex.unlock();
+
+        scheduleExpiry(postId, holder.expires_at);
+        return result;
     }
-    catch (...) {
-        locksMapMutex.unlock();
-        std::cerr << "Error during lock cleanup" << std::endl;
+
+    /**
+     * Looks up the valid lock on a post
+     *
+     * @return The current lock, or nothing if the post is not locked
+     */
+    std::optional<PostLock> status(int postId) {
+        auto now = Clock::now();
+        Shard& shard = shardFor(postId);
+        std::lock_guard<std::mutex> lock(shard.mtx);
+
+        auto it = shard.locks.find(postId);
+        if (it == shard.locks.end() || it->second.expires_at <= now) {
+            return std::nullopt;
+        }
+        return it->second;
     }
-}
+
+    /**
+     * Releases a lock on behalf of its holder
+     *
+     * An expired lock can still be released by the user who held it.
+     *
+     * @param released Receives the removed lock, if given
+     */
+    ReleaseResult release(int postId, int userId, PostLock* released = nullptr) {
+        Shard& shard = shardFor(postId);
+        std::lock_guard<std::mutex> lock(shard.mtx);
+
+        auto it = shard.locks.find(postId);
+        if (it == shard.locks.end()) {
+            return ReleaseResult::NotFound;
+        }
+        if (it->second.user_id != userId) {
+            return ReleaseResult::NotOwner;
+        }
+        if (released != nullptr) {
+            *released = std::move(it->second);
+        }
+        shard.locks.erase(it);
+        return ReleaseResult::Released;
+    }
+
+    /**
+     * Drops the lock on a post regardless of who holds it
+     *
+     * @param removed Receives the removed lock, if given
+     * @return true if a lock was removed
+     */
+    bool erase(int postId, PostLock* removed = nullptr) {
+        Shard& shard = shardFor(postId);
+        std::lock_guard<std::mutex> lock(shard.mtx);
+
+        auto it = shard.locks.find(postId);
+        if (it == shard.locks.end()) {
+            return false;
+        }
+        if (removed != nullptr) {
+            *removed = std::move(it->second);
+        }
+        shard.locks.erase(it);
+        return true;
+    }
+
+    // Number of locks evicted by the expiry thread so far
+    uint64_t expiredLocks() const {
+        return expiredCount.load(std::memory_order_relaxed);
+    }
+
+    // Number of locks currently stored, including expired ones not yet removed
+    size_t size() {
+        size_t total = 0;
+        for (auto& shard : shards) {
+            std::lock_guard<std::mutex> lock(shard->mtx);
+            total += shard->locks.size();
+        }
+        return total;
+    }
+};
@@ -0,0 +1,559 @@
+#pragma once
+#include "sqlite3.h"
+#include "ConnectionPool.h"
+#include "WriteQueue.h"
+#include "TextPatch.h"
+#include "Metrics.h"
+#include "Logger.h"
+#include <zlib.h>
+#include <array>
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <cstdint>
+
+/**
+ * Revision history of posts, stored as reverse deltas with periodic snapshots
+ *
+ * The posts table always holds the latest version. Every update first
+ * records the version it replaces in post_revisions, usually as a reverse
+ * delta: for each of title, HTML, CSS and JS, the splice that turns the
+ * newer version back into this one (see diffSplice). A save therefore
+ * costs roughly the size of the edit, not of the post.
+ *
+ * Materializing version v starts from the closest snapshot at or above v,
+ * or from the current post, and applies deltas downwards. To bound that
+ * walk, a version is stored as a full snapshot instead once the deltas
+ * since the last snapshot reach SNAPSHOT_EVERY entries or
+ * SNAPSHOT_AFTER_BYTES bytes.
+ *
+ * Because deltas point from newer to older, dropping the oldest revisions
+ * of a post never breaks the chain of the ones kept, which is what lets
+ * RevisionPruner trim history from the old end at any time.
+ *
+ * Payloads above REVISION_COMPRESS_MIN_BYTES are deflated when that makes
+ * them smaller.
+ */
+
+// title, html_code, css_code, js_code
+using PostFields = std::array<std::string, 4>;
+
+enum class RevisionKind {
+    Snapshot = 0,
+    Delta = 1
+};
+
+constexpr int SNAPSHOT_EVERY = 32;
+constexpr int64_t SNAPSHOT_AFTER_BYTES = 64 * 1024;
+constexpr size_t REVISION_COMPRESS_MIN_BYTES = 128;
+
+inline void appendVarint(std::string& out, uint64_t value) {
+    while (value >= 0x80) {
+        out.push_back(static_cast<char>((value & 0x7F) | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<char>(value));
+}
+
+inline bool readVarint(const std::string& in, size_t& pos, uint64_t& value) {
+    value = 0;
+    for (int shift = 0; shift < 64 && pos < in.size(); shift += 7) {
+        unsigned char byte = static_cast<unsigned char>(in[pos++]);
+        value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+inline bool readBytes(const std::string& in, size_t& pos, std::string& out) {
+    uint64_t length = 0;
+    if (!readVarint(in, pos, length) || length > in.size() - pos) {
+        return false;
+    }
+    out.assign(in, pos, length);
+    pos += length;
+    return true;
+}
+
+// Snapshot payload: every field, length-prefixed
+inline std::string encodeSnapshot(const PostFields& fields) {
+    std::string out;
+    for (const std::string& field : fields) {
+        appendVarint(out, field.size());
+        out += field;
+    }
+    return out;
+}
+
+// Delta payload: per field, 0 if unchanged, or 1 and the splice turning newer into older
+inline std::string encodeReverseDelta(const PostFields& newer, const PostFields& older) {
+    std::string out;
+    for (size_t i = 0; i < older.size(); i++) {
+        if (newer[i] == older[i]) {
+            out.push_back(0);
+            continue;
+        }
+        TextSplice splice = diffSplice(newer[i], older[i]);
+        out.push_back(1);
+        appendVarint(out, splice.at);
+        appendVarint(out, splice.remove);
+        appendVarint(out, splice.insert.size());
+        out += splice.insert;
+    }
+    return out;
+}
+
+/**
+ * Turns the fields of the next newer version into those of this revision
+ *
+ * @return false if the payload is malformed
+ */
+inline bool applyRevision(RevisionKind kind, const std::string& payload, PostFields& fields) {
+    size_t pos = 0;
+    if (kind == RevisionKind::Snapshot) {
+        for (std::string& field : fields) {
+            if (!readBytes(payload, pos, field)) {
+                return false;
+            }
+        }
+        return pos == payload.size();
+    }
+
+    for (std::string& field : fields) {
+        if (pos >= payload.size()) {
+            return false;
+        }
+        if (payload[pos++] == 0) {
+            continue;
+        }
+        uint64_t at = 0;
+        uint64_t remove = 0;
+        TextSplice splice;
+        if (!readVarint(payload, pos, at) || !readVarint(payload, pos, remove) ||
+            !readBytes(payload, pos, splice.insert)) {
+            return false;
+        }
+        splice.at = at;
+        splice.remove = remove;
+        std::string error;
+        if (!applySplices(field, {splice}, error)) {
+            return false;
+        }
+    }
+    return pos == payload.size();
+}
+
+// Deflates a payload if it is worth it; returns whether `stored` is compressed
+inline bool packRevision(const std::string& payload, std::string& stored) {
+    if (payload.size() >= REVISION_COMPRESS_MIN_BYTES) {
+        uLongf length = compressBound(payload.size());
+        stored.resize(length);
+        if (compress2(reinterpret_cast<Bytef*>(&stored[0]), &length,
+                      reinterpret_cast<const Bytef*>(payload.data()), payload.size(),
+                      Z_DEFAULT_COMPRESSION) == Z_OK && length < payload.size()) {
+            stored.resize(length);
+            return true;
+        }
+    }
+    stored = payload;
+    return false;
+}
+
+inline bool unpackRevision(const void* data, size_t size, bool compressed, size_t rawSize, std::string& payload) {
+    if (!compressed) {
+        payload.assign(static_cast<const char*>(data), size);
+        return payload.size() == rawSize;
+    }
+    payload.resize(rawSize);
+    uLongf length = rawSize;
+    return uncompress(reinterpret_cast<Bytef*>(&payload[0]), &length,
+                      static_cast<const Bytef*>(data), size) == Z_OK && length == rawSize;
+}
+
+// Reads the content of a code blob on the given connection
+inline bool loadCodeBlob(ConnectionPool::Lease& conn, const std::string& hash, std::string& content) {
+    CachedStatement stmt = conn.prepare("SELECT content FROM code_blobs WHERE hash = ?");
+    if (!stmt) {
+        return false;
+    }
+    sqlite3_bind_blob(stmt, 1, hash.data(), static_cast<int>(hash.size()), SQLITE_STATIC);
+    if (sqlite3_step(stmt) != SQLITE_ROW) {
+        return false;
+    }
+    content.assign(reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0)), sqlite3_column_bytes(stmt, 0));
+    return true;
+}
+
+/**
+ * Records the current version of a post before an update replaces it
+ *
+ * Must run in the same write operation as the update, and before it.
+ * Every update that bumps posts.version has to record a revision, even
+ * one that changes nothing, so the version chain has no gaps.
+ *
+ * @param updated New value per field, or nullptr for fields the update does not touch
+ * @return false on a database error (see sqlite3_errmsg); true if the post
+ *         does not exist, in which case the update will not find it either
+ */
+inline bool recordRevision(ConnectionPool::Lease& conn, int postId,
+                           const std::array<const std::string*, 4>& updated) {
+    static const Metrics::Counter snapshots = Metrics::instance().counter(
+        "post_revisions_recorded_total", "Post revisions recorded", "kind=\"snapshot\"");
+    static const Metrics::Counter deltas = Metrics::instance().counter(
+        "post_revisions_recorded_total", "Post revisions recorded", "kind=\"delta\"");
+    static const Metrics::Counter storedBytes = Metrics::instance().counter(
+        "post_revision_bytes_total", "Bytes written to post_revisions after compression");
+
+    int64_t version = 0;
+    std::string savedAt;
+    PostFields older;
+    std::array<std::string, 4> hashes;
+    {
+        CachedStatement stmt = conn.prepare(
+            "SELECT version, coalesce(updated_at, created_at, CURRENT_TIMESTAMP), title, html_hash, css_hash, js_hash "
+            "FROM posts WHERE id = ?");
+        if (!stmt) {
+            return false;
+        }
+        sqlite3_bind_int(stmt, 1, postId);
+        int rc = sqlite3_step(stmt);
+        if (rc == SQLITE_DONE) {
+            return true;
+        }
+        if (rc != SQLITE_ROW) {
+            return false;
+        }
+        version = sqlite3_column_int64(stmt, 0);
+        savedAt = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1));
+        older[0] = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 2));
+        for (size_t i = 1; i < hashes.size(); i++) {
+            hashes[i].assign(static_cast<const char*>(sqlite3_column_blob(stmt, 2 + i)),
+                             sqlite3_column_bytes(stmt, 2 + i));
+        }
+    }
+
+    // Snapshot once the deltas above the newest snapshot make too long a walk
+    int64_t lastSnapshot = -1;
+    {
+        CachedStatement stmt = conn.prepare(
+            "SELECT max(version) FROM post_revisions INDEXED BY idx_post_revisions_snapshots "
+            "WHERE post_id = ? AND kind = 0");
+        if (!stmt) {
+            return false;
+        }
+        sqlite3_bind_int(stmt, 1, postId);
+        if (sqlite3_step(stmt) == SQLITE_ROW && sqlite3_column_type(stmt, 0) != SQLITE_NULL) {
+            lastSnapshot = sqlite3_column_int64(stmt, 0);
+        }
+    }
+    int64_t deltaCount = 0;
+    int64_t deltaBytes = 0;
+    {
+        CachedStatement stmt = conn.prepare(
+            "SELECT count(*), total(length(data)) FROM post_revisions WHERE post_id = ? AND version > ?");
+        if (!stmt) {
+            return false;
+        }
+        sqlite3_bind_int(stmt, 1, postId);
+        sqlite3_bind_int64(stmt, 2, lastSnapshot);
+        if (sqlite3_step(stmt) == SQLITE_ROW) {
+            deltaCount = sqlite3_column_int64(stmt, 0);
+            deltaBytes = static_cast<int64_t>(sqlite3_column_double(stmt, 1));
+        }
+    }
+    bool snapshot = deltaCount + 1 >= SNAPSHOT_EVERY || deltaBytes >= SNAPSHOT_AFTER_BYTES;
+
+    // A delta only needs the old content of fields that are being replaced
+    PostFields newer;
+    for (size_t i = 1; i < older.size(); i++) {
+        if ((snapshot || updated[i] != nullptr) && !loadCodeBlob(conn, hashes[i], older[i])) {
+            return false;
+        }
+    }
+    for (size_t i = 0; i < older.size(); i++) {
+        newer[i] = updated[i] != nullptr ? *updated[i] : older[i];
+    }
+
+    std::string payload = snapshot ? encodeSnapshot(older) : encodeReverseDelta(newer, older);
+    std::string stored;
+    bool compressed = packRevision(payload, stored);
+
+    CachedStatement stmt = conn.prepare(
+        "INSERT INTO post_revisions (post_id, version, saved_at, kind, raw_size, compressed, data) "
+        "VALUES (?, ?, ?, ?, ?, ?, ?)");
+    if (!stmt) {
+        return false;
+    }
+    sqlite3_bind_int(stmt, 1, postId);
+    sqlite3_bind_int64(stmt, 2, version);
+    sqlite3_bind_text(stmt, 3, savedAt.c_str(), -1, SQLITE_STATIC);
+    sqlite3_bind_int(stmt, 4, static_cast<int>(snapshot ? RevisionKind::Snapshot : RevisionKind::Delta));
+    sqlite3_bind_int64(stmt, 5, static_cast<sqlite3_int64>(payload.size()));
+    sqlite3_bind_int(stmt, 6, compressed ? 1 : 0);
+    sqlite3_bind_blob(stmt, 7, stored.data(), static_cast<int>(stored.size()), SQLITE_STATIC);
+    if (sqlite3_step(stmt) != SQLITE_DONE) {
+        return false;
+    }
+
+    Metrics::increment(snapshot ? snapshots : deltas);
+    Metrics::increment(storedBytes, stored.size());
+    return true;
+}
+
+enum class MaterializeResult {
+    Ok,
+    NotFound,   // No such post, or the version is in the future or was pruned
+    Error       // Database error or corrupt revision
+};
+
+/**
+ * Rebuilds the fields of a post as they were at a given version
+ *
+ * Runs in one read transaction, so a concurrent save cannot move the
+ * current version between reading it and reading the deltas below it.
+ *
+ * @param fields Receives title, html_code, css_code and js_code
+ * @param savedAt Receives when that version was saved
+ */
+inline MaterializeResult materializeRevision(ConnectionPool::Lease& conn, int postId, int64_t version,
+                                             PostFields& fields, std::string& savedAt) {
+    sqlite3* db = conn.get();
+    if (sqlite3_exec(db, "BEGIN", nullptr, nullptr, nullptr) != SQLITE_OK) {
+        return MaterializeResult::Error;
+    }
+    struct ReadTransaction {
+        sqlite3* db;
+        ~ReadTransaction() { sqlite3_exec(db, "COMMIT", nullptr, nullptr, nullptr); }
+    } transaction{db};
+
+    int64_t start = 0;
+    {
+        CachedStatement stmt = conn.prepare(
+            "SELECT version, title, html_code, css_code, js_code, updated_at FROM posts_with_code WHERE id = ?");
+        if (!stmt) {
+            return MaterializeResult::Error;
+        }
+        sqlite3_bind_int(stmt, 1, postId);
+        if (sqlite3_step(stmt) != SQLITE_ROW) {
+            return MaterializeResult::NotFound;
+        }
+        start = sqlite3_column_int64(stmt, 0);
+        for (size_t i = 0; i < fields.size(); i++) {
+            const unsigned char* text = sqlite3_column_text(stmt, 1 + i);
+            fields[i].assign(text ? reinterpret_cast<const char*>(text) : "", sqlite3_column_bytes(stmt, 1 + i));
+        }
+        const unsigned char* updatedAt = sqlite3_column_text(stmt, 5);
+        savedAt = updatedAt ? reinterpret_cast<const char*>(updatedAt) : "";
+    }
+    if (version > start || version < 0) {
+        return MaterializeResult::NotFound;
+    }
+    if (version == start) {
+        return MaterializeResult::Ok;
+    }
+
+    // Begin at the closest snapshot at or above the version, if any
+    {
+        CachedStatement stmt = conn.prepare(
+            "SELECT min(version) FROM post_revisions INDEXED BY idx_post_revisions_snapshots "
+            "WHERE post_id = ? AND kind = 0 AND version >= ?");
+        if (!stmt) {
+            return MaterializeResult::Error;
+        }
+        sqlite3_bind_int(stmt, 1, postId);
+        sqlite3_bind_int64(stmt, 2, version);
+        if (sqlite3_step(stmt) == SQLITE_ROW && sqlite3_column_type(stmt, 0) != SQLITE_NULL) {
+            start = sqlite3_column_int64(stmt, 0) + 1;
+        }
+    }
+
+    CachedStatement stmt = conn.prepare(
+        "SELECT version, kind, compressed, raw_size, data, saved_at FROM post_revisions "
+        "WHERE post_id = ? AND version >= ? AND version < ? ORDER BY version DESC");
+    if (!stmt) {
+        return MaterializeResult::Error;
+    }
+    sqlite3_bind_int(stmt, 1, postId);
+    sqlite3_bind_int64(stmt, 2, version);
+    sqlite3_bind_int64(stmt, 3, start);
+
+    // Every version from start - 1 down to the target must be present
+    int64_t expected = start - 1;
+    std::string payload;
+    int rc;
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        if (sqlite3_column_int64(stmt, 0) != expected) {
+            return MaterializeResult::NotFound;
+        }
+        RevisionKind kind = static_cast<RevisionKind>(sqlite3_column_int(stmt, 1));
+        if (!unpackRevision(sqlite3_column_blob(stmt, 4), sqlite3_column_bytes(stmt, 4),
+                            sqlite3_column_int(stmt, 2) != 0,
+                            static_cast<size_t>(sqlite3_column_int64(stmt, 3)), payload) ||
+            !applyRevision(kind, payload, fields)) {
+            Logger::instance().error("post_revision_corrupt", {{"post_id", postId},
+                                                               {"version", static_cast<long long>(expected)}});
+            return MaterializeResult::Error;
+        }
+        savedAt = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 5));
+        expected--;
+    }
+    if (rc != SQLITE_DONE) {
+        return MaterializeResult::Error;
+    }
+    return expected == version - 1 ? MaterializeResult::Ok : MaterializeResult::NotFound;
+}
+
+/**
+ * Background thread that trims revision history
+ *
+ * Each pass deletes, in batches through the write queue, the revisions
+ * of deleted posts and revisions saved before the retention window.
+ * Trimming from the old end never breaks the deltas that are kept.
+ */
+class RevisionPruner {
+private:
+    WriteQueue& writeQueue;
+    std::chrono::milliseconds interval;
+    int retentionDays;
+    int batchSize;
+
+    std::thread worker;
+    std::mutex mtx;
+    std::condition_variable wakeup;
+    bool stopping = false;
+
+    Metrics::Counter pruned = Metrics::instance().counter(
+        "post_revisions_pruned_total", "Post revisions deleted by retention");
+
+    bool stopRequested() {
+        std::lock_guard<std::mutex> lock(mtx);
+        return stopping;
+    }
+
+    void run() {
+        std::unique_lock<std::mutex> lock(mtx);
+        while (!wakeup.wait_for(lock, interval, [this] { return stopping; })) {
+            lock.unlock();
+            // Keep going while batches come back full
+            while (pruneBatch() == batchSize && !stopRequested()) {
+            }
+            lock.lock();
+        }
+    }
+
+    // Deletes one batch; returns the number of revisions deleted, or -1 on failure
+    int pruneBatch() {
+        int deleted = 0;
+        bool success = writeQueue.execute([this, &deleted](ConnectionPool::Lease& conn) -> bool {
+            sqlite3* db = conn.get();
+            deleted = 0;
+
+            // Revisions of deleted posts, one queued post at a time
+            CachedStatement next = conn.prepare("SELECT post_id FROM post_revision_purges LIMIT 1");
+            if (!next) {
+                return fail(db);
+            }
+            if (sqlite3_step(next) == SQLITE_ROW) {
+                int postId = sqlite3_column_int(next, 0);
+                CachedStatement purge = conn.prepare(
+                    "DELETE FROM post_revisions WHERE post_id = ? AND version IN "
+                    "(SELECT version FROM post_revisions WHERE post_id = ? LIMIT ?)");
+                if (!purge) {
+                    return fail(db);
+                }
+                sqlite3_bind_int(purge, 1, postId);
+                sqlite3_bind_int(purge, 2, postId);
+                sqlite3_bind_int(purge, 3, batchSize);
+                if (sqlite3_step(purge) != SQLITE_DONE) {
+                    return fail(db);
+                }
+                deleted = sqlite3_changes(db);
+                if (deleted < batchSize) {
+                    CachedStatement done = conn.prepare("DELETE FROM post_revision_purges WHERE post_id = ?");
+                    if (!done) {
+                        return fail(db);
+                    }
+                    sqlite3_bind_int(done, 1, postId);
+                    if (sqlite3_step(done) != SQLITE_DONE) {
+                        return fail(db);
+                    }
+                    // Report a full batch so the next queued post follows straight away
+                    deleted = batchSize;
+                }
+                return true;
+            }
+
+            if (retentionDays <= 0) {
+                return true;
+            }
+            CachedStatement expire = conn.prepare(
+                "DELETE FROM post_revisions WHERE rowid IN "
+                "(SELECT rowid FROM post_revisions WHERE saved_at < datetime('now', ?) LIMIT ?)");
+            if (!expire) {
+                return fail(db);
+            }
+            std::string window = "-" + std::to_string(retentionDays) + " days";
+            sqlite3_bind_text(expire, 1, window.c_str(), -1, SQLITE_TRANSIENT);
+            sqlite3_bind_int(expire, 2, batchSize);
+            if (sqlite3_step(expire) != SQLITE_DONE) {
+                return fail(db);
+            }
+            deleted = sqlite3_changes(db);
+            return true;
+        });
+
+        if (!success) {
+            return -1;
+        }
+        if (deleted > 0) {
+            Metrics::increment(pruned, static_cast<uint64_t>(deleted));
+        }
+        return deleted;
+    }
+
+    static bool fail(sqlite3* db) {
+        Logger::instance().error("post_revision_prune_failed", {{"error", sqlite3_errmsg(db)}});
+        return false;
+    }
+
+public:
+    /**
+     * @param writeQueue Queue the deletes are submitted to; must outlive the pruner
+     * @param interval Time between passes
+     * @param retentionDays Revisions saved longer ago than this are deleted; 0 keeps them forever
+     * @param batchSize Most revisions deleted in one write
+     */
+    RevisionPruner(WriteQueue& writeQueue, std::chrono::milliseconds interval, int retentionDays, int batchSize = 500)
+        : writeQueue(writeQueue), interval(interval), retentionDays(retentionDays),
+          batchSize(batchSize > 0 ? batchSize : 1) {}
+
+    ~RevisionPruner() {
+        stop();
+    }
+
+    RevisionPruner(const RevisionPruner&) = delete;
+    RevisionPruner& operator=(const RevisionPruner&) = delete;
+
+    void start() {
+        worker = std::thread(&RevisionPruner::run, this);
+    }
+
+    /**
+     * Joins the thread; safe to call more than once
+     */
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            stopping = true;
+        }
+        wakeup.notify_all();
+        if (worker.joinable()) {
+            worker.join();
+        }
+    }
+};
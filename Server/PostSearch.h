@@ -0,0 +1,181 @@
+#pragma once
+#include "sqlite3.h"
+#include "ConnectionPool.h"
+#include <algorithm>
+#include <string>
+#include <vector>
+
+/**
+ * Full-text search over posts
+ *
+ * Matches are ranked inside the FTS5 index: posts_fts is asked for only its
+ * best `window` matches by rank, and only those are joined with posts and
+ * users, filtered down to what the viewer may see and given a snippet.
+ *
+ * bm25 still has to score every match it ranks, which for a word found in
+ * most pens is most of the table. So only the newest MAX_SEARCH_CANDIDATES
+ * matches are ranked: a lookup walks the doclist from its newest end to the
+ * rowid where that many matches start, and ranking is limited to rowids
+ * from there on. Queries that match fewer posts rank all of them; the rest
+ * cost the same however large the table grows.
+ *
+ * The window over-fetches the requested page so that private posts of
+ * other users rarely leave it short. When they do and the index still had
+ * more matches, the search is repeated with a larger window.
+ */
+
+// Limits on search input, to keep a single query cheap
+constexpr size_t MAX_SEARCH_QUERY_LENGTH = 256;
+constexpr int MAX_SEARCH_TERMS = 16;
+constexpr int MAX_SEARCH_OFFSET = 1000;
+
+// Newest matches a single search ranks
+constexpr int MAX_SEARCH_CANDIDATES = 5000;
+
+struct SearchHit {
+    int id;
+    int userId;
+    std::string title;
+    std::string createdAt;
+    std::string updatedAt;
+    bool isPrivate;
+    std::string username;
+    std::string snippet;
+};
+
+/**
+ * Turns free text into an FTS5 query that matches posts containing every word
+ *
+ * Each whitespace-separated word is quoted, so FTS5 operators and syntax
+ * characters typed by users are matched literally instead of causing query
+ * errors. The last word is a prefix match, so results appear while typing,
+ * once it is at least two characters long (the shortest indexed prefix).
+ *
+ * @return The FTS5 query, or an empty string if the text has no words
+ */
+inline std::string buildSearchMatch(const std::string& text) {
+    std::string match;
+    int terms = 0;
+    size_t pos = 0;
+    size_t lastChars = 0;
+    while (pos < text.size() && terms < MAX_SEARCH_TERMS) {
+        size_t start = text.find_first_not_of(" \t\r\n", pos);
+        if (start == std::string::npos) {
+            break;
+        }
+        size_t end = text.find_first_of(" \t\r\n", start);
+        if (end == std::string::npos) {
+            end = text.size();
+        }
+
+        if (!match.empty()) {
+            match += ' ';
+        }
+        match += '"';
+        lastChars = 0;
+        for (size_t i = start; i < end; i++) {
+            if (text[i] == '"') {
+                match += '"';  // Quotes are escaped by doubling
+            }
+            match += text[i];
+            if ((static_cast<unsigned char>(text[i]) & 0xC0) != 0x80) {
+                lastChars++;  // Count UTF-8 lead bytes, not continuation bytes
+            }
+        }
+        match += '"';
+        terms++;
+        pos = end;
+    }
+
+    // A one-character prefix would merge the doclists of a large part of
+    // the vocabulary, so such a word only matches itself
+    if (lastChars >= 2) {
+        match += '*';
+    }
+    return match;
+}
+
+/**
+ * Runs a search and reads one page of results
+ *
+ * @param match An FTS5 query from buildSearchMatch
+ * @param viewerId The user searching, or -1; private posts are only
+ *                 returned to their owner
+ * @param hits Receives up to `limit` results, best first
+ * @param hasMore Set when another page follows
+ * @return false on a database error
+ */
+inline bool searchPosts(ConnectionPool::Lease& conn, const std::string& match, int viewerId,
+                        int limit, int offset, std::vector<SearchHit>& hits, bool& hasMore) {
+    // rank is the bm25 weighting configured when the index was created.
+    // Ordering the FTS query itself by rank lets FTS5 stop after `window`
+    // matches, so snippets are only built for those.
+    static const char* sql =
+        "SELECT p.id, p.user_id, p.title, p.created_at, p.updated_at, p.isPrivate, u.username, "
+        "f.snippet, p.id IS NOT NULL AND (p.isPrivate = 0 OR p.user_id = :viewer) "
+        "FROM (SELECT rowid, rank, snippet(posts_fts, -1, '«', '»', '…', 16) AS snippet "
+        "      FROM posts_fts WHERE posts_fts MATCH :match AND rowid >= coalesce("
+        "          (SELECT rowid FROM posts_fts WHERE posts_fts MATCH :match "
+        "           ORDER BY rowid DESC LIMIT 1 OFFSET :candidates - 1), 0) "
+        "      ORDER BY rank LIMIT :window) f "
+        "LEFT JOIN posts p ON p.id = f.rowid "
+        "LEFT JOIN users u ON u.user_id = p.user_id "
+        "ORDER BY f.rank";
+
+    auto text = [](sqlite3_stmt* stmt, int column) -> std::string {
+        const unsigned char* value = sqlite3_column_text(stmt, column);
+        return value ? reinterpret_cast<const char*>(value) : "";
+    };
+
+    // One extra visible row tells whether another page exists
+    const int needed = offset + limit + 1;
+    int window = std::min(needed * 2, MAX_SEARCH_CANDIDATES);
+    while (true) {
+        hits.clear();
+        hasMore = false;
+        int fetched = 0;
+        int visible = 0;
+        {
+            CachedStatement stmt = conn.prepare(sql);
+            if (!stmt) {
+                return false;
+            }
+            sqlite3_bind_text(stmt, sqlite3_bind_parameter_index(stmt, ":match"), match.c_str(), -1, SQLITE_TRANSIENT);
+            sqlite3_bind_int(stmt, sqlite3_bind_parameter_index(stmt, ":viewer"), viewerId);
+            sqlite3_bind_int(stmt, sqlite3_bind_parameter_index(stmt, ":candidates"), MAX_SEARCH_CANDIDATES);
+            sqlite3_bind_int(stmt, sqlite3_bind_parameter_index(stmt, ":window"), window);
+
+            int rc;
+            while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+                fetched++;
+                if (sqlite3_column_int(stmt, 8) == 0 || visible++ < offset) {
+                    continue;
+                }
+                if ((int)hits.size() == limit) {
+                    hasMore = true;
+                    break;
+                }
+
+                SearchHit hit;
+                hit.id = sqlite3_column_int(stmt, 0);
+                hit.userId = sqlite3_column_int(stmt, 1);
+                hit.title = text(stmt, 2);
+                hit.createdAt = text(stmt, 3);
+                hit.updatedAt = text(stmt, 4);
+                hit.isPrivate = sqlite3_column_int(stmt, 5) != 0;
+                hit.username = text(stmt, 6);
+                hit.snippet = text(stmt, 7);
+                hits.push_back(std::move(hit));
+            }
+            if (rc != SQLITE_ROW && rc != SQLITE_DONE) {
+                return false;
+            }
+        }
+
+        // Done once the page is full or the index ran out of matches
+        if (hasMore || fetched < window || window >= MAX_SEARCH_CANDIDATES) {
+            return true;
+        }
+        window = std::min(window * 4, MAX_SEARCH_CANDIDATES);
+    }
+}
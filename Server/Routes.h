@@ -6,10 +6,43 @@
 #include "DeadlockSafeMutex.h"
 #include "PostLockSystem.h"
 #include "DatabaseUtils.h"
+#include "ConnectionPool.h"
+#include "WriteQueue.h"
+#include "PasswordHasher.h"
+#include "PostCache.h"
+#include "WalCheckpointer.h"
+#include "NotificationHub.h"
+#include "Compression.h"
+#include "Metrics.h"
+#include "Logger.h"
+#include "MetricsMiddleware.h"
+#include "TextPatch.h"
+#include "PostRevisions.h"
+#include "PostSearch.h"
 #include <iostream>
 #include <unordered_map>
 #include <memory>
 #include <string>
+#include <vector>
+#include <array>
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+#include <optional>
+
+// Application type shared by every route module; metrics come first so
+// their timing covers the other middlewares too
+using ServerApp = crow::App<MetricsMiddleware, crow::CORSHandler>;
+
+/**
+ * Gives route templates their own latency and status series on /metrics
+ *
+ * Each setup*Routes function lists the templates it registers, next to
+ * the routes themselves, so a new route cannot be left out of the list.
+ */
+inline void trackRoutes(ServerApp& app, const std::vector<std::string>& routes) {
+    app.get_middleware<MetricsMiddleware>().trackRoutes(routes);
+}
 
 // Helper function to convert HTTP method to string
 inline std::string methodToString(const crow::HTTPMethod& method) {
@@ -27,15 +60,159 @@ inline std::string methodToString(const crow::HTTPMethod& method) {
     }
 }
 
+/**
+ * Computes a strong ETag for a response body
+ * 
+ * Combines the body length with a 64-bit FNV-1a hash, which is cheap enough
+ * to run on every listing response and still makes accidental collisions
+ * between two versions of the same resource practically impossible.
+ */
+inline std::string computeETag(const std::string& body) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (unsigned char c : body) {
+        hash ^= c;
+        hash *= 1099511628211ULL;
+    }
+    
+    char etag[48];
+    snprintf(etag, sizeof(etag), "\"%zx-%016llx\"", body.size(), (unsigned long long)hash);
+    return etag;
+}
+
+/**
+ * ETag of one content coding of a representation
+ * 
+ * Strong validators must differ between codings of the same content, so
+ * compressed responses carry the base ETag with the coding name appended.
+ */
+inline std::string representationETag(const std::string& etag, ContentEncoding encoding) {
+    if (encoding == ContentEncoding::Identity || etag.size() < 2) {
+        return etag;
+    }
+    return etag.substr(0, etag.size() - 1) + "-" + contentEncodingName(encoding) + "\"";
+}
+
+/**
+ * Checks whether an If-None-Match header names the given ETag
+ * 
+ * Uses the weak comparison required for If-None-Match: a W/ prefix on
+ * either side is ignored, and "*" matches any current representation.
+ * Any coding suffix added by representationETag is ignored as well, since
+ * every coding of an unchanged body is still valid for the client.
+ */
+inline bool etagMatches(const std::string& ifNoneMatch, const std::string& etag) {
+    auto normalize = [](std::string tag) {
+        if (tag.compare(0, 2, "W/") == 0) {
+            tag = tag.substr(2);
+        }
+        for (size_t i = 0; i < CONTENT_ENCODING_COUNT; i++) {
+            std::string suffix = std::string("-") + contentEncodingName(static_cast<ContentEncoding>(i)) + "\"";
+            if (tag.size() > suffix.size() && tag.compare(tag.size() - suffix.size(), suffix.size(), suffix) == 0) {
+                return tag.substr(0, tag.size() - suffix.size()) + "\"";
+            }
+        }
+        return tag;
+    };
+    const std::string target = normalize(etag);
+    
+    size_t start = 0;
+    while (start < ifNoneMatch.size()) {
+        size_t end = ifNoneMatch.find(',', start);
+        if (end == std::string::npos) {
+            end = ifNoneMatch.size();
+        }
+        
+        size_t first = ifNoneMatch.find_first_not_of(" \t", start);
+        size_t last = ifNoneMatch.find_last_not_of(" \t", end - 1);
+        if (first != std::string::npos && first < end && last >= first) {
+            std::string candidate = ifNoneMatch.substr(first, last - first + 1);
+            if (candidate == "*" || normalize(candidate) == target) {
+                return true;
+            }
+        }
+        start = end + 1;
+    }
+    return false;
+}
+
+// Coding a response body of the given size is sent with for this request
+inline ContentEncoding responseEncoding(const crow::request& req, size_t bodySize) {
+    if (bodySize < COMPRESSION_MIN_BYTES) {
+        return ContentEncoding::Identity;
+    }
+    return negotiateEncoding(req.get_header_value("Accept-Encoding"));
+}
+
+// Bodiless 304 response carrying the validator of the current representation
+inline crow::response notModifiedResponse(const std::string& etag) {
+    crow::response res(304);
+    res.set_header("ETag", etag);
+    res.set_header("Vary", "Accept-Encoding");
+    res.set_header("Cache-Control", "private, no-cache");
+    return res;
+}
+
+/**
+ * Builds a conditional, content-negotiated JSON response
+ * 
+ * Answers 304 Not Modified without a body when the request's If-None-Match
+ * already names the ETag, and 200 with the body otherwise. Bodies of at
+ * least COMPRESSION_MIN_BYTES are compressed with the best coding the
+ * client accepts. Responses depend on the caller's identity, so browsers
+ * may store them privately but must revalidate before reuse.
+ * 
+ * @param req The request, for If-None-Match and Accept-Encoding
+ * @param body The uncompressed JSON body
+ * @param etag The strong ETag of body
+ * @param encodedBodies Optional precompressed copies of body indexed by
+ *                      ContentEncoding; empty slots are compressed on the fly
+ */
+inline crow::response conditionalJsonResponse(const crow::request& req, const std::string& body,
+                                              const std::string& etag,
+                                              const std::string* encodedBodies = nullptr) {
+    ContentEncoding encoding = responseEncoding(req, body.size());
+    
+    const std::string& ifNoneMatch = req.get_header_value("If-None-Match");
+    if (!ifNoneMatch.empty() && etagMatches(ifNoneMatch, etag)) {
+        return notModifiedResponse(representationETag(etag, encoding));
+    }
+    
+    crow::response res(200);
+    if (encoding != ContentEncoding::Identity) {
+        size_t slot = static_cast<size_t>(encoding);
+        if (encodedBodies && !encodedBodies[slot].empty()) {
+            res.body = encodedBodies[slot];
+        } else if (!compressBody(body, encoding, res.body)) {
+            encoding = ContentEncoding::Identity;
+        }
+    }
+    
+    if (encoding == ContentEncoding::Identity) {
+        res.body = body;
+    } else {
+        res.set_header("Content-Encoding", contentEncodingName(encoding));
+    }
+    
+    res.set_header("Content-Type", "application/json");
+    res.set_header("ETag", representationETag(etag, encoding));
+    res.set_header("Vary", "Accept-Encoding");
+    res.set_header("Cache-Control", "private, no-cache");
+    return res;
+}
+
 // Setup authentication routes
 inline void setupAuthRoutes(
-    crow::App<crow::CORSHandler>& app,
-    sqlite3* db,
-    AuthMiddleware& auth
+    ServerApp& app,
+    ConnectionPool& pool,
+    WriteQueue& writeQueue,
+    AuthMiddleware& auth,
+    PasswordHasher& hasher
 ) {
+    trackRoutes(app, {"/auth/register", "/auth/login"});
+    
     // User registration endpoint
     CROW_ROUTE(app, "/auth/register").methods("POST"_method)
-    ([db](const crow::request& req) {
+    ([&writeQueue, &hasher](const crow::request& req) {
         auto x = crow::json::load(req.body);
         if (!x) {
             return crow::response(400, "Invalid JSON");
@@ -49,25 +226,30 @@ inline void setupAuthRoutes(
         std::string email = x["email"].s();
         std::string password = x["password"].s();
         
+        // Hash on the hashing pool before queueing the write
+        std::string passwordHash;
+        if (!hasher.hash(password, passwordHash)) {
+            return crow::response(503, "Server busy, please try again later");
+        }
+        
         int user_id = -1;
         crow::response errorResponse(500);
         
-        bool success = executeTransaction(db, [&](sqlite3* db) -> bool {
-            sqlite3_stmt* stmt;
+        bool success = writeQueue.execute([&](ConnectionPool::Lease& conn) -> bool {
+            sqlite3* db = conn.get();
             const char* sql = "INSERT INTO users (username, email, password) VALUES (?, ?, ?)";
-            
-            if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) != SQLITE_OK) {
+            CachedStatement stmt = conn.prepare(sql);
+            if (!stmt) {
                 errorResponse = crow::response(500, sqlite3_errmsg(db));
                 return false;
             }
             
             sqlite3_bind_text(stmt, 1, username.c_str(), -1, SQLITE_TRANSIENT);
             sqlite3_bind_text(stmt, 2, email.c_str(), -1, SQLITE_TRANSIENT);
-            sqlite3_bind_text(stmt, 3, password.c_str(), -1, SQLITE_TRANSIENT);
+            sqlite3_bind_text(stmt, 3, passwordHash.c_str(), -1, SQLITE_TRANSIENT);
             
             if (sqlite3_step(stmt) != SQLITE_DONE) {
                 std::string error = sqlite3_errmsg(db);
-                sqlite3_finalize(stmt);
                 
                 if (error.find("UNIQUE constraint failed") != std::string::npos) {
                     errorResponse = crow::response(409, "Username or email already exists");
@@ -78,7 +260,6 @@ inline void setupAuthRoutes(
             }
             
             user_id = sqlite3_last_insert_rowid(db);
-            sqlite3_finalize(stmt);
             return true;
         });
         
@@ -95,7 +276,7 @@ inline void setupAuthRoutes(
     
     // User login endpoint
     CROW_ROUTE(app, "/auth/login").methods("POST"_method)
-    ([db, &auth](const crow::request& req) {
+    ([&pool, &writeQueue, &auth, &hasher](const crow::request& req) {
         auto x = crow::json::load(req.body);
         if (!x) {
             return crow::response(400, "Invalid JSON");
@@ -108,27 +289,55 @@ inline void setupAuthRoutes(
         std::string username = x["username"].s();
         std::string password = x["password"].s();
         
-        sqlite3_stmt* stmt;
-        const char* sql = "SELECT user_id, password FROM users WHERE username = ?";
-        
-        if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) != SQLITE_OK) {
-            return crow::response(500, sqlite3_errmsg(db));
+        int user_id = -1;
+        std::string stored_password;
+        {
+            // Hand the reader back before the (slow) password check
+            auto conn = pool.acquireReader();
+            sqlite3* db = conn.get();
+            const char* sql = "SELECT user_id, password FROM users WHERE username = ?";
+            CachedStatement stmt = conn.prepare(sql);
+            if (!stmt) {
+                return crow::response(500, sqlite3_errmsg(db));
+            }
+            
+            sqlite3_bind_text(stmt, 1, username.c_str(), -1, SQLITE_TRANSIENT);
+            
+            if (sqlite3_step(stmt) == SQLITE_ROW) {
+                user_id = sqlite3_column_int(stmt, 0);
+                stored_password = (const char*)sqlite3_column_text(stmt, 1);
+            }
         }
         
-        sqlite3_bind_text(stmt, 1, username.c_str(), -1, SQLITE_TRANSIENT);
-        
-        if (sqlite3_step(stmt) != SQLITE_ROW) {
-            sqlite3_finalize(stmt);
+        // Unknown users cost the same hash as known ones, so response times
+        // don't reveal which usernames exist
+        PasswordHasher::VerifyResult verification = user_id == -1
+            ? hasher.verifyUnknownUser(password)
+            : hasher.verify(password, stored_password);
+        if (verification == PasswordHasher::VerifyResult::Busy) {
+            return crow::response(503, "Server busy, please try again later");
+        }
+        if (verification == PasswordHasher::VerifyResult::Mismatch) {
             return crow::response(401, "Invalid username or password");
         }
         
-        int user_id = sqlite3_column_int(stmt, 0);
-        std::string stored_password = (const char*)sqlite3_column_text(stmt, 1);
-        
-        sqlite3_finalize(stmt);
-        
-        if (password != stored_password) {
-            return crow::response(401, "Invalid username or password");
+        // Upgrade plaintext or outdated hashes now that we know the password.
+        // Failing to do so doesn't affect this login, so neither the new hash
+        // nor its write is waited for; a full hashing queue just skips it.
+        if (verification == PasswordHasher::VerifyResult::MatchNeedsRehash) {
+            hasher.hashInBackground(password, [&writeQueue, user_id, stored_password](std::string upgradedHash) {
+                writeQueue.submit([user_id, stored_password, upgradedHash](ConnectionPool::Lease& conn) -> bool {
+                    // Only replace the value we verified against
+                    CachedStatement stmt = conn.prepare("UPDATE users SET password = ? WHERE user_id = ? AND password = ?");
+                    if (!stmt) {
+                        return false;
+                    }
+                    sqlite3_bind_text(stmt, 1, upgradedHash.c_str(), -1, SQLITE_TRANSIENT);
+                    sqlite3_bind_int(stmt, 2, user_id);
+                    sqlite3_bind_text(stmt, 3, stored_password.c_str(), -1, SQLITE_TRANSIENT);
+                    return sqlite3_step(stmt) == SQLITE_DONE;
+                });
+            });
         }
         
         // Generate authentication token
@@ -143,95 +352,467 @@ inline void setupAuthRoutes(
     });
 }
 
+// Page size limits for paginated listing endpoints
+constexpr int DEFAULT_PAGE_SIZE = 20;
+constexpr int MAX_PAGE_SIZE = 100;
+
+/**
+ * Keyset pagination and filter parameters for post listings
+ * 
+ * Listings are ordered by (updated_at DESC, id DESC). The cursor is the
+ * (updated_at, id) pair of the last post on the previous page, encoded as
+ * "<updated_at>|<id>", so each page is a bounded index range scan no matter
+ * how deep the client pages.
+ */
+struct PostListQuery {
+    int limit = DEFAULT_PAGE_SIZE;
+    bool hasCursor = false;
+    std::string cursorUpdatedAt;
+    int cursorId = 0;
+    int ownerId = -1;              // -1 means any owner
+    std::string privacy = "all";   // "all", "public" or "private"
+};
+
+// Encodes the keyset cursor for the post with the given sort key
+inline std::string makePostCursor(const std::string& updated_at, int id) {
+    return updated_at + "|" + std::to_string(id);
+}
+
+/**
+ * Parses the limit, cursor, owner and privacy query parameters
+ * 
+ * @param req The HTTP request whose query string is parsed
+ * @param query Receives the parsed parameters
+ * @return An empty string on success, otherwise a description of the invalid parameter
+ */
+inline std::string parsePostListQuery(const crow::request& req, PostListQuery& query) {
+    try {
+        if (const char* limit = req.url_params.get("limit")) {
+            query.limit = std::stoi(limit);
+            if (query.limit < 1) {
+                return "limit must be a positive integer";
+            }
+            query.limit = std::min(query.limit, MAX_PAGE_SIZE);
+        }
+        
+        if (const char* cursor = req.url_params.get("cursor")) {
+            std::string value = cursor;
+            size_t separator = value.rfind('|');
+            if (separator == std::string::npos || separator == 0) {
+                return "Invalid cursor";
+            }
+            query.cursorUpdatedAt = value.substr(0, separator);
+            query.cursorId = std::stoi(value.substr(separator + 1));
+            query.hasCursor = true;
+        }
+        
+        if (const char* owner = req.url_params.get("owner")) {
+            query.ownerId = std::stoi(owner);
+        }
+    } catch (const std::exception&) {
+        return "Invalid pagination parameters";
+    }
+    
+    if (const char* privacy = req.url_params.get("privacy")) {
+        query.privacy = privacy;
+        if (query.privacy != "all" && query.privacy != "public" && query.privacy != "private") {
+            return "privacy must be one of all, public or private";
+        }
+    }
+    
+    return "";
+}
+
+/**
+ * Builds the WHERE / ORDER BY / LIMIT tail of a post listing query
+ * 
+ * Visibility is always enforced: anonymous viewers only see public posts and
+ * authenticated viewers additionally see their own private posts. The clause
+ * uses named parameters that bindPostListQuery fills in. Columns are
+ * qualified with the "p" alias, so the caller must select FROM posts p or
+ * FROM posts_with_code p (the view has every posts column).
+ * 
+ * @param query The parsed listing parameters
+ * @param viewerId The authenticated user ID, or -1 for anonymous requests
+ * @return The SQL clause, starting with " WHERE"
+ */
+inline std::string buildPostListClause(const PostListQuery& query, int viewerId) {
+    // The unary + keeps SQLite from answering the OR with a multi-index
+    // union plus a sort; it walks the (updated_at, id) index and stops at LIMIT
+    std::string clause = viewerId != -1
+        ? " WHERE (+p.isPrivate = 0 OR +p.user_id = :viewer)"
+        : " WHERE p.isPrivate = 0";
+    
+    if (query.ownerId != -1) {
+        clause += " AND p.user_id = :owner";
+    }
+    if (query.privacy == "public") {
+        clause += " AND p.isPrivate = 0";
+    } else if (query.privacy == "private") {
+        clause += " AND p.isPrivate = 1";
+    }
+    if (query.hasCursor) {
+        clause += " AND (p.updated_at, p.id) < (:cursor_updated_at, :cursor_id)";
+    }
+    
+    clause += " ORDER BY p.updated_at DESC, p.id DESC LIMIT :limit";
+    return clause;
+}
+
+// Binds the named parameters used by buildPostListClause
+inline void bindPostListQuery(sqlite3_stmt* stmt, const PostListQuery& query, int viewerId) {
+    auto index = [stmt](const char* name) {
+        return sqlite3_bind_parameter_index(stmt, name);
+    };
+    
+    if (viewerId != -1) {
+        sqlite3_bind_int(stmt, index(":viewer"), viewerId);
+    }
+    if (query.ownerId != -1) {
+        sqlite3_bind_int(stmt, index(":owner"), query.ownerId);
+    }
+    if (query.hasCursor) {
+        sqlite3_bind_text(stmt, index(":cursor_updated_at"), query.cursorUpdatedAt.c_str(), -1, SQLITE_TRANSIENT);
+        sqlite3_bind_int(stmt, index(":cursor_id"), query.cursorId);
+    }
+    
+    // Fetch one extra row to learn whether another page exists
+    sqlite3_bind_int(stmt, index(":limit"), query.limit + 1);
+}
+
+// Text of a column, or "" for NULL
+inline std::string columnText(sqlite3_stmt* stmt, int column) {
+    const unsigned char* value = sqlite3_column_text(stmt, column);
+    return value ? reinterpret_cast<const char*>(value) : "";
+}
+
+/**
+ * Steps a listing statement built with buildPostListClause into a page
+ * 
+ * The first six result columns must be p.id, p.user_id, p.title,
+ * p.created_at, p.updated_at and p.isPrivate; addColumns(stmt, post) copies
+ * whatever the listing selects after them. Sets posts, has_more and
+ * next_cursor on the result.
+ * 
+ * @return false on a database error, with the message in sqlite3_errmsg
+ */
+template <typename AddColumns>
+inline bool readPostListPage(sqlite3_stmt* stmt, const PostListQuery& query, crow::json::wvalue& result,
+                             AddColumns addColumns) {
+    crow::json::wvalue::list posts;
+    std::string lastUpdatedAt;
+    int lastId = 0;
+    bool hasMore = false;
+    
+    int rc;
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        if ((int)posts.size() == query.limit) {
+            hasMore = true;
+            break;
+        }
+        
+        crow::json::wvalue post;
+        lastId = sqlite3_column_int(stmt, 0);
+        lastUpdatedAt = columnText(stmt, 4);
+        post["id"] = lastId;
+        post["user_id"] = sqlite3_column_int(stmt, 1);
+        post["title"] = columnText(stmt, 2);
+        post["created_at"] = columnText(stmt, 3);
+        post["updated_at"] = lastUpdatedAt;
+        post["isPrivate"] = sqlite3_column_int(stmt, 5) != 0;
+        addColumns(stmt, post);
+        
+        posts.push_back(std::move(post));
+    }
+    if (rc != SQLITE_ROW && rc != SQLITE_DONE) {
+        return false;
+    }
+    
+    result["posts"] = std::move(posts);
+    result["has_more"] = hasMore;
+    if (hasMore) {
+        result["next_cursor"] = makePostCursor(lastUpdatedAt, lastId);
+    }
+    return true;
+}
+
+/**
+ * Makes sure a code blob exists, for use inside a write operation
+ *
+ * The hash is computed by the caller (see codeHash) before queueing the
+ * write, so the writer thread only does the insert. Content that is already
+ * stored is left as it is; the reference count is maintained by triggers
+ * when a post points at the hash.
+ *
+ * @return false on a database error, with the message in sqlite3_errmsg
+ */
+inline bool storeCodeBlob(ConnectionPool::Lease& conn, const std::string& hash, const std::string& content) {
+    CachedStatement stmt = conn.prepare(
+        "INSERT INTO code_blobs (hash, content) VALUES (?, ?) ON CONFLICT (hash) DO NOTHING");
+    if (!stmt) {
+        return false;
+    }
+    sqlite3_bind_blob(stmt, 1, hash.data(), static_cast<int>(hash.size()), SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 2, content.c_str(), static_cast<int>(content.size()), SQLITE_STATIC);
+    return sqlite3_step(stmt) == SQLITE_DONE;
+}
+
+/**
+ * Checks that a user may write a post under the edit-lock rules
+ *
+ * If the user holds the post's lock this is a no-op. If nobody holds it,
+ * the user takes it, as if they had asked for it first.
+ *
+ * @return false if another user holds the lock
+ */
+inline bool holdOrTakeEditLock(ConnectionPool& pool, PostLockTable& postLocks, NotificationHub& notifications,
+                               int id, int user_id) {
+    std::optional<PostLock> currentLock = postLocks.status(id);
+    if (currentLock) {
+        return currentLock->user_id == user_id;
+    }
+    
+    // Get username for the lock
+    std::string username = "Unknown User";
+    {
+        auto conn = pool.acquireReader();
+        const char* name_sql = "SELECT username FROM users WHERE user_id = ?";
+        CachedStatement name_stmt = conn.prepare(name_sql);
+        if (name_stmt) {
+            sqlite3_bind_int(name_stmt, 1, user_id);
+            if (sqlite3_step(name_stmt) == SQLITE_ROW) {
+                username = (const char*)sqlite3_column_text(name_stmt, 0);
+            }
+        }
+    }
+    
+    // Someone else may have locked the post while we looked up the name
+    PostLock holder;
+    bool hasValidLock = postLocks.tryAcquire(id, user_id, username,
+        std::chrono::seconds(DEFAULT_LOCK_DURATION), holder) != PostLockTable::AcquireResult::HeldByOther;
+    if (hasValidLock) {
+        notifications.publish(id, lockEventMessage(id, "acquired", holder));
+    }
+    return hasValidLock;
+}
+
+// Most splices one PATCH may carry, across all fields
+constexpr size_t MAX_PATCH_SPLICES = 1024;
+
+/**
+ * One field of a PATCH /posts/<int> body
+ *
+ * A string value replaces the field; a list of {"at", "delete", "insert"}
+ * objects splices it (see TextPatch.h). An absent field is left alone.
+ */
+struct FieldPatch {
+    bool present = false;
+    bool replace = false;
+    std::string replacement;
+    std::vector<TextSplice> splices;
+};
+
+// Reads a field patch; returns an error message, or "" if the field is valid
+inline std::string parseFieldPatch(const crow::json::rvalue& body, const char* field,
+                                   FieldPatch& patch, size_t& spliceBudget) {
+    if (!body.has(field)) {
+        return "";
+    }
+    const crow::json::rvalue& value = body[field];
+    patch.present = true;
+    
+    if (value.t() == crow::json::type::String) {
+        patch.replace = true;
+        patch.replacement = value.s();
+        return "";
+    }
+    if (value.t() != crow::json::type::List) {
+        return std::string(field) + " must be a string or a list of edits";
+    }
+    
+    for (const auto& op : value) {
+        if (spliceBudget == 0) {
+            return "Too many edits in one request";
+        }
+        spliceBudget--;
+        
+        if (op.t() != crow::json::type::Object || !op.has("at") || op["at"].t() != crow::json::type::Number) {
+            return std::string(field) + ": every edit needs a numeric \"at\"";
+        }
+        TextSplice splice;
+        if (op["at"].i() < 0) {
+            return std::string(field) + ": \"at\" must not be negative";
+        }
+        splice.at = static_cast<size_t>(op["at"].i());
+        if (op.has("delete")) {
+            if (op["delete"].t() != crow::json::type::Number || op["delete"].i() < 0) {
+                return std::string(field) + ": \"delete\" must be a non-negative number";
+            }
+            splice.remove = static_cast<size_t>(op["delete"].i());
+        }
+        if (op.has("insert")) {
+            if (op["insert"].t() != crow::json::type::String) {
+                return std::string(field) + ": \"insert\" must be a string";
+            }
+            splice.insert = op["insert"].s();
+        }
+        patch.splices.push_back(std::move(splice));
+    }
+    return "";
+}
+
 // Setup post routes
 inline void setupPostRoutes(
-    crow::App<crow::CORSHandler>& app,
-    sqlite3* db,
+    ServerApp& app,
+    ConnectionPool& pool,
+    WriteQueue& writeQueue,
     AuthMiddleware& auth,
-    std::unordered_map<int, std::unique_ptr<DeadlockSafeMutex>>& postMutexes,
-    DeadlockSafeMutex& mutexMapMutex,
-    std::unordered_map<int, PostLock>& postLocks,
-    DeadlockSafeMutex& locksMapMutex
+    PostCache& postCache,
+    StripedMutex& postMutexes,
+    PostLockTable& postLocks,
+    NotificationHub& notifications
 ) {
-    // GET all posts - filtered by privacy settings
+    trackRoutes(app, {"/posts", "/feed", "/posts/<int>", "/posts/<int>/fork", "/posts/<int>/revisions",
+                 "/posts/<int>/revisions/<int>", "/posts/<int>/creator"});
+    
+    // GET a page of posts - filtered by privacy settings, keyset-paginated
     CROW_ROUTE(app, "/posts")
-    ([db, &auth](const crow::request& req){
+    ([&pool, &auth](const crow::request& req){
         crow::json::wvalue result;
-        sqlite3_stmt* stmt;
         
         // Check if user is authenticated
-        int user_id = auth.authenticate(req) ? auth.getUserId(req) : -1;
+        int user_id = auth.resolveUserId(req);
         
-        const char* sql;
-        if (user_id != -1) {
-            // Authenticated user: show their private posts + all public posts
-            sql = "SELECT id, user_id, title, created_at, updated_at, isPrivate FROM posts WHERE (isPrivate = 0 OR user_id = ?) ORDER BY updated_at DESC";
-        } else {
-            // Unauthenticated user: show only public posts
-            sql = "SELECT id, user_id, title, created_at, updated_at, isPrivate FROM posts WHERE isPrivate = 0 ORDER BY updated_at DESC";
+        PostListQuery query;
+        std::string queryError = parsePostListQuery(req, query);
+        if (!queryError.empty()) {
+            return crow::response(400, queryError);
         }
         
-        if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) != SQLITE_OK) {
+        auto conn = pool.acquireReader();
+        sqlite3* db = conn.get();
+        
+        std::string sql = "SELECT p.id, p.user_id, p.title, p.created_at, p.updated_at, p.isPrivate FROM posts p"
+            + buildPostListClause(query, user_id);
+        
+        CachedStatement stmt = conn.prepare(sql);
+        if (!stmt) {
             return crow::response(500, sqlite3_errmsg(db));
         }
         
-        // Bind user_id parameter if authenticated
-        if (user_id != -1) {
-            sqlite3_bind_int(stmt, 1, user_id);
+        bindPostListQuery(stmt, query, user_id);
+        
+        if (!readPostListPage(stmt, query, result, [](sqlite3_stmt*, crow::json::wvalue&) {})) {
+            return crow::response(500, sqlite3_errmsg(db));
         }
         
-        crow::json::wvalue::list posts;
+        std::string body = result.dump();
+        return conditionalJsonResponse(req, body, computeETag(body));
+    });
+    
+    // GET a page of the home feed - posts joined with their creator and a
+    // bounded code preview, so a page renders from a single request
+    CROW_ROUTE(app, "/feed")
+    ([&pool, &auth](const crow::request& req){
+        crow::json::wvalue result;
         
-        while (sqlite3_step(stmt) == SQLITE_ROW) {
-            crow::json::wvalue post;
-            post["id"] = sqlite3_column_int(stmt, 0);
-            post["user_id"] = sqlite3_column_int(stmt, 1);
-            post["title"] = (const char*)sqlite3_column_text(stmt, 2);
-            post["created_at"] = (const char*)sqlite3_column_text(stmt, 3);
-            post["updated_at"] = (const char*)sqlite3_column_text(stmt, 4);
-            post["isPrivate"] = sqlite3_column_int(stmt, 5) != 0;
-            
-            posts.push_back(std::move(post));
+        // Check if user is authenticated
+        int user_id = auth.resolveUserId(req);
+        
+        PostListQuery query;
+        std::string queryError = parsePostListQuery(req, query);
+        if (!queryError.empty()) {
+            return crow::response(400, queryError);
+        }
+        
+        auto conn = pool.acquireReader();
+        sqlite3* db = conn.get();
+        
+        // Previews and lengths were stored with each blob, so no code body is read
+        const std::string previewChars = std::to_string(CODE_PREVIEW_CHARS);
+        std::string sql =
+            "SELECT p.id, p.user_id, p.title, p.created_at, p.updated_at, p.isPrivate, u.username, "
+            "h.preview, c.preview, j.preview, "
+            "(h.content_length > " + previewChars + " OR c.content_length > " + previewChars +
+            " OR j.content_length > " + previewChars + ") "
+            "FROM posts p LEFT JOIN users u ON u.user_id = p.user_id "
+            "LEFT JOIN code_previews h ON h.hash = p.html_hash "
+            "LEFT JOIN code_previews c ON c.hash = p.css_hash "
+            "LEFT JOIN code_previews j ON j.hash = p.js_hash"
+            + buildPostListClause(query, user_id);
+        
+        CachedStatement stmt = conn.prepare(sql);
+        if (!stmt) {
+            return crow::response(500, sqlite3_errmsg(db));
         }
         
-        sqlite3_finalize(stmt);
-        result["posts"] = std::move(posts);
+        bindPostListQuery(stmt, query, user_id);
         
-        return crow::response(result);
+        bool read = readPostListPage(stmt, query, result, [](sqlite3_stmt* row, crow::json::wvalue& post) {
+            post["username"] = columnText(row, 6);
+            post["preview"]["html_code"] = columnText(row, 7);
+            post["preview"]["css_code"] = columnText(row, 8);
+            post["preview"]["js_code"] = columnText(row, 9);
+            post["preview"]["truncated"] = sqlite3_column_int(row, 10) != 0;
+        });
+        if (!read) {
+            return crow::response(500, sqlite3_errmsg(db));
+        }
+        
+        std::string body = result.dump();
+        return conditionalJsonResponse(req, body, computeETag(body));
     });
     
-    // GET a specific post - checks privacy settings
+    // GET a specific post - checks privacy settings, served from the post cache when possible
     CROW_ROUTE(app, "/posts/<int>")
-    ([db, &auth](const crow::request& req, int id){
+    ([&pool, &auth, &postCache](const crow::request& req, int id){
         // Check if user is authenticated
-        int user_id = auth.authenticate(req) ? auth.getUserId(req) : -1;
+        int user_id = auth.resolveUserId(req);
         
         // Add debugging to track authentication issues
-        std::cout << "Fetching post " << id << ", authenticated user_id: " << user_id << std::endl;
-        
-        sqlite3_stmt* stmt;
-        const char* sql = "SELECT id, user_id, title, html_code, css_code, js_code, created_at, updated_at, isPrivate FROM posts WHERE id = ?";
-        
-        if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) != SQLITE_OK) {
-            return crow::response(500, sqlite3_errmsg(db));
+        Logger& logger = Logger::instance();
+        if (logger.enabled(LogLevel::Debug)) {
+            logger.debug("post_fetch", {{"post_id", id}, {"user_id", user_id}});
+        }
+        
+        // Revalidation: a known validator answers 304 without touching SQLite,
+        // even when the body itself has been evicted from the cache
+        const std::string& ifNoneMatch = req.get_header_value("If-None-Match");
+        if (!ifNoneMatch.empty()) {
+            if (auto validator = postCache.validator(id)) {
+                if (validator->isPrivate && validator->userId != user_id) {
+                    return crow::response(403, "This post is private");
+                }
+                if (etagMatches(ifNoneMatch, validator->etag)) {
+                    ContentEncoding encoding = responseEncoding(req, validator->bodySize);
+                    return notModifiedResponse(representationETag(validator->etag, encoding));
+                }
+            }
         }
         
-        sqlite3_bind_int(stmt, 1, id);
+        std::shared_ptr<const CachedPost> cached = postCache.get(id);
         
-        if (sqlite3_step(stmt) == SQLITE_ROW) {
-            int post_user_id = sqlite3_column_int(stmt, 1);
-            bool isPrivate = sqlite3_column_int(stmt, 8) != 0;
+        if (!cached) {
+            uint64_t fillToken = postCache.fillToken(id);
+            
+            auto conn = pool.acquireReader();
+            sqlite3* db = conn.get();
+            const char* sql = "SELECT id, user_id, title, html_code, css_code, js_code, created_at, updated_at, isPrivate, parent_id, version FROM posts_with_code WHERE id = ?";
+            CachedStatement stmt = conn.prepare(sql);
+            if (!stmt) {
+                return crow::response(500, sqlite3_errmsg(db));
+            }
             
-            // Debug log for privacy check
-            std::cout << "Post " << id << " belongs to user " << post_user_id 
-                      << ", isPrivate: " << (isPrivate ? "true" : "false") << std::endl;
+            sqlite3_bind_int(stmt, 1, id);
             
-            // Check privacy: if private, only creator can view
-            if (isPrivate && post_user_id != user_id) {
-                sqlite3_finalize(stmt);
-                return crow::response(403, "This post is private");
+            if (sqlite3_step(stmt) != SQLITE_ROW) {
+                return crow::response(404, "Post not found");
             }
             
+            int post_user_id = sqlite3_column_int(stmt, 1);
+            bool isPrivate = sqlite3_column_int(stmt, 8) != 0;
+            std::string updated_at = (const char*)sqlite3_column_text(stmt, 7);
+            
             crow::json::wvalue post;
             post["id"] = sqlite3_column_int(stmt, 0);
             post["user_id"] = post_user_id;
@@ -240,37 +821,76 @@ inline void setupPostRoutes(
             post["css_code"] = (const char*)sqlite3_column_text(stmt, 4);
             post["js_code"] = (const char*)sqlite3_column_text(stmt, 5);
             post["created_at"] = (const char*)sqlite3_column_text(stmt, 6);
-            post["updated_at"] = (const char*)sqlite3_column_text(stmt, 7);
+            post["updated_at"] = updated_at;
             post["isPrivate"] = isPrivate;
+            if (sqlite3_column_type(stmt, 9) == SQLITE_NULL) {
+                post["parent_id"] = nullptr;
+            } else {
+                post["parent_id"] = sqlite3_column_int(stmt, 9);
+            }
+            post["version"] = sqlite3_column_int64(stmt, 10);
             
-            sqlite3_finalize(stmt);
-            return crow::response(post);
-        } else {
-            sqlite3_finalize(stmt);
-            return crow::response(404, "Post not found");
+            // Private posts are cached too; the privacy check below runs on every hit
+            auto entry = std::make_shared<CachedPost>();
+            entry->userId = post_user_id;
+            entry->isPrivate = isPrivate;
+            entry->updatedAt = updated_at;
+            entry->body = post.dump();
+            entry->etag = computeETag(entry->body);
+            cached = entry;
+            postCache.put(id, cached, fillToken);
+        }
+        
+        // Debug log for privacy check
+        if (logger.enabled(LogLevel::Debug)) {
+            logger.debug("post_privacy", {{"post_id", id}, {"owner_id", cached->userId},
+                                          {"is_private", cached->isPrivate}});
+        }
+        
+        // Check privacy: if private, only creator can view
+        if (cached->isPrivate && cached->userId != user_id) {
+            return crow::response(403, "This post is private");
+        }
+        
+        // The first request for a coding compresses the body once, thoroughly,
+        // and attaches the result to the cache entry for every later viewer
+        ContentEncoding encoding = responseEncoding(req, cached->body.size());
+        size_t slot = static_cast<size_t>(encoding);
+        if (encoding != ContentEncoding::Identity && cached->encoded[slot].empty()
+            && !etagMatches(ifNoneMatch, cached->etag)) {
+            auto enriched = std::make_shared<CachedPost>(*cached);
+            if (compressBody(cached->body, encoding, enriched->encoded[slot], true)) {
+                postCache.replace(id, cached, enriched);
+                cached = std::move(enriched);
+            }
         }
+        
+        return conditionalJsonResponse(req, cached->body, cached->etag, cached->encoded);
     });
     
     // CREATE a new post - with privacy setting
     CROW_ROUTE(app, "/posts").methods("POST"_method)
-    ([db, &auth](const crow::request& req) {
+    ([&writeQueue, &auth](const crow::request& req) {
         // Check if user is authenticated
-        if (!auth.authenticate(req)) {
+        int user_id = auth.resolveUserId(req);
+        if (user_id == -1) {
             return crow::response(401, "Unauthorized - Login required");
         }
-        int user_id = auth.getUserId(req);
         
-        std::cout << "Received POST request to /posts" << std::endl;
-        std::cout << "Request body: " << req.body << std::endl;
+        // Bodies can be large and private, so they are only logged on request
+        Logger& logger = Logger::instance();
+        if (logger.logBodies()) {
+            logger.info("request_body", {{"route", "/posts"}, {"user_id", user_id}, {"body", req.body}});
+        }
         
         auto x = crow::json::load(req.body);
         if (!x) {
-            std::cout << "Invalid JSON received" << std::endl;
+            logger.debug("post_create_rejected", {{"reason", "invalid JSON"}});
             return crow::response(400, "Invalid JSON");
         }
         
         if (!x.has("title")) {
-            std::cout << "Missing title field in request" << std::endl;
+            logger.debug("post_create_rejected", {{"reason", "missing title"}});
             return crow::response(400, "Missing title field");
         }
         
@@ -296,37 +916,48 @@ inline void setupPostRoutes(
             isPrivate = x["isPrivate"].b();
         }
         
+        std::string html_hash = codeHash(html_code);
+        std::string css_hash = codeHash(css_code);
+        std::string js_hash = codeHash(js_code);
+        
         int id = -1;
         crow::response errorResponse(500);
         
-        bool success = executeTransaction(db, [&](sqlite3* db) -> bool {
-            sqlite3_stmt* stmt;
-            const char* sql = "INSERT INTO posts (user_id, title, html_code, css_code, js_code, isPrivate) VALUES (?, ?, ?, ?, ?, ?)";
+        bool success = writeQueue.execute([&](ConnectionPool::Lease& conn) -> bool {
+            sqlite3* db = conn.get();
+            if (!storeCodeBlob(conn, html_hash, html_code) ||
+                !storeCodeBlob(conn, css_hash, css_code) ||
+                !storeCodeBlob(conn, js_hash, js_code)) {
+                std::string error = sqlite3_errmsg(db);
+                Logger::instance().error("code_blob_store_failed", {{"route", "/posts"}, {"error", error}});
+                errorResponse = crow::response(500, error);
+                return false;
+            }
             
-            if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) != SQLITE_OK) {
+            const char* sql = "INSERT INTO posts (user_id, title, html_hash, css_hash, js_hash, isPrivate) VALUES (?, ?, ?, ?, ?, ?)";
+            CachedStatement stmt = conn.prepare(sql);
+            if (!stmt) {
                 std::string error = sqlite3_errmsg(db);
-                std::cout << "SQLite prepare error: " << error << std::endl;
+                Logger::instance().error("sqlite_prepare_failed", {{"route", "/posts"}, {"error", error}});
                 errorResponse = crow::response(500, error);
                 return false;
             }
             
             sqlite3_bind_int(stmt, 1, user_id);
             sqlite3_bind_text(stmt, 2, title.c_str(), -1, SQLITE_TRANSIENT);
-            sqlite3_bind_text(stmt, 3, html_code.c_str(), -1, SQLITE_TRANSIENT);
-            sqlite3_bind_text(stmt, 4, css_code.c_str(), -1, SQLITE_TRANSIENT);
-            sqlite3_bind_text(stmt, 5, js_code.c_str(), -1, SQLITE_TRANSIENT);
+            sqlite3_bind_blob(stmt, 3, html_hash.data(), static_cast<int>(html_hash.size()), SQLITE_TRANSIENT);
+            sqlite3_bind_blob(stmt, 4, css_hash.data(), static_cast<int>(css_hash.size()), SQLITE_TRANSIENT);
+            sqlite3_bind_blob(stmt, 5, js_hash.data(), static_cast<int>(js_hash.size()), SQLITE_TRANSIENT);
             sqlite3_bind_int(stmt, 6, isPrivate ? 1 : 0);
             
             if (sqlite3_step(stmt) != SQLITE_DONE) {
                 std::string error = sqlite3_errmsg(db);
-                std::cout << "SQLite execution error: " << error << std::endl;
-                sqlite3_finalize(stmt);
+                Logger::instance().error("sqlite_step_failed", {{"route", "/posts"}, {"error", error}});
                 errorResponse = crow::response(500, error);
                 return false;
             }
             
             id = sqlite3_last_insert_rowid(db);
-            sqlite3_finalize(stmt);
             return true;
         });
         
@@ -334,7 +965,7 @@ inline void setupPostRoutes(
             return errorResponse;
         }
         
-        std::cout << "Post created successfully with ID: " << id << std::endl;
+        logger.info("post_created", {{"post_id", id}, {"user_id", user_id}});
         
         crow::json::wvalue result;
         result["id"] = id;
@@ -343,133 +974,269 @@ inline void setupPostRoutes(
         
         auto res = crow::response(201, result);
         res.add_header("Content-Type", "application/json");
-        
-        std::cout << "Returning response: " << res.body << std::endl;
         return res;
     });
     
-    // UPDATE a post - respects privacy settings and releases locks
-    CROW_ROUTE(app, "/posts/<int>").methods("PUT"_method)
-    ([db, &postMutexes, &mutexMapMutex, &postLocks, &locksMapMutex, &auth](const crow::request& req, int id) {
+    // FORK a post - copies it inside the database, code included, without a request body
+    CROW_ROUTE(app, "/posts/<int>/fork").methods("POST"_method)
+    ([&writeQueue, &auth](const crow::request& req, int id) {
         // Check if user is authenticated
-        if (!auth.authenticate(req)) {
+        int user_id = auth.resolveUserId(req);
+        if (user_id == -1) {
             return crow::response(401, "Unauthorized - Login required");
         }
-        int user_id = auth.getUserId(req);
-
-        // Check lock status
-        if (!locksMapMutex.tryLockWithTimeout(500)) {
-            return crow::response(503, "Server busy, please try again later");
+        
+        int forkId = -1;
+        crow::response errorResponse(500);
+        
+        bool success = writeQueue.execute([&](ConnectionPool::Lease& conn) -> bool {
+            sqlite3* db = conn.get();
+            // The privacy check is part of the copy, so the post cannot turn
+            // private between checking and copying. Only hashes are copied;
+            // the fork shares the original's code blobs. A fork of one's own
+            // private post stays private.
+            const char* sql =
+                "INSERT INTO posts (user_id, title, html_hash, css_hash, js_hash, isPrivate, parent_id) "
+                "SELECT ?, title || ' (Fork)', html_hash, css_hash, js_hash, isPrivate, id "
+                "FROM posts WHERE id = ? AND (isPrivate = 0 OR user_id = ?)";
+            CachedStatement stmt = conn.prepare(sql);
+            if (!stmt) {
+                errorResponse = crow::response(500, sqlite3_errmsg(db));
+                return false;
+            }
+            
+            sqlite3_bind_int(stmt, 1, user_id);
+            sqlite3_bind_int(stmt, 2, id);
+            sqlite3_bind_int(stmt, 3, user_id);
+            
+            if (sqlite3_step(stmt) != SQLITE_DONE) {
+                std::string error = sqlite3_errmsg(db);
+                Logger::instance().error("sqlite_step_failed", {{"route", "/posts/<int>/fork"}, {"error", error}});
+                errorResponse = crow::response(500, error);
+                return false;
+            }
+            
+            if (sqlite3_changes(db) > 0) {
+                forkId = sqlite3_last_insert_rowid(db);
+                return true;
+            }
+            
+            // Nothing copied: tell a missing post from a private one
+            CachedStatement check_stmt = conn.prepare("SELECT 1 FROM posts INDEXED BY idx_posts_access WHERE id = ?");
+            if (!check_stmt) {
+                errorResponse = crow::response(500, sqlite3_errmsg(db));
+                return false;
+            }
+            sqlite3_bind_int(check_stmt, 1, id);
+            if (sqlite3_step(check_stmt) == SQLITE_ROW) {
+                errorResponse = crow::response(403, "This post is private");
+            } else {
+                errorResponse = crow::response(404, "Post not found");
+            }
+            return false;
+        });
+        
+        if (!success) {
+            return errorResponse;
         }
-
-        bool hasValidLock = false;
-        bool isLocked = false;
+        
+        Logger::instance().info("post_forked", {{"post_id", forkId}, {"parent_id", id}, {"user_id", user_id}});
+        
+        crow::json::wvalue result;
+        result["id"] = forkId;
+        
+        auto res = crow::response(201, result);
+        res.add_header("Content-Type", "application/json");
+        return res;
+    });
+    
+    // LIST the saved revisions of a post, newest first. Pages are bounded by
+    // `limit`; `before` is the version the previous page ended at.
+    CROW_ROUTE(app, "/posts/<int>/revisions")
+    ([&pool, &auth](const crow::request& req, int id) {
+        int user_id = auth.resolveUserId(req);
+        
+        int limit = DEFAULT_PAGE_SIZE;
+        int64_t before = INT64_MAX;
         try {
-            auto lock_it = postLocks.find(id);
-            auto now = std::chrono::system_clock::now();
-            
-            if (lock_it != postLocks.end() && lock_it->second.expires_at > now) {
-                // Post is currently locked
-                isLocked = true;
-                if (lock_it->second.user_id == user_id) {
-                    hasValidLock = true;
-                }
-            } else if (lock_it != postLocks.end()) {
-                // Remove expired lock
-                postLocks.erase(lock_it);
+            if (const char* value = req.url_params.get("limit")) {
+                limit = std::stoi(value);
             }
-
-            // If no valid lock exists, automatically create one
-            if (!isLocked) {
-                // Get username for the lock
-                std::string username = "Unknown User";
-                sqlite3_stmt* name_stmt;
-                const char* name_sql = "SELECT username FROM users WHERE user_id = ?";
-                
-                if (sqlite3_prepare_v2(db, name_sql, -1, &name_stmt, nullptr) == SQLITE_OK) {
-                    sqlite3_bind_int(name_stmt, 1, user_id);
-                    if (sqlite3_step(name_stmt) == SQLITE_ROW) {
-                        username = (const char*)sqlite3_column_text(name_stmt, 0);
-                    }
-                    sqlite3_finalize(name_stmt);
-                }
-
-                // Create new lock
-                postLocks[id] = {
-                    user_id,
-                    now + std::chrono::seconds(DEFAULT_LOCK_DURATION),
-                    username
-                };
-                hasValidLock = true;
+            if (const char* value = req.url_params.get("before")) {
+                before = std::stoll(value);
             }
-
-            locksMapMutex.unlock();
-        } catch (...) {
-            locksMapMutex.unlock();
-            return crow::response(500, "Error checking lock status");
+        } catch (const std::exception&) {
+            return crow::response(400, "Invalid pagination parameters");
         }
-
-        if (!hasValidLock) {
-            return crow::response(423, "This post is being edited by another user");
+        if (limit < 1) {
+            return crow::response(400, "Invalid pagination parameters");
         }
-
-        auto x = crow::json::load(req.body);
-        if (!x) {
-            return crow::response(400, "Invalid JSON");
+        limit = std::min(limit, MAX_PAGE_SIZE);
+        
+        auto conn = pool.acquireReader();
+        sqlite3* db = conn.get();
+        
+        int64_t currentVersion = 0;
+        {
+            CachedStatement stmt = conn.prepare("SELECT user_id, isPrivate, version FROM posts WHERE id = ?");
+            if (!stmt) {
+                return crow::response(500, sqlite3_errmsg(db));
+            }
+            sqlite3_bind_int(stmt, 1, id);
+            if (sqlite3_step(stmt) != SQLITE_ROW) {
+                return crow::response(404, "Post not found");
+            }
+            if (sqlite3_column_int(stmt, 1) != 0 && sqlite3_column_int(stmt, 0) != user_id) {
+                return crow::response(403, "This post is private");
+            }
+            currentVersion = sqlite3_column_int64(stmt, 2);
         }
-
-        // Get post privacy status and ownership before acquiring locks
-        sqlite3_stmt* privacy_stmt;
-        int post_owner_id = -1;
-        bool isPrivate = false;
         
-        const char* privacy_sql = "SELECT user_id, isPrivate FROM posts WHERE id = ?";
-        if (sqlite3_prepare_v2(db, privacy_sql, -1, &privacy_stmt, nullptr) != SQLITE_OK) {
+        CachedStatement stmt = conn.prepare(
+            "SELECT version, saved_at, kind, raw_size, length(data) FROM post_revisions "
+            "WHERE post_id = ? AND version < ? ORDER BY version DESC LIMIT ?");
+        if (!stmt) {
+            return crow::response(500, sqlite3_errmsg(db));
+        }
+        sqlite3_bind_int(stmt, 1, id);
+        sqlite3_bind_int64(stmt, 2, before);
+        // Fetch one extra row to learn whether another page exists
+        sqlite3_bind_int(stmt, 3, limit + 1);
+        
+        crow::json::wvalue::list revisions;
+        bool hasMore = false;
+        int64_t last = 0;
+        int rc;
+        while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+            if ((int)revisions.size() == limit) {
+                hasMore = true;
+                break;
+            }
+            
+            last = sqlite3_column_int64(stmt, 0);
+            crow::json::wvalue revision;
+            revision["version"] = last;
+            revision["saved_at"] = (const char*)sqlite3_column_text(stmt, 1);
+            revision["snapshot"] = sqlite3_column_int(stmt, 2) == static_cast<int>(RevisionKind::Snapshot);
+            revision["size"] = sqlite3_column_int64(stmt, 3);
+            revision["stored_size"] = sqlite3_column_int64(stmt, 4);
+            revisions.push_back(std::move(revision));
+        }
+        if (rc != SQLITE_ROW && rc != SQLITE_DONE) {
             return crow::response(500, sqlite3_errmsg(db));
         }
         
-        sqlite3_bind_int(privacy_stmt, 1, id);
+        crow::json::wvalue result;
+        result["current_version"] = currentVersion;
+        result["revisions"] = std::move(revisions);
+        result["has_more"] = hasMore;
+        if (hasMore) {
+            result["next_before"] = last;
+        }
+        return crow::response(200, result);
+    });
+    
+    // GET a post as it was at a given version, rebuilt from its revisions
+    CROW_ROUTE(app, "/posts/<int>/revisions/<int>")
+    ([&pool, &auth](const crow::request& req, int id, int version) {
+        int user_id = auth.resolveUserId(req);
+        
+        auto conn = pool.acquireReader();
+        sqlite3* db = conn.get();
+        
+        // Access follows the post as it is now, not as it was
+        {
+            CachedStatement stmt = conn.prepare("SELECT user_id, isPrivate FROM posts INDEXED BY idx_posts_access WHERE id = ?");
+            if (!stmt) {
+                return crow::response(500, sqlite3_errmsg(db));
+            }
+            sqlite3_bind_int(stmt, 1, id);
+            if (sqlite3_step(stmt) != SQLITE_ROW) {
+                return crow::response(404, "Post not found");
+            }
+            if (sqlite3_column_int(stmt, 1) != 0 && sqlite3_column_int(stmt, 0) != user_id) {
+                return crow::response(403, "This post is private");
+            }
+        }
         
-        if (sqlite3_step(privacy_stmt) == SQLITE_ROW) {
-            post_owner_id = sqlite3_column_int(privacy_stmt, 0);
-            isPrivate = sqlite3_column_int(privacy_stmt, 1) != 0;
-        } else {
-            sqlite3_finalize(privacy_stmt);
-            return crow::response(404, "Post not found");
+        PostFields fields;
+        std::string savedAt;
+        switch (materializeRevision(conn, id, version, fields, savedAt)) {
+            case MaterializeResult::Ok:
+                break;
+            case MaterializeResult::NotFound:
+                return crow::response(404, "Revision not found");
+            case MaterializeResult::Error:
+                return crow::response(500, "Failed to rebuild revision");
+        }
+        
+        crow::json::wvalue post;
+        post["id"] = id;
+        post["version"] = version;
+        post["saved_at"] = savedAt;
+        post["title"] = fields[0];
+        post["html_code"] = fields[1];
+        post["css_code"] = fields[2];
+        post["js_code"] = fields[3];
+        
+        std::string body = post.dump();
+        return conditionalJsonResponse(req, body, computeETag(body));
+    });
+    
+    // UPDATE a post - respects privacy settings and releases locks
+    CROW_ROUTE(app, "/posts/<int>").methods("PUT"_method)
+    ([&pool, &writeQueue, &postCache, &postMutexes, &postLocks, &notifications, &auth](const crow::request& req, int id) {
+        // Check if user is authenticated
+        int user_id = auth.resolveUserId(req);
+        if (user_id == -1) {
+            return crow::response(401, "Unauthorized - Login required");
+        }
+
+        // Check lock status; if nobody holds a valid lock, take one automatically
+        if (!holdOrTakeEditLock(pool, postLocks, notifications, id, user_id)) {
+            return crow::response(423, "This post is being edited by another user");
+        }
+
+        auto x = crow::json::load(req.body);
+        if (!x) {
+            return crow::response(400, "Invalid JSON");
+        }
+
+        // Get post privacy status and ownership before acquiring locks
+        int post_owner_id = -1;
+        bool isPrivate = false;
+        {
+            auto conn = pool.acquireReader();
+            sqlite3* db = conn.get();
+            
+            const char* privacy_sql = "SELECT user_id, isPrivate FROM posts INDEXED BY idx_posts_access WHERE id = ?";
+            CachedStatement privacy_stmt = conn.prepare(privacy_sql);
+            if (!privacy_stmt) {
+                return crow::response(500, sqlite3_errmsg(db));
+            }
+            
+            sqlite3_bind_int(privacy_stmt, 1, id);
+            
+            if (sqlite3_step(privacy_stmt) == SQLITE_ROW) {
+                post_owner_id = sqlite3_column_int(privacy_stmt, 0);
+                isPrivate = sqlite3_column_int(privacy_stmt, 1) != 0;
+            } else {
+                return crow::response(404, "Post not found");
+            }
         }
-        
-        sqlite3_finalize(privacy_stmt);
         
         // If post is private, only the owner can edit it
         if (isPrivate && user_id != post_owner_id) {
             return crow::response(403, "You don't have permission to edit this private post");
         }
         
-        // Mutex locking for thread-safety with deadlock prevention
-        DeadlockSafeMutex* postMutex = nullptr;
-        
-        // Phase 1: Get the post-specific mutex
-        if (!mutexMapMutex.tryLockWithTimeout(500)) {
-            return crow::response(503, "Server busy, please try again later");
-        }
-        
-        try {
-            // Create the mutex if it doesn't exist
-            if (postMutexes.find(id) == postMutexes.end()) {
-                postMutexes[id] = std::make_unique<DeadlockSafeMutex>("post_" + std::to_string(id));
-            }
-            postMutex = postMutexes[id].get();
-            mutexMapMutex.unlock();  // Release map mutex before acquiring post mutex
-        }
-        catch (...) {
-            mutexMapMutex.unlock();  // Ensure we release the mutex even if an exception occurs
-            return crow::response(500, "Internal server error");
-        }
-        
-        // Phase 2: Lock the post-specific mutex
-        if (!postMutex->tryLockWithTimeout(1000)) {
+        // Mutex locking for thread-safety with deadlock prevention; the guard
+        // releases the post's stripe on every return path
+        DeadlockSafeMutex& postMutex = postMutexes.forKey(id);
+        if (!postMutex.tryLockWithTimeout(1000)) {
             return crow::response(503, "Post is being edited by another user, please try again later");
         }
+        std::unique_lock<DeadlockSafeMutex> postGuard(postMutex, std::adopt_lock);
         
         // Extract data from request
         std::string title = "";
@@ -502,28 +1269,47 @@ inline void setupPostRoutes(
             newPrivacySetting = x["isPrivate"].b();
         }
         
+        // Unchanged fields hash to the blobs the post already points at
+        std::string html_hash = codeHash(html_code);
+        std::string css_hash = codeHash(css_code);
+        std::string js_hash = codeHash(js_code);
+        
         crow::response errorResponse(500);
         
-        bool success = executeTransaction(db, [&](sqlite3* db) -> bool {
+        bool success = writeQueue.execute([&](ConnectionPool::Lease& conn) -> bool {
+            sqlite3* db = conn.get();
+            if (!storeCodeBlob(conn, html_hash, html_code) ||
+                !storeCodeBlob(conn, css_hash, css_code) ||
+                !storeCodeBlob(conn, js_hash, js_code)) {
+                errorResponse = crow::response(500, sqlite3_errmsg(db));
+                return false;
+            }
+            
+            // Keep the version being replaced in the revision history
+            if (!recordRevision(conn, id, {&title, &html_code, &css_code, &js_code})) {
+                errorResponse = crow::response(500, sqlite3_errmsg(db));
+                return false;
+            }
+            
             // Update the post (privacy check already done)
-            sqlite3_stmt* stmt;
             const char* sql;
             
             if (updatePrivacy) {
-                sql = "UPDATE posts SET title = ?, html_code = ?, css_code = ?, js_code = ?, isPrivate = ?, updated_at = CURRENT_TIMESTAMP WHERE id = ?";
+                sql = "UPDATE posts SET title = ?, html_hash = ?, css_hash = ?, js_hash = ?, isPrivate = ?, version = version + 1, updated_at = CURRENT_TIMESTAMP WHERE id = ?";
             } else {
-                sql = "UPDATE posts SET title = ?, html_code = ?, css_code = ?, js_code = ?, updated_at = CURRENT_TIMESTAMP WHERE id = ?";
+                sql = "UPDATE posts SET title = ?, html_hash = ?, css_hash = ?, js_hash = ?, version = version + 1, updated_at = CURRENT_TIMESTAMP WHERE id = ?";
             }
             
-            if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) != SQLITE_OK) {
+            CachedStatement stmt = conn.prepare(sql);
+            if (!stmt) {
                 errorResponse = crow::response(500, sqlite3_errmsg(db));
                 return false;
             }
             
             sqlite3_bind_text(stmt, 1, title.c_str(), -1, SQLITE_TRANSIENT);
-            sqlite3_bind_text(stmt, 2, html_code.c_str(), -1, SQLITE_TRANSIENT);
-            sqlite3_bind_text(stmt, 3, css_code.c_str(), -1, SQLITE_TRANSIENT);
-            sqlite3_bind_text(stmt, 4, js_code.c_str(), -1, SQLITE_TRANSIENT);
+            sqlite3_bind_blob(stmt, 2, html_hash.data(), static_cast<int>(html_hash.size()), SQLITE_TRANSIENT);
+            sqlite3_bind_blob(stmt, 3, css_hash.data(), static_cast<int>(css_hash.size()), SQLITE_TRANSIENT);
+            sqlite3_bind_blob(stmt, 4, js_hash.data(), static_cast<int>(js_hash.size()), SQLITE_TRANSIENT);
             
             if (updatePrivacy) {
                 sqlite3_bind_int(stmt, 5, newPrivacySetting ? 1 : 0);
@@ -534,38 +1320,35 @@ inline void setupPostRoutes(
             
             if (sqlite3_step(stmt) != SQLITE_DONE) {
                 std::string error = sqlite3_errmsg(db);
-                sqlite3_finalize(stmt);
                 errorResponse = crow::response(500, error);
                 return false;
             }
             
-            sqlite3_finalize(stmt);
             return true;
-        }, 3);  // Allow up to 3 retries
+        });
         
         // Release the post mutex
-        postMutex->unlock();
+        postGuard.unlock();
         
         if (!success) {
             return errorResponse;
         }
         
+        // Drop the cached response now that the new version is committed
+        postCache.invalidate(id);
+        
+        // A post that just turned private stops publishing to everyone but its owner
+        if (updatePrivacy && newPrivacySetting && !isPrivate) {
+            notifications.revokeExcept(id, post_owner_id, accessRevokedMessage(id));
+        }
+        
+        notifications.publish(id, postEventMessage(id, "updated"));
+        
         // After successful update, release any lock the user holds on this post
-        if (locksMapMutex.tryLockWithTimeout(500)) {
-            try {
-                auto it = postLocks.find(id);
-                if (it != postLocks.end() && it->second.user_id == user_id) {
-                    // Remove the lock since user has completed their edit
-                    postLocks.erase(it);
-                    std::cout << "Released lock on post " << id << " after successful update" << std::endl;
-                }
-                locksMapMutex.unlock();
-            }
-            catch (...) {
-                locksMapMutex.unlock();
-                std::cerr << "Error while releasing post lock" << std::endl;
-                // Don't fail the response just because of a lock issue
-            }
+        PostLock released;
+        if (postLocks.release(id, user_id, &released) == PostLockTable::ReleaseResult::Released) {
+            notifications.publish(id, lockEventMessage(id, "released", released));
+            Logger::instance().debug("post_lock_released", {{"post_id", id}, {"reason", "updated"}});
         }
         
         crow::json::wvalue result;
@@ -576,24 +1359,258 @@ inline void setupPostRoutes(
         return crow::response(200, result);
     });
     
+    // PATCH a post - applies edits to the version the client last saw and
+    // writes only the columns that changed
+    CROW_ROUTE(app, "/posts/<int>").methods("PATCH"_method)
+    ([&pool, &writeQueue, &postCache, &postMutexes, &postLocks, &notifications, &auth](const crow::request& req, int id) {
+        // Check if user is authenticated
+        int user_id = auth.resolveUserId(req);
+        if (user_id == -1) {
+            return crow::response(401, "Unauthorized - Login required");
+        }
+        
+        auto x = crow::json::load(req.body);
+        if (!x) {
+            return crow::response(400, "Invalid JSON");
+        }
+        
+        if (!x.has("base_version") || x["base_version"].t() != crow::json::type::Number) {
+            return crow::response(400, "Missing base_version field");
+        }
+        int64_t baseVersion = x["base_version"].i();
+        
+        // Fields in column order: title, html, css, js
+        static const char* const fields[4] = {"title", "html_code", "css_code", "js_code"};
+        static const char* const columns[4] = {"title", "html_hash", "css_hash", "js_hash"};
+        FieldPatch patches[4];
+        size_t spliceBudget = MAX_PATCH_SPLICES;
+        for (int i = 0; i < 4; i++) {
+            std::string parseError = parseFieldPatch(x, fields[i], patches[i], spliceBudget);
+            if (!parseError.empty()) {
+                return crow::response(400, parseError);
+            }
+        }
+        bool releaseLock = x.has("release_lock") && x["release_lock"].t() == crow::json::type::True;
+        
+        // Check lock status; if nobody holds a valid lock, take one automatically
+        if (!holdOrTakeEditLock(pool, postLocks, notifications, id, user_id)) {
+            return crow::response(423, "This post is being edited by another user");
+        }
+        
+        DeadlockSafeMutex& postMutex = postMutexes.forKey(id);
+        if (!postMutex.tryLockWithTimeout(1000)) {
+            return crow::response(503, "Post is being edited by another user, please try again later");
+        }
+        std::unique_lock<DeadlockSafeMutex> postGuard(postMutex, std::adopt_lock);
+        
+        // Read the current row; code is only loaded for fields being spliced
+        int post_owner_id = -1;
+        bool isPrivate = false;
+        int64_t currentVersion = 0;
+        std::string values[4];   // title, then the code of each patched field
+        std::string hashes[4];   // unused for the title
+        {
+            auto conn = pool.acquireReader();
+            sqlite3* db = conn.get();
+            
+            CachedStatement stmt = conn.prepare(
+                "SELECT user_id, isPrivate, version, title, html_hash, css_hash, js_hash FROM posts WHERE id = ?");
+            if (!stmt) {
+                return crow::response(500, sqlite3_errmsg(db));
+            }
+            sqlite3_bind_int(stmt, 1, id);
+            if (sqlite3_step(stmt) != SQLITE_ROW) {
+                return crow::response(404, "Post not found");
+            }
+            
+            post_owner_id = sqlite3_column_int(stmt, 0);
+            isPrivate = sqlite3_column_int(stmt, 1) != 0;
+            currentVersion = sqlite3_column_int64(stmt, 2);
+            values[0] = (const char*)sqlite3_column_text(stmt, 3);
+            for (int i = 1; i < 4; i++) {
+                const void* hash = sqlite3_column_blob(stmt, 3 + i);
+                hashes[i].assign(static_cast<const char*>(hash), sqlite3_column_bytes(stmt, 3 + i));
+            }
+            
+            if (isPrivate && user_id != post_owner_id) {
+                return crow::response(403, "You don't have permission to edit this private post");
+            }
+            if (currentVersion != baseVersion) {
+                crow::json::wvalue conflict;
+                conflict["message"] = "The post has changed since base_version";
+                conflict["version"] = currentVersion;
+                return crow::response(409, conflict);
+            }
+            
+            for (int i = 1; i < 4; i++) {
+                if (patches[i].splices.empty() || patches[i].replace) {
+                    continue;
+                }
+                CachedStatement blob_stmt = conn.prepare("SELECT content FROM code_blobs WHERE hash = ?");
+                if (!blob_stmt) {
+                    return crow::response(500, sqlite3_errmsg(db));
+                }
+                sqlite3_bind_blob(blob_stmt, 1, hashes[i].data(), static_cast<int>(hashes[i].size()), SQLITE_STATIC);
+                if (sqlite3_step(blob_stmt) != SQLITE_ROW) {
+                    return crow::response(500, "Missing code blob");
+                }
+                values[i].assign(reinterpret_cast<const char*>(sqlite3_column_text(blob_stmt, 0)),
+                                 sqlite3_column_bytes(blob_stmt, 0));
+            }
+        }
+        
+        // Apply the edits and find which columns actually change
+        bool changed[4] = {false, false, false, false};
+        for (int i = 0; i < 4; i++) {
+            if (!patches[i].present || (!patches[i].replace && patches[i].splices.empty())) {
+                continue;
+            }
+            std::string updated = patches[i].replace ? patches[i].replacement : values[i];
+            std::string spliceError;
+            if (!patches[i].replace && !applySplices(updated, patches[i].splices, spliceError)) {
+                return crow::response(400, std::string(fields[i]) + ": " + spliceError);
+            }
+            
+            if (i == 0) {
+                changed[i] = updated != values[i];
+            } else {
+                std::string updatedHash = codeHash(updated);
+                changed[i] = updatedHash != hashes[i];
+                hashes[i] = std::move(updatedHash);
+            }
+            values[i] = std::move(updated);
+        }
+        
+        bool changePrivacy = x.has("isPrivate") && user_id == post_owner_id &&
+                             x["isPrivate"].b() != isPrivate;
+        bool newPrivacySetting = changePrivacy ? !isPrivate : isPrivate;
+        
+        std::string sql = "UPDATE posts SET ";
+        for (int i = 0; i < 4; i++) {
+            if (changed[i]) {
+                sql += std::string(columns[i]) + " = ?, ";
+            }
+        }
+        if (changePrivacy) {
+            sql += "isPrivate = ?, ";
+        }
+        bool anyChange = sql.size() > std::strlen("UPDATE posts SET ");
+        sql += "version = version + 1, updated_at = CURRENT_TIMESTAMP WHERE id = ? AND version = ?";
+        
+        int64_t newVersion = currentVersion;
+        if (anyChange) {
+            crow::response errorResponse(500);
+            
+            bool success = writeQueue.execute([&](ConnectionPool::Lease& conn) -> bool {
+                sqlite3* db = conn.get();
+                for (int i = 1; i < 4; i++) {
+                    if (changed[i] && !storeCodeBlob(conn, hashes[i], values[i])) {
+                        errorResponse = crow::response(500, sqlite3_errmsg(db));
+                        return false;
+                    }
+                }
+                
+                // Every version bump records a revision, even a privacy-only one
+                std::array<const std::string*, 4> updated{};
+                for (int i = 0; i < 4; i++) {
+                    updated[i] = changed[i] ? &values[i] : nullptr;
+                }
+                if (!recordRevision(conn, id, updated)) {
+                    errorResponse = crow::response(500, sqlite3_errmsg(db));
+                    return false;
+                }
+                
+                CachedStatement stmt = conn.prepare(sql);
+                if (!stmt) {
+                    errorResponse = crow::response(500, sqlite3_errmsg(db));
+                    return false;
+                }
+                
+                int param = 1;
+                if (changed[0]) {
+                    sqlite3_bind_text(stmt, param++, values[0].c_str(), -1, SQLITE_STATIC);
+                }
+                for (int i = 1; i < 4; i++) {
+                    if (changed[i]) {
+                        sqlite3_bind_blob(stmt, param++, hashes[i].data(), static_cast<int>(hashes[i].size()), SQLITE_STATIC);
+                    }
+                }
+                if (changePrivacy) {
+                    sqlite3_bind_int(stmt, param++, newPrivacySetting ? 1 : 0);
+                }
+                sqlite3_bind_int(stmt, param++, id);
+                sqlite3_bind_int64(stmt, param++, baseVersion);
+                
+                if (sqlite3_step(stmt) != SQLITE_DONE) {
+                    errorResponse = crow::response(500, sqlite3_errmsg(db));
+                    return false;
+                }
+                if (sqlite3_changes(db) == 0) {
+                    // Deleted, or rewritten by a writer outside the post mutex
+                    errorResponse = crow::response(409, "The post has changed since base_version");
+                    return false;
+                }
+                return true;
+            });
+            
+            if (!success) {
+                return errorResponse;
+            }
+            newVersion = baseVersion + 1;
+        }
+        
+        postGuard.unlock();
+        
+        if (anyChange) {
+            postCache.invalidate(id);
+            if (changePrivacy && newPrivacySetting) {
+                notifications.revokeExcept(id, post_owner_id, accessRevokedMessage(id));
+            }
+            notifications.publish(id, postEventMessage(id, "updated"));
+        }
+        
+        Logger& logger = Logger::instance();
+        if (logger.enabled(LogLevel::Debug)) {
+            logger.debug("post_patched", {{"post_id", id}, {"version", static_cast<long long>(newVersion)},
+                                          {"request_bytes", static_cast<unsigned long>(req.body.size())}});
+        }
+        
+        bool lockReleased = false;
+        PostLock released;
+        if (releaseLock && postLocks.release(id, user_id, &released) == PostLockTable::ReleaseResult::Released) {
+            notifications.publish(id, lockEventMessage(id, "released", released));
+            Logger::instance().debug("post_lock_released", {{"post_id", id}, {"reason", "updated"}});
+            lockReleased = true;
+        }
+        
+        crow::json::wvalue result;
+        result["message"] = anyChange ? "Post updated successfully" : "No changes";
+        result["version"] = newVersion;
+        result["isPrivate"] = newPrivacySetting;
+        result["lock_released"] = lockReleased;
+        
+        return crow::response(200, result);
+    });
+    
     // DELETE a post - requires authentication
     CROW_ROUTE(app, "/posts/<int>").methods("DELETE"_method)
-    ([db, &auth, &postLocks, &locksMapMutex](const crow::request& req, int id) {
+    ([&writeQueue, &auth, &postCache, &postLocks, &notifications](const crow::request& req, int id) {
         // Check if user is authenticated
-        if (!auth.authenticate(req)) {
+        int user_id = auth.resolveUserId(req);
+        if (user_id == -1) {
             return crow::response(401, "Unauthorized - Login required");
         }
-        int user_id = auth.getUserId(req);
         
         crow::response errorResponse(500);
         bool changes = false;
+        std::vector<int> forkIds;
         
-        bool success = executeTransaction(db, [&](sqlite3* db) -> bool {
+        bool success = writeQueue.execute([&](ConnectionPool::Lease& conn) -> bool {
+            sqlite3* db = conn.get();
             // Check if post exists and belongs to the authenticated user
-            sqlite3_stmt* check_stmt;
-            const char* check_sql = "SELECT id FROM posts WHERE id = ? AND user_id = ?";
-            
-            if (sqlite3_prepare_v2(db, check_sql, -1, &check_stmt, nullptr) != SQLITE_OK) {
+            const char* check_sql = "SELECT id FROM posts INDEXED BY idx_posts_access WHERE id = ? AND user_id = ?";
+            CachedStatement check_stmt = conn.prepare(check_sql);
+            if (!check_stmt) {
                 errorResponse = crow::response(500, sqlite3_errmsg(db));
                 return false;
             }
@@ -602,18 +1619,28 @@ inline void setupPostRoutes(
             sqlite3_bind_int(check_stmt, 2, user_id);
             
             bool authorized = sqlite3_step(check_stmt) == SQLITE_ROW;
-            sqlite3_finalize(check_stmt);
             
             if (!authorized) {
                 errorResponse = crow::response(403, "Forbidden - You don't have permission to delete this post");
                 return false;
             }
             
+            // Forks lose their parent reference, so their cached bodies go stale
+            CachedStatement forks_stmt = conn.prepare("SELECT id FROM posts WHERE parent_id = ?");
+            if (!forks_stmt) {
+                errorResponse = crow::response(500, sqlite3_errmsg(db));
+                return false;
+            }
+            sqlite3_bind_int(forks_stmt, 1, id);
+            forkIds.clear();
+            while (sqlite3_step(forks_stmt) == SQLITE_ROW) {
+                forkIds.push_back(sqlite3_column_int(forks_stmt, 0));
+            }
+            
             // Delete the post
-            sqlite3_stmt* stmt;
             const char* sql = "DELETE FROM posts WHERE id = ?";
-            
-            if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) != SQLITE_OK) {
+            CachedStatement stmt = conn.prepare(sql);
+            if (!stmt) {
                 errorResponse = crow::response(500, sqlite3_errmsg(db));
                 return false;
             }
@@ -622,12 +1649,10 @@ inline void setupPostRoutes(
             
             if (sqlite3_step(stmt) != SQLITE_DONE) {
                 std::string error = sqlite3_errmsg(db);
-                sqlite3_finalize(stmt);
                 errorResponse = crow::response(500, error);
                 return false;
             }
             
-            sqlite3_finalize(stmt);
             changes = sqlite3_changes(db) > 0;
             
             return true;
@@ -641,14 +1666,18 @@ inline void setupPostRoutes(
             return crow::response(404, "Post not found");
         }
         
+        postCache.invalidate(id);
+        for (int forkId : forkIds) {
+            postCache.invalidate(forkId);
+        }
+        
+        notifications.publish(id, postEventMessage(id, "deleted"));
+        
         // Also clean up any locks for this post
-        if (locksMapMutex.tryLockWithTimeout(500)) {
-            auto it = postLocks.find(id);
-            if (it != postLocks.end()) {
-                postLocks.erase(it);
-                std::cout << "Removed lock for deleted post " << id << std::endl;
-            }
-            locksMapMutex.unlock();
+        PostLock removed;
+        if (postLocks.erase(id, &removed)) {
+            notifications.publish(id, lockEventMessage(id, "released", removed));
+            Logger::instance().debug("post_lock_released", {{"post_id", id}, {"reason", "deleted"}});
         }
         
         crow::json::wvalue result;
@@ -659,20 +1688,22 @@ inline void setupPostRoutes(
 
     // GET post creator - respects privacy settings
     CROW_ROUTE(app, "/posts/<int>/creator")
-    ([db, &auth](const crow::request& req, int post_id) {
+    ([&pool, &auth](const crow::request& req, int post_id) {
         // Use our transaction helper to ensure ACID properties
         crow::response errorResponse(500);
         crow::json::wvalue result;
         bool success = false;
         
         // Check if user is authenticated
-        int user_id = auth.authenticate(req) ? auth.getUserId(req) : -1;
+        int user_id = auth.resolveUserId(req);
         
-        // First check if the post is private
-        sqlite3_stmt* privacy_stmt;
-        const char* privacy_sql = "SELECT user_id, isPrivate FROM posts WHERE id = ?";
+        auto conn = pool.acquireReader();
+        sqlite3* db = conn.get();
         
-        if (sqlite3_prepare_v2(db, privacy_sql, -1, &privacy_stmt, nullptr) != SQLITE_OK) {
+        // First check if the post is private
+        const char* privacy_sql = "SELECT user_id, isPrivate FROM posts INDEXED BY idx_posts_access WHERE id = ?";
+        CachedStatement privacy_stmt = conn.prepare(privacy_sql);
+        if (!privacy_stmt) {
             return crow::response(500, sqlite3_errmsg(db));
         }
         
@@ -685,26 +1716,22 @@ inline void setupPostRoutes(
             post_user_id = sqlite3_column_int(privacy_stmt, 0);
             isPrivate = sqlite3_column_int(privacy_stmt, 1) != 0;
         } else {
-            sqlite3_finalize(privacy_stmt);
             return crow::response(404, "Post not found");
         }
         
-        sqlite3_finalize(privacy_stmt);
-        
         // If post is private and current user is not the owner, deny access
         if (isPrivate && post_user_id != user_id) {
             return crow::response(403, "This post is private");
         }
         
         // Query to get post creator information
-        sqlite3_stmt* stmt;
         const char* sql = 
             "SELECT u.user_id, u.username, u.email, p.id, p.isPrivate "
             "FROM users u "
-            "JOIN posts p ON u.user_id = p.user_id "
+            "JOIN posts p INDEXED BY idx_posts_access ON u.user_id = p.user_id "
             "WHERE p.id = ?";
-        
-        if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) != SQLITE_OK) {
+        CachedStatement stmt = conn.prepare(sql);
+        if (!stmt) {
             errorResponse = crow::response(500, "Database error: " + std::string(sqlite3_errmsg(db)));
             return errorResponse;
         }
@@ -732,8 +1759,6 @@ inline void setupPostRoutes(
             success = true;
         }
         
-        sqlite3_finalize(stmt);
-        
         if (!success) {
             return crow::response(404, "Post not found or has no creator");
         }
@@ -744,20 +1769,22 @@ inline void setupPostRoutes(
 
 // Setup post lock routes
 inline void setupPostLockRoutes(
-    crow::App<crow::CORSHandler>& app,
-    sqlite3* db,
+    ServerApp& app,
+    ConnectionPool& pool,
     AuthMiddleware& auth,
-    std::unordered_map<int, PostLock>& postLocks,
-    DeadlockSafeMutex& locksMapMutex
+    PostLockTable& postLocks,
+    NotificationHub& notifications
 ) {
+    trackRoutes(app, {"/posts/<int>/lock"});
+    
     // ACQUIRE a lock on a post for editing
     CROW_ROUTE(app, "/posts/<int>/lock").methods("POST"_method)
-    ([db, &postLocks, &locksMapMutex, &auth](const crow::request& req, int post_id) {
+    ([&pool, &postLocks, &notifications, &auth](const crow::request& req, int post_id) {
         // Check if user is authenticated
-        if (!auth.authenticate(req)) {
+        int user_id = auth.resolveUserId(req);
+        if (user_id == -1) {
             return crow::response(401, "Unauthorized - Login required");
         }
-        int user_id = auth.getUserId(req);
         
         // Parse request body for custom lock duration (optional)
         int lock_duration = DEFAULT_LOCK_DURATION;
@@ -768,38 +1795,36 @@ inline void setupPostLockRoutes(
             lock_duration = std::min(lock_duration, 3600); // Max 1 hour
         }
         
+        auto conn = pool.acquireReader();
+        sqlite3* db = conn.get();
+        
         // Get username for the lock
         std::string username = "Unknown User";
-        sqlite3_stmt* name_stmt;
         const char* name_sql = "SELECT username FROM users WHERE user_id = ?";
-        
-        if (sqlite3_prepare_v2(db, name_sql, -1, &name_stmt, nullptr) == SQLITE_OK) {
+        CachedStatement name_stmt = conn.prepare(name_sql);
+        if (name_stmt) {
             sqlite3_bind_int(name_stmt, 1, user_id);
             
             if (sqlite3_step(name_stmt) == SQLITE_ROW) {
                 username = (const char*)sqlite3_column_text(name_stmt, 0);
             }
-            sqlite3_finalize(name_stmt);
         }
         
         // Check if post exists and respect privacy settings
-        sqlite3_stmt* post_stmt;
-        const char* post_sql = "SELECT user_id, isPrivate FROM posts WHERE id = ?";
-        
-        if (sqlite3_prepare_v2(db, post_sql, -1, &post_stmt, nullptr) != SQLITE_OK) {
+        const char* post_sql = "SELECT user_id, isPrivate FROM posts INDEXED BY idx_posts_access WHERE id = ?";
+        CachedStatement post_stmt = conn.prepare(post_sql);
+        if (!post_stmt) {
             return crow::response(500, sqlite3_errmsg(db));
         }
         
         sqlite3_bind_int(post_stmt, 1, post_id);
         
         if (sqlite3_step(post_stmt) != SQLITE_ROW) {
-            sqlite3_finalize(post_stmt);
             return crow::response(404, "Post not found");
         }
         
         int post_owner_id = sqlite3_column_int(post_stmt, 0);
         bool isPrivate = sqlite3_column_int(post_stmt, 1) != 0;
-        sqlite3_finalize(post_stmt);
         
         // Check privacy - private posts can only be edited by owner
         if (isPrivate && post_owner_id != user_id) {
@@ -807,163 +1832,485 @@ inline void setupPostLockRoutes(
         }
         
         // Try to acquire the lock
-        if (!locksMapMutex.tryLockWithTimeout(500)) {
-            return crow::response(503, "Server busy, please try again later");
-        }
+        PostLock holder;
+        auto outcome = postLocks.tryAcquire(post_id, user_id, username,
+                                            std::chrono::seconds(lock_duration), holder);
         
         crow::json::wvalue result;
-        crow::response response(200);
+        auto now = std::chrono::system_clock::now();
         
-        try {
-            auto now = std::chrono::system_clock::now();
-            
-            // Check if the post is already locked
-            auto lock_it = postLocks.find(post_id);
-            if (lock_it != postLocks.end()) {
-                // If lock exists, check if it belongs to current user or has expired
-                if (lock_it->second.user_id == user_id) {
-                    // User already has the lock, just extend it
-                    lock_it->second.expires_at = now + std::chrono::seconds(lock_duration);
-                    result["message"] = "Lock extended";
-                    result["expires_at"] = std::chrono::duration_cast<std::chrono::seconds>(
-                        lock_it->second.expires_at.time_since_epoch()).count();
-                    result["lock_holder"] = username;
-                    result["seconds_remaining"] = lock_duration;
-                } 
-                else if (lock_it->second.expires_at <= now) {
-                    // Lock expired, assign to current user
-                    lock_it->second.user_id = user_id;
-                    lock_it->second.expires_at = now + std::chrono::seconds(lock_duration);
-                    lock_it->second.username = username;
-                    result["message"] = "Lock acquired (previous lock expired)";
-                    result["expires_at"] = std::chrono::duration_cast<std::chrono::seconds>(
-                        lock_it->second.expires_at.time_since_epoch()).count();
-                    result["lock_holder"] = username;
-                    result["seconds_remaining"] = lock_duration;
-                } 
-                else {
-                    // Lock is still valid and belongs to another user
-                    result["message"] = "Post is currently being edited by another user";
-                    result["lock_holder"] = lock_it->second.username;
-                    
-                    auto remaining = std::chrono::duration_cast<std::chrono::seconds>(
-                        lock_it->second.expires_at - now).count();
-                    result["seconds_remaining"] = remaining;
-                    
-                    response.code = 423; // Locked (HTTP status code)
-                }
-            } 
-            else {
-                // No lock exists, create new lock
-                postLocks[post_id] = {
-                    user_id,
-                    now + std::chrono::seconds(lock_duration),
-                    username
-                };
-                
-                result["message"] = "Lock acquired successfully";
-                result["expires_at"] = std::chrono::duration_cast<std::chrono::seconds>(
-                    postLocks[post_id].expires_at.time_since_epoch()).count();
-                result["lock_holder"] = username;
-                result["seconds_remaining"] = lock_duration;
-            }
-            
-            locksMapMutex.unlock();
-            response.body = result.dump();
-            return response;
+        if (outcome == PostLockTable::AcquireResult::HeldByOther) {
+            // Lock is still valid and belongs to another user
+            result["message"] = "Post is currently being edited by another user";
+            result["lock_holder"] = holder.username;
+            result["seconds_remaining"] = std::chrono::duration_cast<std::chrono::seconds>(
+                holder.expires_at - now).count();
+            return crow::response(423, result);  // Locked (HTTP status code)
         }
-        catch (...) {
-            locksMapMutex.unlock();
-            return crow::response(500, "Internal server error while processing lock");
+        
+        if (outcome == PostLockTable::AcquireResult::Extended) {
+            result["message"] = "Lock extended";
+        } else if (outcome == PostLockTable::AcquireResult::Reacquired) {
+            result["message"] = "Lock acquired (previous lock expired)";
+        } else {
+            result["message"] = "Lock acquired successfully";
         }
+        bool extended = outcome == PostLockTable::AcquireResult::Extended;
+        notifications.publish(post_id, lockEventMessage(post_id, extended ? "extended" : "acquired", holder));
+        result["expires_at"] = std::chrono::duration_cast<std::chrono::seconds>(
+            holder.expires_at.time_since_epoch()).count();
+        result["lock_holder"] = username;
+        result["seconds_remaining"] = lock_duration;
+        
+        return crow::response(200, result);
     });
     
     // RELEASE a lock on a post (explicit release)
     CROW_ROUTE(app, "/posts/<int>/lock").methods("DELETE"_method)
-    ([&postLocks, &locksMapMutex, &auth](const crow::request& req, int post_id) {
+    ([&postLocks, &notifications, &auth](const crow::request& req, int post_id) {
         // Check if user is authenticated
-        if (!auth.authenticate(req)) {
+        int user_id = auth.resolveUserId(req);
+        if (user_id == -1) {
             return crow::response(401, "Unauthorized - Login required");
         }
-        int user_id = auth.getUserId(req);
         
-        if (!locksMapMutex.tryLockWithTimeout(500)) {
-            return crow::response(503, "Server busy, please try again later");
-        }
-        
-        try {
-            // Check if the post is locked
-            auto lock_it = postLocks.find(post_id);
-            if (lock_it == postLocks.end()) {
-                locksMapMutex.unlock();
+        PostLock released;
+        switch (postLocks.release(post_id, user_id, &released)) {
+            case PostLockTable::ReleaseResult::NotFound:
                 return crow::response(404, "No lock found for this post");
-            }
-            
-            // Only the lock owner can release the lock
-            if (lock_it->second.user_id != user_id) {
-                locksMapMutex.unlock();
+            case PostLockTable::ReleaseResult::NotOwner:
+                // Only the lock owner can release the lock
                 return crow::response(403, "You don't have permission to release this lock");
-            }
-            
-            // Remove the lock
-            postLocks.erase(lock_it);
-            locksMapMutex.unlock();
-            
-            crow::json::wvalue result;
-            result["message"] = "Lock released successfully";
-            return crow::response(200, result);
-        }
-        catch (...) {
-            locksMapMutex.unlock();
-            return crow::response(500, "Internal server error while processing lock release");
+            default:
+                break;
         }
+        
+        notifications.publish(post_id, lockEventMessage(post_id, "released", released));
+        
+        crow::json::wvalue result;
+        result["message"] = "Lock released successfully";
+        return crow::response(200, result);
     });
     
     // CHECK lock status on a post
     CROW_ROUTE(app, "/posts/<int>/lock").methods("GET"_method)
-    ([&postLocks, &locksMapMutex, &auth](const crow::request& req, int post_id) {
+    ([&postLocks, &auth](const crow::request& req, int post_id) {
         // No auth required to check lock status
+        std::optional<PostLock> lock = postLocks.status(post_id);
+        crow::json::wvalue result;
         
-        if (!locksMapMutex.tryLockWithTimeout(500)) {
-            return crow::response(503, "Server busy, please try again later");
+        if (lock) {
+            // Valid lock exists
+            result["locked"] = true;
+            result["user_id"] = lock->user_id;
+            result["username"] = lock->username;
+            
+            auto remaining = std::chrono::duration_cast<std::chrono::seconds>(
+                lock->expires_at - std::chrono::system_clock::now()).count();
+            result["seconds_remaining"] = remaining;
+            
+            // Check if requesting user is the lock holder
+            int user_id = auth.resolveUserId(req);
+            result["is_lock_holder"] = (user_id == lock->user_id);
+        } 
+        else {
+            // No valid lock
+            result["locked"] = false;
         }
         
+        return crow::response(200, result);
+    });
+}
+// Setup real-time notification routes
+//
+// Clients open a WebSocket on /ws and send JSON messages:
+//   {"action": "subscribe", "post_id": 1, "token": "..."}   (token optional)
+//   {"action": "unsubscribe", "post_id": 1}
+// and then receive the lock and post events published for those posts.
+inline void setupNotificationRoutes(
+    ServerApp& app,
+    ConnectionPool& pool,
+    AuthMiddleware& auth,
+    PostLockTable& postLocks,
+    NotificationHub& notifications
+) {
+    trackRoutes(app, {"/ws"});
+    
+    auto sendError = [](crow::websocket::connection& conn, const std::string& error) {
+        crow::json::wvalue message;
+        message["type"] = "error";
+        message["message"] = error;
+        conn.send_text(message.dump());
+    };
+    
+    CROW_WEBSOCKET_ROUTE(app, "/ws")
+    .onopen([&notifications](crow::websocket::connection& conn) {
+        notifications.addConnection(conn);
+    })
+    .onclose([&notifications](crow::websocket::connection& conn, const std::string&, uint16_t) {
+        notifications.removeConnection(conn);
+    })
+    .onerror([&notifications](crow::websocket::connection& conn, const std::string&) {
+        notifications.removeConnection(conn);
+    })
+    .onmessage([&pool, &auth, &postLocks, &notifications, sendError](
+        crow::websocket::connection& conn, const std::string& data, bool isBinary) {
+        if (isBinary) {
+            sendError(conn, "Binary messages are not supported");
+            return;
+        }
+        
+        std::string action;
+        int post_id = -1;
+        std::string token;
         try {
-            auto now = std::chrono::system_clock::now();
-            
-            // Check if the post is locked
-            auto lock_it = postLocks.find(post_id);
-            crow::json::wvalue result;
-            
-            if (lock_it != postLocks.end() && lock_it->second.expires_at > now) {
-                // Valid lock exists
-                result["locked"] = true;
-                result["user_id"] = lock_it->second.user_id;
-                result["username"] = lock_it->second.username;
-                
-                auto remaining = std::chrono::duration_cast<std::chrono::seconds>(
-                    lock_it->second.expires_at - now).count();
-                result["seconds_remaining"] = remaining;
-                
-                // Check if requesting user is the lock holder
-                int user_id = auth.authenticate(req) ? auth.getUserId(req) : -1;
-                result["is_lock_holder"] = (user_id == lock_it->second.user_id);
-            } 
-            else {
-                // No valid lock
-                if (lock_it != postLocks.end()) {
-                    // Lock exists but expired, clean it up
-                    postLocks.erase(lock_it);
-                }
-                result["locked"] = false;
+            auto x = crow::json::load(data);
+            if (!x || !x.has("action") || !x.has("post_id")) {
+                sendError(conn, "Expected action and post_id");
+                return;
             }
-            
-            locksMapMutex.unlock();
-            return crow::response(200, result);
+            action = x["action"].s();
+            post_id = static_cast<int>(x["post_id"].i());
+            if (x.has("token")) {
+                token = x["token"].s();
+            }
+        } catch (const std::exception&) {
+            sendError(conn, "Invalid message");
+            return;
+        }
+        
+        if (action == "unsubscribe") {
+            notifications.unsubscribe(conn, post_id);
+            return;
+        }
+        if (action != "subscribe") {
+            sendError(conn, "Unknown action");
+            return;
+        }
+        
+        int user_id = token.empty() ? -1 : auth.getUserIdForToken(token);
+        
+        // Private posts only publish to their owner
+        auto checkAccess = [&pool, post_id, user_id](std::string& error) -> bool {
+            auto reader = pool.acquireReader();
+            const char* sql = "SELECT user_id, isPrivate FROM posts INDEXED BY idx_posts_access WHERE id = ?";
+            CachedStatement stmt = reader.prepare(sql);
+            if (!stmt) {
+                error = "Database error";
+                return false;
+            }
+            sqlite3_bind_int(stmt, 1, post_id);
+            if (sqlite3_step(stmt) != SQLITE_ROW) {
+                error = "Post not found";
+                return false;
+            }
+            int owner_id = sqlite3_column_int(stmt, 0);
+            bool isPrivate = sqlite3_column_int(stmt, 1) != 0;
+            if (isPrivate && user_id != owner_id) {
+                error = "Access denied: This post is private";
+                return false;
+            }
+            return true;
+        };
+        
+        std::string accessError;
+        if (!checkAccess(accessError)) {
+            sendError(conn, accessError);
+            return;
+        }
+        
+        if (!notifications.subscribe(conn, post_id, user_id)) {
+            sendError(conn, "Too many subscriptions");
+            return;
+        }
+        
+        // The post may have turned private between the check and the
+        // subscribe, after the update revoked its other subscribers
+        if (!checkAccess(accessError)) {
+            notifications.unsubscribe(conn, post_id);
+            sendError(conn, accessError);
+            return;
+        }
+        
+        // Acknowledge with the current lock state so clients need no initial poll
+        crow::json::wvalue ack;
+        ack["type"] = "subscribed";
+        ack["post_id"] = post_id;
+        std::optional<PostLock> lock = postLocks.status(post_id);
+        ack["locked"] = lock.has_value();
+        if (lock) {
+            ack["user_id"] = lock->user_id;
+            ack["username"] = lock->username;
+            ack["expires_at"] = std::chrono::duration_cast<std::chrono::seconds>(
+                lock->expires_at.time_since_epoch()).count();
+        }
+        conn.send_text(ack.dump());
+    });
+}
+
+// Setup search routes
+inline void setupSearchRoutes(
+    ServerApp& app,
+    ConnectionPool& pool,
+    AuthMiddleware& auth
+) {
+    trackRoutes(app, {"/search"});
+    
+    // GET posts matching a full-text query, best matches first
+    // 
+    // Query parameters: q (required), limit, and cursor (the next_cursor of
+    // the previous page). Private posts are only returned to their owner.
+    // Snippets show the best matching passage with matches wrapped in « ».
+    // A query matching more than MAX_SEARCH_CANDIDATES posts is ranked
+    // among its newest matches only (see PostSearch.h).
+    CROW_ROUTE(app, "/search")
+    ([&pool, &auth](const crow::request& req) {
+        int user_id = auth.resolveUserId(req);
+        
+        const char* q = req.url_params.get("q");
+        if (q == nullptr || std::strlen(q) > MAX_SEARCH_QUERY_LENGTH) {
+            return crow::response(400, "q is required and may be at most 256 characters");
+        }
+        std::string match = buildSearchMatch(q);
+        if (match.empty()) {
+            return crow::response(400, "q must contain at least one word");
+        }
+        
+        int limit = DEFAULT_PAGE_SIZE;
+        int offset = 0;
+        try {
+            if (const char* value = req.url_params.get("limit")) {
+                limit = std::stoi(value);
+            }
+            if (const char* value = req.url_params.get("cursor")) {
+                offset = std::stoi(value);
+            }
+        } catch (const std::exception&) {
+            return crow::response(400, "Invalid pagination parameters");
+        }
+        if (limit < 1 || offset < 0) {
+            return crow::response(400, "Invalid pagination parameters");
+        }
+        limit = std::min(limit, MAX_PAGE_SIZE);
+        if (offset > MAX_SEARCH_OFFSET) {
+            return crow::response(400, "Refine the query to see more results");
+        }
+        
+        auto conn = pool.acquireReader();
+        std::vector<SearchHit> hits;
+        bool hasMore = false;
+        if (!searchPosts(conn, match, user_id, limit, offset, hits, hasMore)) {
+            return crow::response(500, sqlite3_errmsg(conn.get()));
+        }
+        
+        crow::json::wvalue::list results;
+        for (SearchHit& hit : hits) {
+            crow::json::wvalue post;
+            post["id"] = hit.id;
+            post["user_id"] = hit.userId;
+            post["title"] = std::move(hit.title);
+            post["created_at"] = std::move(hit.createdAt);
+            post["updated_at"] = std::move(hit.updatedAt);
+            post["isPrivate"] = hit.isPrivate;
+            post["username"] = std::move(hit.username);
+            post["snippet"] = std::move(hit.snippet);
+            results.push_back(std::move(post));
+        }
+        
+        crow::json::wvalue result;
+        result["posts"] = std::move(results);
+        result["has_more"] = hasMore;
+        if (hasMore) {
+            result["next_cursor"] = std::to_string(offset + limit);
         }
-        catch (...) {
-            locksMapMutex.unlock();
-            return crow::response(500, "Internal server error while checking lock status");
+        return crow::response(200, result);
+    });
+}
+
+// Setup server statistics routes
+inline void setupStatsRoutes(
+    ServerApp& app,
+    ConnectionPool& pool,
+    WriteQueue& writeQueue,
+    PostCache& postCache,
+    NotificationHub& notifications,
+    const WalCheckpointer* checkpointer = nullptr
+) {
+    trackRoutes(app, {"/stats"});
+    
+    // GET runtime statistics for monitoring
+    CROW_ROUTE(app, "/stats")
+    ([&pool, &writeQueue, &postCache, &notifications, checkpointer]() {
+        auto statementStats = pool.statementCacheStats();
+        auto writeStats = writeQueue.stats();
+        auto postCacheStats = postCache.stats();
+        
+        crow::json::wvalue result;
+        result["statement_cache"]["hits"] = statementStats.hits;
+        result["statement_cache"]["misses"] = statementStats.misses;
+        result["write_queue"]["jobs"] = writeStats.jobs;
+        result["write_queue"]["batches"] = writeStats.batches;
+        result["write_queue"]["fallbacks"] = writeStats.fallbacks;
+        result["write_queue"]["largest_batch"] = writeStats.largestBatch;
+        auto notificationStats = notifications.stats();
+        result["notifications"]["connections"] = notificationStats.connections;
+        result["notifications"]["subscriptions"] = notificationStats.subscriptions;
+        result["notifications"]["published"] = notificationStats.published;
+        result["notifications"]["delivered"] = notificationStats.delivered;
+        result["post_cache"]["hits"] = postCacheStats.hits;
+        result["post_cache"]["misses"] = postCacheStats.misses;
+        result["post_cache"]["evictions"] = postCacheStats.evictions;
+        result["post_cache"]["invalidations"] = postCacheStats.invalidations;
+        result["post_cache"]["entries"] = postCacheStats.entries;
+        result["post_cache"]["bytes"] = postCacheStats.bytes;
+        result["post_cache"]["capacity_bytes"] = postCacheStats.capacity;
+        result["post_cache"]["validators"] = postCacheStats.validators;
+        result["post_cache"]["validator_hits"] = postCacheStats.validatorHits;
+        result["post_cache"]["validator_misses"] = postCacheStats.validatorMisses;
+        
+        // Wait and hold times per named mutex, as histograms in microseconds
+        MutexMetricsRegistry::instance().forEach([&result](const std::string& name, const MutexMetrics& metrics) {
+            crow::json::wvalue& entry = result["mutexes"][name];
+            entry["acquisitions"] = metrics.acquisitions.load(std::memory_order_relaxed);
+            entry["contended"] = metrics.contended.load(std::memory_order_relaxed);
+            entry["timeouts"] = metrics.timeouts.load(std::memory_order_relaxed);
+            entry["max_hold_us"] = metrics.maxHoldUs.load(std::memory_order_relaxed);
+            for (size_t i = 0; i < MUTEX_HISTOGRAM_BUCKETS; i++) {
+                std::string bucket = i < MUTEX_HISTOGRAM_BUCKETS - 1
+                    ? "le_" + std::to_string(MUTEX_HISTOGRAM_BOUNDS_US[i])
+                    : "inf";
+                entry["wait_us"][bucket] = metrics.waitHistogram[i].load(std::memory_order_relaxed);
+                entry["hold_us"][bucket] = metrics.holdHistogram[i].load(std::memory_order_relaxed);
+            }
+        });
+        
+        // The checkpointer is optional; without it SQLite checkpoints on commit
+        if (checkpointer != nullptr) {
+            auto checkpointStats = checkpointer->stats();
+            result["wal_checkpointer"]["runs"] = checkpointStats.runs;
+            result["wal_checkpointer"]["frames_checkpointed"] = checkpointStats.framesCheckpointed;
+            result["wal_checkpointer"]["failures"] = checkpointStats.failures;
+        }
+        
+        return crow::response(200, result);
+    });
+}
+
+// Setup Prometheus metrics routes
+//
+// Registers collectors for the state other components already track and
+// serves everything in the Prometheus text format on /metrics.
+inline void setupMetricsRoutes(
+    ServerApp& app,
+    ConnectionPool& pool,
+    WriteQueue& writeQueue,
+    PostCache& postCache,
+    PostLockTable& postLocks,
+    NotificationHub& notifications,
+    PasswordHasher& hasher,
+    const WalCheckpointer* checkpointer = nullptr
+) {
+    trackRoutes(app, {"/metrics"});
+    
+    Metrics& metrics = Metrics::instance();
+    
+    metrics.addCollector([&postLocks](std::string& out) {
+        Metrics::writeHeader(out, "post_locks", "Editing locks stored, including expired ones not yet evicted", "gauge");
+        Metrics::writeSample(out, "post_locks", "", static_cast<double>(postLocks.size()));
+        Metrics::writeHeader(out, "post_locks_expired_total", "Editing locks evicted after expiring", "counter");
+        Metrics::writeSample(out, "post_locks_expired_total", "", static_cast<double>(postLocks.expiredLocks()));
+    });
+    
+    metrics.addCollector([](std::string& out) {
+        std::string acquisitions, contended, timeouts, wait, hold;
+        MutexMetricsRegistry::instance().forEach([&](const std::string& name, const MutexMetrics& mutex) {
+            std::string label = "mutex=\"" + name + "\"";
+            Metrics::writeSample(acquisitions, "mutex_acquisitions_total", label,
+                                 static_cast<double>(mutex.acquisitions.load(std::memory_order_relaxed)));
+            Metrics::writeSample(contended, "mutex_contended_total", label,
+                                 static_cast<double>(mutex.contended.load(std::memory_order_relaxed)));
+            Metrics::writeSample(timeouts, "mutex_timeouts_total", label,
+                                 static_cast<double>(mutex.timeouts.load(std::memory_order_relaxed)));
+            
+            // The registry's histograms are cumulated here into Prometheus buckets
+            uint64_t waitCount = 0, holdCount = 0;
+            for (size_t i = 0; i < MUTEX_HISTOGRAM_BUCKETS; i++) {
+                waitCount += mutex.waitHistogram[i].load(std::memory_order_relaxed);
+                holdCount += mutex.holdHistogram[i].load(std::memory_order_relaxed);
+                std::string le = i < MUTEX_HISTOGRAM_BUCKETS - 1
+                    ? ",le=\"" + std::to_string(MUTEX_HISTOGRAM_BOUNDS_US[i] / 1e6) + "\""
+                    : ",le=\"+Inf\"";
+                Metrics::writeSample(wait, "mutex_wait_seconds_bucket", label + le, static_cast<double>(waitCount));
+                Metrics::writeSample(hold, "mutex_hold_seconds_bucket", label + le, static_cast<double>(holdCount));
+            }
+            Metrics::writeSample(wait, "mutex_wait_seconds_sum", label,
+                                 mutex.waitSumUs.load(std::memory_order_relaxed) / 1e6);
+            Metrics::writeSample(wait, "mutex_wait_seconds_count", label, static_cast<double>(waitCount));
+            Metrics::writeSample(hold, "mutex_hold_seconds_sum", label,
+                                 mutex.holdSumUs.load(std::memory_order_relaxed) / 1e6);
+            Metrics::writeSample(hold, "mutex_hold_seconds_count", label, static_cast<double>(holdCount));
+        });
+        
+        Metrics::writeHeader(out, "mutex_acquisitions_total", "DeadlockSafeMutex acquisitions", "counter");
+        out += acquisitions;
+        Metrics::writeHeader(out, "mutex_contended_total", "DeadlockSafeMutex acquisitions that had to wait", "counter");
+        out += contended;
+        Metrics::writeHeader(out, "mutex_timeouts_total", "DeadlockSafeMutex lock attempts that timed out", "counter");
+        out += timeouts;
+        Metrics::writeHeader(out, "mutex_wait_seconds", "Time spent waiting for DeadlockSafeMutexes", "histogram");
+        out += wait;
+        Metrics::writeHeader(out, "mutex_hold_seconds", "Time DeadlockSafeMutexes were held", "histogram");
+        out += hold;
+    });
+    
+    metrics.addCollector([&pool, &writeQueue, &postCache, &notifications, &hasher, checkpointer](std::string& out) {
+        auto counter = [&out](const char* name, const char* help, double value) {
+            Metrics::writeHeader(out, name, help, "counter");
+            Metrics::writeSample(out, name, "", value);
+        };
+        auto gauge = [&out](const char* name, const char* help, double value) {
+            Metrics::writeHeader(out, name, help, "gauge");
+            Metrics::writeSample(out, name, "", value);
+        };
+        
+        auto statementStats = pool.statementCacheStats();
+        counter("sqlite_statement_cache_hits_total", "Prepared statements served from the cache", statementStats.hits);
+        counter("sqlite_statement_cache_misses_total", "Prepared statements compiled on a cache miss", statementStats.misses);
+        
+        auto writeStats = writeQueue.stats();
+        counter("write_queue_jobs_total", "Write operations submitted to the write queue", writeStats.jobs);
+        counter("write_queue_batches_total", "Transactions committed by the write queue", writeStats.batches);
+        counter("write_queue_fallbacks_total", "Write operations re-run alone after a failed batch", writeStats.fallbacks);
+        
+        auto cacheStats = postCache.stats();
+        counter("post_cache_hits_total", "Post responses served from the cache", cacheStats.hits);
+        counter("post_cache_misses_total", "Post responses built from the database", cacheStats.misses);
+        counter("post_cache_evictions_total", "Post responses evicted to stay within budget", cacheStats.evictions);
+        gauge("post_cache_bytes", "Bytes held by the post response cache", cacheStats.bytes);
+        
+        auto notificationStats = notifications.stats();
+        gauge("websocket_connections", "Open notification WebSockets", notificationStats.connections);
+        gauge("websocket_subscriptions", "Post subscriptions across all WebSockets", notificationStats.subscriptions);
+        counter("notifications_delivered_total", "Events queued for WebSocket subscribers", notificationStats.delivered);
+        
+        auto hashStats = hasher.stats();
+        counter("password_hashes_total", "PBKDF2 derivations run for logins and registrations", hashStats.hashed);
+        counter("password_hash_rejected_total", "Hashing requests refused because the queue or waiters were full", hashStats.rejected);
+        gauge("password_hash_queued", "Hashing requests waiting for a hashing thread", hashStats.queued);
+        gauge("password_hash_waiting", "Requests blocked on a password hash", hashStats.waiting);
+        
+        if (checkpointer != nullptr) {
+            auto checkpointStats = checkpointer->stats();
+            counter("wal_checkpoints_total", "Background WAL checkpoints run", checkpointStats.runs);
+            counter("wal_checkpoint_failures_total", "Background WAL checkpoints that failed", checkpointStats.failures);
         }
     });
-}
\ No newline at end of file
+    
+    // GET all metrics in the Prometheus text exposition format
+    CROW_ROUTE(app, "/metrics")
+    ([]() {
+        crow::response res(200, Metrics::instance().scrape());
+        res.set_header("Content-Type", "text/plain; version=0.0.4; charset=utf-8");
+        return res;
+    });
+}
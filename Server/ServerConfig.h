@@ -0,0 +1,138 @@
+#pragma once
+#include "DatabaseUtils.h"
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <unordered_map>
+#include <cstdlib>
+#include <cctype>
+#include <algorithm>
+
+/**
+ * Runtime settings read from an optional config file and the environment
+ *
+ * The file holds one "key = value" pair per line; blank lines and lines
+ * starting with '#' are ignored. Every key can also be set through an
+ * environment variable named after the key in upper case (db_pool_size ->
+ * DB_POOL_SIZE), which takes precedence over the file.
+ *
+ * See server.conf.example for the recognised keys.
+ */
+class ServerConfig {
+private:
+    std::unordered_map<std::string, std::string> values;
+
+    static std::string trim(const std::string& text) {
+        size_t start = text.find_first_not_of(" \t\r\n");
+        if (start == std::string::npos) {
+            return "";
+        }
+        size_t end = text.find_last_not_of(" \t\r\n");
+        return text.substr(start, end - start + 1);
+    }
+
+public:
+    static std::string toUpper(std::string text) {
+        std::transform(text.begin(), text.end(), text.begin(),
+                       [](unsigned char c) { return static_cast<char>(std::toupper(c)); });
+        return text;
+    }
+
+    /**
+     * Loads key/value pairs from a config file
+     *
+     * @param path Path to the file
+     * @return true if the file was read, false if it does not exist or cannot be opened
+     */
+    bool loadFile(const std::string& path) {
+        std::ifstream file(path);
+        if (!file) {
+            return false;
+        }
+
+        std::string line;
+        int lineNumber = 0;
+        while (std::getline(file, line)) {
+            lineNumber++;
+            line = trim(line);
+            if (line.empty() || line[0] == '#') {
+                continue;
+            }
+
+            size_t equals = line.find('=');
+            if (equals == std::string::npos) {
+                std::cerr << "Ignoring malformed line " << lineNumber << " in " << path << std::endl;
+                continue;
+            }
+            values[trim(line.substr(0, equals))] = trim(line.substr(equals + 1));
+        }
+
+        std::cout << "Loaded configuration from " << path << std::endl;
+        return true;
+    }
+
+    /**
+     * Looks up a setting, preferring the environment over the config file
+     */
+    std::string getString(const std::string& key, const std::string& fallback) const {
+        if (const char* env = std::getenv(toUpper(key).c_str())) {
+            return env;
+        }
+        auto it = values.find(key);
+        return it == values.end() ? fallback : it->second;
+    }
+
+    /**
+     * Looks up an integer setting; values that are not numbers yield the fallback
+     */
+    long long getInt(const std::string& key, long long fallback) const {
+        std::string value = getString(key, "");
+        if (value.empty()) {
+            return fallback;
+        }
+
+        char* end = nullptr;
+        long long parsed = std::strtoll(value.c_str(), &end, 10);
+        if (end == value.c_str() || *end != '\0') {
+            std::cerr << "Invalid value for " << key << ": " << value << std::endl;
+            return fallback;
+        }
+        return parsed;
+    }
+};
+
+/**
+ * Builds the SQLite tuning from a loaded configuration
+ *
+ * Recognised keys: durability (safe, balanced or fast), busy_timeout_ms,
+ * wal_autocheckpoint, mmap_size, cache_size_kb, sql_profiling and temp_store.
+ */
+inline DatabaseSettings databaseSettingsFromConfig(const ServerConfig& config) {
+    DatabaseSettings settings;
+
+    std::string durability = config.getString("durability", "safe");
+    if (durability == "safe") {
+        settings.durability = DurabilityTier::Safe;
+    } else if (durability == "balanced") {
+        settings.durability = DurabilityTier::Balanced;
+    } else if (durability == "fast") {
+        settings.durability = DurabilityTier::Fast;
+    } else {
+        std::cerr << "Unknown durability tier '" << durability << "', using safe" << std::endl;
+    }
+
+    settings.busyTimeoutMs = static_cast<int>(std::max(0LL, config.getInt("busy_timeout_ms", settings.busyTimeoutMs)));
+    settings.walAutocheckpointPages = static_cast<int>(std::max(0LL, config.getInt("wal_autocheckpoint", settings.walAutocheckpointPages)));
+    settings.mmapSizeBytes = std::max(0LL, config.getInt("mmap_size", settings.mmapSizeBytes));
+    settings.cacheSizeKb = std::max(0LL, config.getInt("cache_size_kb", settings.cacheSizeKb));
+    settings.profileStatements = config.getInt("sql_profiling", 1) != 0;
+
+    std::string tempStore = ServerConfig::toUpper(config.getString("temp_store", settings.tempStore));
+    if (tempStore == "DEFAULT" || tempStore == "FILE" || tempStore == "MEMORY") {
+        settings.tempStore = tempStore;
+    } else {
+        std::cerr << "Unknown temp_store '" << tempStore << "', using DEFAULT" << std::endl;
+    }
+
+    return settings;
+}
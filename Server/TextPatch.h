@@ -0,0 +1,82 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cstddef>
+
+/**
+ * Splice-based text edits, used for partial post updates
+ *
+ * A splice replaces `remove` bytes at byte offset `at` with `insert`.
+ * Offsets and lengths count UTF-8 bytes and must fall on character
+ * boundaries, so applying splices to valid UTF-8 with valid UTF-8 inserts
+ * always gives valid UTF-8.
+ */
+struct TextSplice {
+    size_t at = 0;
+    size_t remove = 0;
+    std::string insert;
+};
+
+// True if a UTF-8 string can be cut at this byte offset
+inline bool isUtf8Boundary(const std::string& text, size_t offset) {
+    return offset == 0 || offset >= text.size() ||
+           (static_cast<unsigned char>(text[offset]) & 0xC0) != 0x80;
+}
+
+/**
+ * Applies splices in order, each to the result of the ones before it
+ *
+ * @param text Edited in place; left unchanged if any splice is invalid
+ * @param error Receives a description of the first invalid splice
+ * @return false if a splice is out of range or cuts a character in two
+ */
+inline bool applySplices(std::string& text, const std::vector<TextSplice>& splices, std::string& error) {
+    std::string result = text;
+    for (size_t i = 0; i < splices.size(); i++) {
+        const TextSplice& splice = splices[i];
+        if (splice.at > result.size() || splice.remove > result.size() - splice.at) {
+            error = "Edit " + std::to_string(i) + " is outside the text";
+            return false;
+        }
+        if (!isUtf8Boundary(result, splice.at) || !isUtf8Boundary(result, splice.at + splice.remove)) {
+            error = "Edit " + std::to_string(i) + " splits a UTF-8 character";
+            return false;
+        }
+        result.replace(splice.at, splice.remove, splice.insert);
+    }
+    text = std::move(result);
+    return true;
+}
+
+/**
+ * Returns the single splice that turns `from` into `to`
+ *
+ * Keeps the longest common prefix and suffix, backed off to character
+ * boundaries, and replaces what lies between. Typing in one place of a
+ * large text therefore yields a splice the size of the edit, not the text.
+ */
+inline TextSplice diffSplice(const std::string& from, const std::string& to) {
+    size_t limit = std::min(from.size(), to.size());
+    size_t prefix = 0;
+    while (prefix < limit && from[prefix] == to[prefix]) {
+        prefix++;
+    }
+    while (prefix > 0 && !isUtf8Boundary(from, prefix)) {
+        prefix--;
+    }
+
+    size_t suffix = 0;
+    while (suffix < limit - prefix && from[from.size() - 1 - suffix] == to[to.size() - 1 - suffix]) {
+        suffix++;
+    }
+    while (suffix > 0 && !isUtf8Boundary(from, from.size() - suffix)) {
+        suffix--;
+    }
+
+    TextSplice splice;
+    splice.at = prefix;
+    splice.remove = from.size() - prefix - suffix;
+    splice.insert = to.substr(prefix, to.size() - prefix - suffix);
+    return splice;
+}
@@ -0,0 +1,195 @@
+#pragma once
+#include <openssl/hmac.h>
+#include <openssl/evp.h>
+#include <openssl/crypto.h>
+#include <openssl/rand.h>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cctype>
+#include <cstdint>
+#include <stdexcept>
+
+/**
+ * Issues and verifies self-contained HMAC-SHA256 signed tokens
+ *
+ * A token reads "<key id>.<user id>.<expiry>.<signature>", where the expiry
+ * is in Unix seconds and the signature is the hex HMAC-SHA256 of everything
+ * before it under the named key. Verifying needs nothing but the keys, so
+ * tokens survive restarts and any number of server processes sharing the
+ * keys accept each other's tokens without shared state or locks.
+ *
+ * Key rotation: the first key signs new tokens and every key verifies.
+ * To rotate, put a new key first and keep the old one listed until the
+ * tokens it signed have expired (one token TTL), then drop it.
+ */
+class TokenSigner {
+public:
+    struct Key {
+        std::string id;
+        std::string secret;
+    };
+
+    // Secrets shorter than this weaken the signature
+    static constexpr size_t MIN_SECRET_BYTES = 32;
+
+private:
+    std::vector<Key> keys;  // Immutable after construction
+    std::chrono::seconds ttl;
+
+    static std::string toHex(const unsigned char* data, size_t length) {
+        static const char digits[] = "0123456789abcdef";
+        std::string hex;
+        hex.reserve(length * 2);
+        for (size_t i = 0; i < length; i++) {
+            hex.push_back(digits[data[i] >> 4]);
+            hex.push_back(digits[data[i] & 0x0f]);
+        }
+        return hex;
+    }
+
+    static std::string sign(const Key& key, const std::string& message) {
+        unsigned char mac[EVP_MAX_MD_SIZE];
+        unsigned int macLength = 0;
+        HMAC(EVP_sha256(), key.secret.data(), static_cast<int>(key.secret.size()),
+             reinterpret_cast<const unsigned char*>(message.data()), message.size(),
+             mac, &macLength);
+        return toHex(mac, macLength);
+    }
+
+    // Parses a non-negative decimal number with no sign, spaces or overflow
+    static bool parseNumber(const std::string& text, size_t begin, size_t end, long long& value) {
+        if (begin == end || end - begin > 18) {
+            return false;
+        }
+        value = 0;
+        for (size_t i = begin; i < end; i++) {
+            if (!std::isdigit(static_cast<unsigned char>(text[i]))) {
+                return false;
+            }
+            value = value * 10 + (text[i] - '0');
+        }
+        return true;
+    }
+
+    static long long nowSeconds() {
+        return std::chrono::duration_cast<std::chrono::seconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+    }
+
+public:
+    /**
+     * @param keys Signing keys, the active one first; must not be empty
+     * @param ttl How long an issued token stays valid
+     */
+    TokenSigner(std::vector<Key> keys, std::chrono::seconds ttl)
+        : keys(std::move(keys)), ttl(ttl) {
+        if (this->keys.empty()) {
+            throw std::invalid_argument("TokenSigner needs at least one key");
+        }
+    }
+
+    /**
+     * Parses a key list of the form "id:secret, id:secret, ..."
+     *
+     * Entries without an id or secret are skipped. Key ids may not
+     * contain '.', which separates the token fields.
+     */
+    static std::vector<Key> parseKeys(const std::string& text) {
+        std::vector<Key> parsed;
+        size_t start = 0;
+        while (start <= text.size()) {
+            size_t comma = text.find(',', start);
+            if (comma == std::string::npos) {
+                comma = text.size();
+            }
+            std::string entry = text.substr(start, comma - start);
+            size_t first = entry.find_first_not_of(" \t");
+            size_t last = entry.find_last_not_of(" \t");
+            if (first != std::string::npos) {
+                entry = entry.substr(first, last - first + 1);
+                size_t colon = entry.find(':');
+                if (colon != std::string::npos && colon > 0 && colon + 1 < entry.size() &&
+                    entry.find('.') >= colon) {
+                    parsed.push_back(Key{entry.substr(0, colon), entry.substr(colon + 1)});
+                }
+            }
+            start = comma + 1;
+        }
+        return parsed;
+    }
+
+    /**
+     * Creates a random key that only this process knows
+     *
+     * Tokens signed with it stop verifying when the process exits.
+     */
+    static Key randomKey() {
+        unsigned char secret[MIN_SECRET_BYTES];
+        if (RAND_bytes(secret, sizeof(secret)) != 1) {
+            throw std::runtime_error("Cannot generate a random signing key");
+        }
+        return Key{"local", toHex(secret, sizeof(secret))};
+    }
+
+    const std::vector<Key>& getKeys() const { return keys; }
+
+    /**
+     * Issues a token for a user, signed with the active key
+     */
+    std::string issue(int userId) const {
+        const Key& key = keys.front();
+        std::string payload = key.id + "." + std::to_string(userId) + "." +
+                              std::to_string(nowSeconds() + ttl.count());
+        return payload + "." + sign(key, payload);
+    }
+
+    /**
+     * Verifies a token's signature and expiry
+     *
+     * @return The user ID the token was issued for, or -1 if the token is
+     *         malformed, signed with an unknown key, forged or expired
+     */
+    int verify(const std::string& token) const {
+        size_t signatureDot = token.rfind('.');
+        size_t keyDot = token.find('.');
+        if (signatureDot == std::string::npos || keyDot == signatureDot) {
+            return -1;
+        }
+
+        const Key* key = nullptr;
+        for (const Key& candidate : keys) {
+            if (token.compare(0, keyDot, candidate.id) == 0) {
+                key = &candidate;
+                break;
+            }
+        }
+        if (key == nullptr) {
+            return -1;
+        }
+
+        // Constant-time compare, so response timing reveals nothing about
+        // how much of a forged signature was right
+        std::string payload = token.substr(0, signatureDot);
+        std::string expected = sign(*key, payload);
+        if (token.size() - signatureDot - 1 != expected.size() ||
+            CRYPTO_memcmp(token.data() + signatureDot + 1, expected.data(), expected.size()) != 0) {
+            return -1;
+        }
+
+        // The signature is valid, so the fields are ours
+        size_t userDot = token.find('.', keyDot + 1);
+        long long userId = 0;
+        long long expiresAt = 0;
+        if (userDot >= signatureDot ||
+            !parseNumber(token, keyDot + 1, userDot, userId) ||
+            !parseNumber(token, userDot + 1, signatureDot, expiresAt) ||
+            userId > INT32_MAX) {
+            return -1;
+        }
+        if (expiresAt <= nowSeconds()) {
+            return -1;
+        }
+        return static_cast<int>(userId);
+    }
+};
@@ -0,0 +1,135 @@
+#pragma once
+#include "sqlite3.h"
+#include "DatabaseUtils.h"
+#include <iostream>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <atomic>
+#include <cstdint>
+
+/**
+ * Background thread that checkpoints the WAL on its own connection
+ *
+ * With wal_autocheckpoint enabled, the commit that pushes the WAL past the
+ * threshold runs the checkpoint itself, so one unlucky request stalls while
+ * pages are copied back into the database file. When this checkpointer is
+ * running the pool disables autocheckpoint and the work moves here instead.
+ *
+ * Checkpoints are PASSIVE: they copy as many frames as possible without
+ * waiting on readers or the writer, so they never block a request. Under the
+ * balanced durability tier this is also what fsyncs the WAL, which bounds
+ * the window of commits a power loss can roll back to about one interval.
+ */
+class WalCheckpointer {
+private:
+    std::string path;
+    DatabaseSettings settings;
+    std::chrono::milliseconds interval;
+
+    std::thread worker;
+    std::mutex mtx;
+    std::condition_variable wakeup;
+    bool stopping = false;
+
+    std::atomic<uint64_t> runs{0};
+    std::atomic<uint64_t> framesCheckpointed{0};
+    std::atomic<uint64_t> failures{0};
+
+    void run(sqlite3* db) {
+        std::unique_lock<std::mutex> lock(mtx);
+        while (!wakeup.wait_for(lock, interval, [this] { return stopping; })) {
+            lock.unlock();
+            checkpoint(db);
+            lock.lock();
+        }
+        lock.unlock();
+
+        // Leave as little WAL behind as possible on shutdown
+        checkpoint(db);
+        sqlite3_close(db);
+    }
+
+    void checkpoint(sqlite3* db) {
+        int logFrames = 0;
+        int checkpointed = 0;
+        int rc = sqlite3_wal_checkpoint_v2(db, nullptr, SQLITE_CHECKPOINT_PASSIVE, &logFrames, &checkpointed);
+        runs.fetch_add(1, std::memory_order_relaxed);
+
+        if (rc != SQLITE_OK && rc != SQLITE_BUSY) {
+            failures.fetch_add(1, std::memory_order_relaxed);
+            std::cerr << "WAL checkpoint failed: " << sqlite3_errmsg(db) << std::endl;
+            return;
+        }
+        if (checkpointed > 0) {
+            framesCheckpointed.fetch_add(static_cast<uint64_t>(checkpointed), std::memory_order_relaxed);
+        }
+    }
+
+public:
+    struct Stats {
+        uint64_t runs;
+        uint64_t framesCheckpointed;
+        uint64_t failures;
+    };
+
+    /**
+     * @param path Path to the SQLite database file
+     * @param settings Tuning for the checkpoint connection; its durability
+     *                 tier decides whether checkpoints fsync
+     * @param interval Time between checkpoints
+     */
+    WalCheckpointer(const std::string& path, const DatabaseSettings& settings, std::chrono::milliseconds interval)
+        : path(path), settings(settings), interval(interval) {}
+
+    ~WalCheckpointer() {
+        stop();
+    }
+
+    WalCheckpointer(const WalCheckpointer&) = delete;
+    WalCheckpointer& operator=(const WalCheckpointer&) = delete;
+
+    /**
+     * Opens the checkpoint connection and starts the thread
+     *
+     * @return true if the thread is running, false if the connection could not be opened
+     */
+    bool start() {
+        sqlite3* db = nullptr;
+        int flags = SQLITE_OPEN_READWRITE | SQLITE_OPEN_NOMUTEX;
+        if (sqlite3_open_v2(path.c_str(), &db, flags, nullptr) != SQLITE_OK) {
+            std::cerr << "Cannot open checkpoint connection: " << sqlite3_errmsg(db) << std::endl;
+            sqlite3_close(db);
+            return false;
+        }
+        configureSQLiteForACID(db, settings);
+
+        worker = std::thread(&WalCheckpointer::run, this, db);
+        std::cout << "WAL checkpointer running every " << interval.count() << "ms" << std::endl;
+        return true;
+    }
+
+    /**
+     * Runs a final checkpoint and joins the thread; safe to call more than once
+     */
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            stopping = true;
+        }
+        wakeup.notify_all();
+        if (worker.joinable()) {
+            worker.join();
+        }
+    }
+
+    Stats stats() const {
+        return Stats{
+            runs.load(std::memory_order_relaxed),
+            framesCheckpointed.load(std::memory_order_relaxed),
+            failures.load(std::memory_order_relaxed)
+        };
+    }
+};
@@ -0,0 +1,303 @@
+#pragma once
+#include "sqlite3.h"
+#include "ConnectionPool.h"
+#include "Logger.h"
+#include "Metrics.h"
+#include <functional>
+#include <future>
+#include <exception>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <deque>
+#include <vector>
+#include <atomic>
+#include <algorithm>
+#include <cstdint>
+
+/**
+ * Group-commit queue in front of the pool's writer connection
+ *
+ * Request threads submit write operations and block on a future; a single
+ * writer thread drains the queue and applies everything it finds in one
+ * transaction, so a burst of saves shares one COMMIT (and one fsync)
+ * instead of queueing for the writer one BEGIN/COMMIT at a time.
+ *
+ * Each operation runs inside its own SAVEPOINT, so an operation that
+ * returns false (or throws) is rolled back alone without affecting the rest
+ * of its batch. Futures of successful operations are only fulfilled once
+ * the batch has committed.
+ *
+ * If the batch transaction itself cannot be started or committed, every
+ * operation that was not already answered is re-run in a transaction of
+ * its own, with executeTransaction's usual retries.
+ */
+class WriteQueue {
+public:
+    using Operation = std::function<bool(ConnectionPool::Lease&)>;
+
+    struct Stats {
+        uint64_t jobs;
+        uint64_t batches;
+        uint64_t fallbacks;     // Jobs re-run individually after a failed batch
+        uint64_t largestBatch;
+    };
+
+private:
+    struct Job {
+        Operation operation;
+        std::promise<bool> done;
+        bool answered = false;
+    };
+
+    ConnectionPool& pool;
+    std::chrono::microseconds window;
+    size_t maxBatch;
+
+    std::mutex mtx;
+    std::condition_variable ready;
+    std::deque<Job> pending;
+    bool running = false;
+    bool stopping = false;
+    std::thread worker;
+
+    std::atomic<uint64_t> jobs{0};
+    std::atomic<uint64_t> batches{0};
+    std::atomic<uint64_t> fallbacks{0};
+    std::atomic<uint64_t> largestBatch{0};
+
+    static bool exec(sqlite3* db, const char* sql) {
+        if (sqlite3_exec(db, sql, nullptr, nullptr, nullptr) != SQLITE_OK) {
+            Logger::instance().error("write_queue_sql_failed", {{"sql", sql}, {"error", sqlite3_errmsg(db)}});
+            return false;
+        }
+        return true;
+    }
+
+    static void answer(Job& job, bool result, std::exception_ptr error = nullptr) {
+        if (error) {
+            job.done.set_exception(error);
+        } else {
+            job.done.set_value(result);
+        }
+        job.answered = true;
+    }
+
+    // Runs one operation in its own transaction, as the pool would without the queue
+    void runAlone(Job& job) {
+        ConnectionPool::Lease lease = pool.acquireWriter();
+        std::exception_ptr error;
+        bool success = executeTransaction(lease.get(), [&](sqlite3*) -> bool {
+            try {
+                return job.operation(lease);
+            } catch (...) {
+                // Roll back like any failed operation, then rethrow to the submitter
+                error = std::current_exception();
+                return false;
+            }
+        });
+        answer(job, success, error);
+    }
+
+    /**
+     * Applies a batch in a single transaction
+     *
+     * @return true if the batch committed; jobs still unanswered on false
+     *         must be re-run individually
+     */
+    bool commitBatch(std::vector<Job>& batch) {
+        const TransactionMetrics& metrics = transactionMetrics();
+        ConnectionPool::Lease lease = pool.acquireWriter();
+        sqlite3* db = lease.get();
+
+        Metrics::increment(metrics.transactions);
+        if (!exec(db, "BEGIN IMMEDIATE")) {
+            Metrics::increment(metrics.failures);
+            return false;
+        }
+
+        std::vector<Job*> applied;
+        for (Job& job : batch) {
+            if (!exec(db, "SAVEPOINT write_job")) {
+                exec(db, "ROLLBACK");
+                Metrics::increment(metrics.failures);
+                return false;
+            }
+
+            bool success = false;
+            std::exception_ptr error;
+            try {
+                success = job.operation(lease);
+            } catch (...) {
+                error = std::current_exception();
+            }
+
+            if (sqlite3_get_autocommit(db)) {
+                // Some errors (e.g. SQLITE_FULL) roll back the whole transaction,
+                // taking every job applied so far with it
+                if (!success || error) {
+                    answer(job, false, error);
+                }
+                Metrics::increment(metrics.rollbacks);
+                return false;
+            }
+
+            if (success && !error) {
+                exec(db, "RELEASE write_job");
+                applied.push_back(&job);
+            } else {
+                exec(db, "ROLLBACK TO write_job");
+                exec(db, "RELEASE write_job");
+                Metrics::increment(metrics.rollbacks);
+                answer(job, false, error);
+            }
+        }
+
+        if (!exec(db, "COMMIT")) {
+            exec(db, "ROLLBACK");
+            Metrics::increment(metrics.failures);
+            return false;
+        }
+
+        for (Job* job : applied) {
+            answer(*job, true);
+        }
+        return true;
+    }
+
+    void run() {
+        std::vector<Job> batch;
+        size_t lastBatchSize = 0;
+
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock(mtx);
+                ready.wait(lock, [this] { return stopping || !pending.empty(); });
+                if (pending.empty()) {
+                    return;  // Stopping and fully drained
+                }
+
+                // Only hold the batch open while writes are actually arriving
+                // concurrently; an isolated save is committed right away
+                if (lastBatchSize > 1 && window.count() > 0 && pending.size() < maxBatch) {
+                    ready.wait_for(lock, window, [this] {
+                        return stopping || pending.size() >= maxBatch;
+                    });
+                }
+
+                size_t count = std::min(pending.size(), maxBatch);
+                for (size_t i = 0; i < count; i++) {
+                    batch.push_back(std::move(pending.front()));
+                    pending.pop_front();
+                }
+            }
+
+            lastBatchSize = batch.size();
+            batches.fetch_add(1, std::memory_order_relaxed);
+            uint64_t largest = largestBatch.load(std::memory_order_relaxed);
+            while (batch.size() > largest &&
+                   !largestBatch.compare_exchange_weak(largest, batch.size(), std::memory_order_relaxed)) {
+            }
+
+            if (!commitBatch(batch)) {
+                for (Job& job : batch) {
+                    if (!job.answered) {
+                        fallbacks.fetch_add(1, std::memory_order_relaxed);
+                        runAlone(job);
+                    }
+                }
+            }
+            batch.clear();
+        }
+    }
+
+public:
+    /**
+     * @param pool The pool whose writer connection the queue drives
+     * @param window How long a batch stays open for more writes under load
+     * @param maxBatch Maximum number of operations per transaction
+     */
+    WriteQueue(ConnectionPool& pool, std::chrono::microseconds window, size_t maxBatch)
+        : pool(pool), window(window), maxBatch(maxBatch == 0 ? 1 : maxBatch) {}
+
+    ~WriteQueue() {
+        stop();
+    }
+
+    WriteQueue(const WriteQueue&) = delete;
+    WriteQueue& operator=(const WriteQueue&) = delete;
+
+    void start() {
+        std::lock_guard<std::mutex> lock(mtx);
+        if (running) {
+            return;
+        }
+        running = true;
+        worker = std::thread(&WriteQueue::run, this);
+    }
+
+    /**
+     * Commits everything still queued and joins the writer thread
+     *
+     * Writes submitted afterwards run directly on the writer connection.
+     */
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            stopping = true;
+        }
+        ready.notify_all();
+        if (worker.joinable()) {
+            worker.join();
+        }
+    }
+
+    /**
+     * Queues a write operation
+     *
+     * The operation runs on the writer thread; anything it captures by
+     * reference must stay alive until the returned future is ready.
+     *
+     * @param operation Database work to run inside the batch transaction;
+     *                  returning false rolls back just this operation
+     * @return A future that becomes true once the operation has committed,
+     *         or false if it was rolled back
+     */
+    std::future<bool> submit(Operation operation) {
+        Job job;
+        job.operation = std::move(operation);
+        std::future<bool> result = job.done.get_future();
+        jobs.fetch_add(1, std::memory_order_relaxed);
+
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            if (running && !stopping) {
+                pending.push_back(std::move(job));
+                ready.notify_one();
+                return result;
+            }
+        }
+
+        runAlone(job);
+        return result;
+    }
+
+    /**
+     * Queues a write operation and waits for it to commit
+     *
+     * Drop-in replacement for ConnectionPool::executeWrite.
+     */
+    bool execute(Operation operation) {
+        return submit(std::move(operation)).get();
+    }
+
+    Stats stats() const {
+        return Stats{
+            jobs.load(std::memory_order_relaxed),
+            batches.load(std::memory_order_relaxed),
+            fallbacks.load(std::memory_order_relaxed),
+            largestBatch.load(std::memory_order_relaxed)
+        };
+    }
+};
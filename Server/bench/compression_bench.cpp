@@ -0,0 +1,206 @@
+/**
+ * Bandwidth and CPU cost of response compression
+ *
+ * Compresses representative response bodies with every coding at the
+ * levels the server uses (per-request and "thorough", see compressBody)
+ * and reports compressed size and CPU time per body against identity.
+ *
+ * Bodies are synthetic pens of several sizes plus listing pages. With a
+ * database path, the latest posts in it are measured as well.
+ *
+ * Build from Server/:
+ *   g++ -std=c++17 -O2 -I. bench/compression_bench.cpp -lsqlite3 -lz -lbrotlienc -o compression_bench
+ * Run:
+ *   ./compression_bench [codepen.db]
+ */
+#include "Compression.h"
+#include "sqlite3.h"
+#include <cstdio>
+#include <ctime>
+#include <random>
+#include <string>
+#include <vector>
+
+struct Body {
+    std::string name;
+    std::string json;
+};
+
+static std::string jsonString(const std::string& text) {
+    std::string out = "\"";
+    for (char c : text) {
+        switch (c) {
+            case '"': out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\n': out += "\\n"; break;
+            case '\t': out += "\\t"; break;
+            default: out += c;
+        }
+    }
+    return out + "\"";
+}
+
+static std::string postJson(int id, const std::string& title, const std::string& html,
+                            const std::string& css, const std::string& js) {
+    return "{\"id\":" + std::to_string(id) + ",\"user_id\":" + std::to_string(id % 97) +
+           ",\"title\":" + jsonString(title) + ",\"html_code\":" + jsonString(html) +
+           ",\"css_code\":" + jsonString(css) + ",\"js_code\":" + jsonString(js) +
+           ",\"created_at\":\"2025-03-14 09:26:53\",\"updated_at\":\"2025-03-15 17:02:11\"" +
+           ",\"isPrivate\":false,\"parent_id\":null,\"version\":3}";
+}
+
+// A pen of roughly `blocks` components, each with markup, rules and a handler
+static Body syntheticPen(const std::string& name, int blocks, std::mt19937& rng) {
+    static const char* const words[] = {"card", "panel", "button", "header", "grid", "item", "toggle",
+                                        "modal", "list", "badge", "avatar", "slider", "nav", "footer"};
+    auto word = [&]() { return std::string(words[rng() % 14]); };
+    std::string html = "<main class=\"app\">\n";
+    std::string css = ":root { --accent: #4f46e5; --radius: 8px; }\n";
+    std::string js = "const state = { open: false, count: 0 };\n";
+    for (int i = 0; i < blocks; i++) {
+        std::string cls = word() + "-" + std::to_string(rng() % 1000);
+        html += "  <section class=\"" + cls + "\" data-index=\"" + std::to_string(i) + "\">\n"
+                "    <h2>" + word() + " " + word() + "</h2>\n"
+                "    <p>Lorem ipsum " + word() + " dolor sit amet, " + word() + " elit.</p>\n"
+                "    <button id=\"btn-" + cls + "\">" + word() + "</button>\n  </section>\n";
+        css += "." + cls + " {\n  display: flex;\n  padding: " + std::to_string(rng() % 32) + "px;\n"
+               "  border-radius: var(--radius);\n  color: #" + std::to_string(100000 + rng() % 899999) + ";\n}\n"
+               "." + cls + ":hover { transform: translateY(-" + std::to_string(rng() % 5) + "px); }\n";
+        js += "document.getElementById('btn-" + cls + "').addEventListener('click', (event) => {\n"
+              "  state.count += " + std::to_string(rng() % 10) + ";\n"
+              "  event.target.textContent = `" + word() + " ${state.count}`;\n});\n";
+    }
+    html += "</main>\n";
+    return {name, postJson(1, "Synthetic " + name, html, css, js)};
+}
+
+// A page of GET /posts: metadata only
+static Body listingPage(int rows) {
+    std::string json = "{\"posts\":[";
+    for (int i = 0; i < rows; i++) {
+        json += std::string(i ? "," : "") + "{\"id\":" + std::to_string(100000 - i) +
+                ",\"user_id\":" + std::to_string(i % 37) + ",\"title\":\"Pen number " + std::to_string(i * 7919 % 10007) +
+                "\",\"created_at\":\"2025-03-14 09:26:53\",\"updated_at\":\"2025-03-15 17:" +
+                std::to_string(10 + i % 50) + ":11\",\"isPrivate\":false}";
+    }
+    json += "],\"has_more\":true,\"next_cursor\":\"2025-03-15 17:10:11|99900\"}";
+    return {"posts page (" + std::to_string(rows) + " rows)", json};
+}
+
+static void loadDatabaseBodies(const char* path, std::vector<Body>& bodies) {
+    sqlite3* db = nullptr;
+    if (sqlite3_open_v2(path, &db, SQLITE_OPEN_READONLY, nullptr) != SQLITE_OK) {
+        std::fprintf(stderr, "Cannot open %s\n", path);
+        sqlite3_close(db);
+        return;
+    }
+    sqlite3_stmt* stmt = nullptr;
+    const char* sql = "SELECT id, title, html_code, css_code, js_code FROM posts_with_code ORDER BY id DESC LIMIT 200";
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) != SQLITE_OK) {
+        std::fprintf(stderr, "Cannot read posts: %s\n", sqlite3_errmsg(db));
+        sqlite3_close(db);
+        return;
+    }
+    auto text = [stmt](int column) {
+        const unsigned char* value = sqlite3_column_text(stmt, column);
+        return std::string(value ? reinterpret_cast<const char*>(value) : "");
+    };
+    std::vector<std::string> posts;
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        posts.push_back(postJson(sqlite3_column_int(stmt, 0), text(1), text(2), text(3), text(4)));
+    }
+    sqlite3_finalize(stmt);
+    sqlite3_close(db);
+    for (size_t i = 0; i < posts.size(); i++) {
+        bodies.push_back({"db post " + std::to_string(i), std::move(posts[i])});
+    }
+}
+
+struct Result {
+    size_t bytes = 0;
+    double cpuMicros = 0;
+};
+
+// Compresses the body repeatedly for at least minSeconds of CPU time
+static Result measure(const std::string& body, ContentEncoding encoding, bool thorough, double minSeconds) {
+    Result result;
+    std::string output;
+    int runs = 0;
+    std::clock_t start = std::clock();
+    double elapsed = 0;
+    do {
+        if (encoding == ContentEncoding::Identity) {
+            output = body;
+        } else if (!compressBody(body, encoding, output, thorough)) {
+            std::fprintf(stderr, "compression failed\n");
+            return result;
+        }
+        runs++;
+        elapsed = static_cast<double>(std::clock() - start) / CLOCKS_PER_SEC;
+    } while (elapsed < minSeconds);
+    result.bytes = output.size();
+    result.cpuMicros = elapsed * 1e6 / runs;
+    return result;
+}
+
+int main(int argc, char** argv) {
+    std::mt19937 rng(42);
+    std::vector<Body> bodies = {
+        syntheticPen("small pen", 3, rng),
+        syntheticPen("typical pen", 25, rng),
+        syntheticPen("large pen", 250, rng),
+        listingPage(20),
+        listingPage(100),
+    };
+    size_t synthetic = bodies.size();
+    if (argc > 1) {
+        loadDatabaseBodies(argv[1], bodies);
+    }
+
+    struct Variant {
+        const char* name;
+        ContentEncoding encoding;
+        bool thorough;
+    };
+    const Variant variants[] = {
+        {"identity", ContentEncoding::Identity, false},
+        {"gzip", ContentEncoding::Gzip, false},
+        {"gzip thorough", ContentEncoding::Gzip, true},
+        {"deflate", ContentEncoding::Deflate, false},
+        {"br", ContentEncoding::Brotli, false},
+        {"br thorough", ContentEncoding::Brotli, true},
+    };
+
+    std::printf("%-24s %-14s %10s %7s %10s %9s\n", "body", "coding", "bytes", "ratio", "cpu us", "MB/s");
+    for (size_t i = 0; i < synthetic; i++) {
+        const Body& body = bodies[i];
+        for (const Variant& variant : variants) {
+            Result r = measure(body.json, variant.encoding, variant.thorough, 0.2);
+            std::printf("%-24s %-14s %10zu %6.1f%% %10.1f %9.1f\n", body.name.c_str(), variant.name, r.bytes,
+                        100.0 * r.bytes / body.json.size(), r.cpuMicros, body.json.size() / r.cpuMicros);
+        }
+    }
+
+    // Database posts are summarized over the whole sample; bodies below
+    // COMPRESSION_MIN_BYTES count as identity, as the server sends them
+    if (bodies.size() > synthetic) {
+        size_t count = bodies.size() - synthetic;
+        size_t rawBytes = 0;
+        for (size_t i = synthetic; i < bodies.size(); i++) {
+            rawBytes += bodies[i].json.size();
+        }
+        std::printf("\n%zu database posts, %zu bytes as identity\n", count, rawBytes);
+        for (const Variant& variant : variants) {
+            size_t bytes = 0;
+            double cpu = 0;
+            for (size_t i = synthetic; i < bodies.size(); i++) {
+                Result r = measure(bodies[i].json, variant.encoding, variant.thorough, 0.002);
+                bytes += bodies[i].json.size() < COMPRESSION_MIN_BYTES ? bodies[i].json.size() : r.bytes;
+                cpu += bodies[i].json.size() < COMPRESSION_MIN_BYTES ? 0 : r.cpuMicros;
+            }
+            std::printf("%-24s %-14s %10zu %6.1f%% %10.1f\n", "database posts (mean)", variant.name, bytes / count,
+                        100.0 * bytes / rawBytes, cpu / count);
+        }
+    }
+    return 0;
+}
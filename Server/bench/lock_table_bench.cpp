@@ -0,0 +1,174 @@
+/**
+ * Contention benchmark for post editing locks
+ *
+ * Compares PostLockTable with the single-mutex map it replaced: one
+ * std::unordered_map<int, PostLock> behind one mutex, taken by every lock
+ * check. Each thread works on its own range of post ids, so the posts are
+ * unrelated and any slowdown as threads are added is lock contention.
+ *
+ * The operation mix follows the lock endpoints: mostly status checks
+ * (GET /posts/<int>/lock and the check before every save), some acquires
+ * and releases.
+ *
+ * Build from Server/:
+ *   g++ -std=c++17 -O2 -I. bench/lock_table_bench.cpp -lpthread -o lock_table_bench
+ * Run:
+ *   ./lock_table_bench [seconds per run]
+ */
+#include "PostLockSystem.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+using Clock = std::chrono::steady_clock;
+
+// The table before PostLockTable: one map, one mutex
+class SingleMutexLockMap {
+private:
+    std::mutex mtx;
+    std::unordered_map<int, PostLock> locks;
+
+public:
+    bool tryAcquire(int postId, int userId, const std::string& username, std::chrono::seconds duration) {
+        auto now = std::chrono::system_clock::now();
+        std::lock_guard<std::mutex> lock(mtx);
+        auto it = locks.find(postId);
+        if (it != locks.end() && it->second.user_id != userId && it->second.expires_at > now) {
+            return false;
+        }
+        locks[postId] = PostLock{userId, now + duration, username};
+        return true;
+    }
+
+    std::optional<PostLock> status(int postId) {
+        auto now = std::chrono::system_clock::now();
+        std::lock_guard<std::mutex> lock(mtx);
+        auto it = locks.find(postId);
+        if (it == locks.end() || it->second.expires_at <= now) {
+            return std::nullopt;
+        }
+        return it->second;
+    }
+
+    void release(int postId, int userId) {
+        std::lock_guard<std::mutex> lock(mtx);
+        auto it = locks.find(postId);
+        if (it != locks.end() && it->second.user_id == userId) {
+            locks.erase(it);
+        }
+    }
+};
+
+struct PostLockTableAdapter {
+    PostLockTable table;
+
+    bool tryAcquire(int postId, int userId, const std::string& username, std::chrono::seconds duration) {
+        PostLock holder;
+        return table.tryAcquire(postId, userId, username, duration, holder) !=
+               PostLockTable::AcquireResult::HeldByOther;
+    }
+
+    std::optional<PostLock> status(int postId) {
+        return table.status(postId);
+    }
+
+    void release(int postId, int userId) {
+        table.release(postId, userId);
+    }
+};
+
+struct RunResult {
+    double opsPerSecond;
+    double p99Micros;
+};
+
+// Every thread cycles over 1000 posts of its own: 8 status checks per acquire and release
+template <typename Locks>
+RunResult run(Locks& locks, int threads, std::chrono::milliseconds duration) {
+    constexpr int POSTS_PER_THREAD = 1000;
+    std::atomic<bool> go{false};
+    std::atomic<bool> done{false};
+    std::vector<uint64_t> counts(threads, 0);
+    std::vector<std::vector<uint32_t>> samples(threads);
+
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; t++) {
+        workers.emplace_back([&, t] {
+            const std::string username = "user" + std::to_string(t);
+            const int firstPost = t * POSTS_PER_THREAD;
+            uint64_t ops = 0;
+            while (!go.load(std::memory_order_acquire)) {
+                std::this_thread::yield();
+            }
+            for (int i = 0; !done.load(std::memory_order_relaxed); i++) {
+                int postId = firstPost + i % POSTS_PER_THREAD;
+                // Time one operation in 64 for the latency percentile
+                bool sample = (i & 63) == 0;
+                Clock::time_point start = sample ? Clock::now() : Clock::time_point();
+                if (i % 10 == 0) {
+                    locks.tryAcquire(postId, t, username, std::chrono::seconds(DEFAULT_LOCK_DURATION));
+                } else if (i % 10 == 9) {
+                    locks.release(firstPost + (i - 9) % POSTS_PER_THREAD, t);
+                } else {
+                    locks.status(postId);
+                }
+                if (sample) {
+                    samples[t].push_back(static_cast<uint32_t>(
+                        std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count()));
+                }
+                ops++;
+            }
+            counts[t] = ops;
+        });
+    }
+
+    Clock::time_point start = Clock::now();
+    go.store(true, std::memory_order_release);
+    std::this_thread::sleep_for(duration);
+    done.store(true);
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+    uint64_t total = 0;
+    std::vector<uint32_t> all;
+    for (int t = 0; t < threads; t++) {
+        total += counts[t];
+        all.insert(all.end(), samples[t].begin(), samples[t].end());
+    }
+    double p99 = 0;
+    if (!all.empty()) {
+        size_t index = all.size() * 99 / 100;
+        std::nth_element(all.begin(), all.begin() + index, all.end());
+        p99 = all[index] / 1000.0;
+    }
+    return {total / seconds, p99};
+}
+
+int main(int argc, char** argv) {
+    double secondsPerRun = argc > 1 ? std::atof(argv[1]) : 1.0;
+    auto duration = std::chrono::milliseconds(static_cast<long long>(std::max(0.1, secondsPerRun) * 1000));
+    unsigned int cores = std::max(1u, std::thread::hardware_concurrency());
+    std::printf("%u hardware threads, %.1f s per run\n", cores, duration.count() / 1000.0);
+    std::printf("%8s %18s %12s %18s %12s %8s\n", "threads", "single mutex op/s", "p99 us",
+                "PostLockTable op/s", "p99 us", "speedup");
+
+    for (int threads : {1, 2, 4, 8, 16, 32}) {
+        // Fresh tables per run so map sizes and expiry heaps start equal
+        SingleMutexLockMap single;
+        RunResult before = run(single, threads, duration);
+        PostLockTableAdapter sharded;
+        RunResult after = run(sharded, threads, duration);
+        std::printf("%8d %18.0f %12.2f %18.0f %12.2f %7.2fx\n", threads, before.opsPerSecond, before.p99Micros,
+                    after.opsPerSecond, after.p99Micros, after.opsPerSecond / before.opsPerSecond);
+    }
+    return 0;
+}
@@ -0,0 +1,113 @@
+/**
+ * Login throughput against password hashing cost
+ *
+ * Drives PasswordHasher::verify, the CPU-heavy part of POST /auth/login,
+ * from concurrent clients for each combination of PBKDF2 iteration count
+ * and hashing thread count, and reports logins per second with median and
+ * p99 latency. Clients outnumber hashing threads two to one, so the queue
+ * is never empty and latency includes queueing, as under a login burst.
+ *
+ * Build from Server/:
+ *   g++ -std=c++17 -O2 -I. bench/login_bench.cpp -lcrypto -lpthread -o login_bench
+ * Run:
+ *   ./login_bench [seconds per run] [iterations,...] [threads,...]
+ *   e.g. ./login_bench 2 100000,300000,600000 1,2,4
+ */
+#include "PasswordHasher.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using Clock = std::chrono::steady_clock;
+
+static std::vector<int> parseList(const char* text) {
+    std::vector<int> values;
+    std::stringstream stream(text);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        int value = std::atoi(item.c_str());
+        if (value > 0) {
+            values.push_back(value);
+        }
+    }
+    return values;
+}
+
+struct RunResult {
+    double loginsPerSecond;
+    double p50Millis;
+    double p99Millis;
+};
+
+static RunResult run(int iterations, int hashThreads, std::chrono::milliseconds duration) {
+    const int clients = hashThreads * 2;
+    // Neither limit ever refuses a client here: each has at most one request in flight
+    PasswordHasher hasher(iterations, static_cast<size_t>(hashThreads), static_cast<size_t>(clients),
+                          static_cast<size_t>(clients));
+    std::string stored;
+    if (!hasher.hash("correct horse battery staple", stored)) {
+        std::fprintf(stderr, "hashing failed\n");
+        std::exit(1);
+    }
+
+    std::atomic<bool> done{false};
+    std::vector<std::vector<double>> latencies(clients);
+    std::vector<std::thread> workers;
+    Clock::time_point start = Clock::now();
+    for (int c = 0; c < clients; c++) {
+        workers.emplace_back([&, c] {
+            while (!done.load(std::memory_order_relaxed)) {
+                Clock::time_point begin = Clock::now();
+                PasswordHasher::VerifyResult result = hasher.verify("correct horse battery staple", stored);
+                if (result != PasswordHasher::VerifyResult::Match) {
+                    std::fprintf(stderr, "verification failed\n");
+                    std::exit(1);
+                }
+                latencies[c].push_back(std::chrono::duration<double, std::milli>(Clock::now() - begin).count());
+            }
+        });
+    }
+    std::this_thread::sleep_for(duration);
+    done.store(true);
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+    std::vector<double> all;
+    for (const auto& client : latencies) {
+        all.insert(all.end(), client.begin(), client.end());
+    }
+    std::sort(all.begin(), all.end());
+    auto percentile = [&all](double p) {
+        return all.empty() ? 0.0 : all[std::min(all.size() - 1, static_cast<size_t>(all.size() * p))];
+    };
+    return {all.size() / seconds, percentile(0.50), percentile(0.99)};
+}
+
+int main(int argc, char** argv) {
+    double secondsPerRun = argc > 1 ? std::atof(argv[1]) : 2.0;
+    std::vector<int> iterationCounts = argc > 2 ? parseList(argv[2]) : std::vector<int>{100000, 300000, 600000};
+    unsigned int cores = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<int> threadCounts = argc > 3 ? parseList(argv[3]) : std::vector<int>{1, 2, 4, static_cast<int>(cores)};
+    std::sort(threadCounts.begin(), threadCounts.end());
+    threadCounts.erase(std::unique(threadCounts.begin(), threadCounts.end()), threadCounts.end());
+    auto duration = std::chrono::milliseconds(static_cast<long long>(std::max(0.1, secondsPerRun) * 1000));
+
+    std::printf("%u hardware threads, %.1f s per run\n", cores, duration.count() / 1000.0);
+    std::printf("%11s %8s %12s %10s %10s\n", "iterations", "threads", "logins/s", "p50 ms", "p99 ms");
+    for (int iterations : iterationCounts) {
+        for (int threads : threadCounts) {
+            RunResult r = run(iterations, threads, duration);
+            std::printf("%11d %8d %12.1f %10.1f %10.1f\n", iterations, threads, r.loginsPerSecond,
+                        r.p50Millis, r.p99Millis);
+        }
+    }
+    return 0;
+}
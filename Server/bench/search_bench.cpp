@@ -0,0 +1,273 @@
+/**
+ * Search indexing throughput and query latency
+ *
+ * Fills a database with synthetic pens through the same code_blobs and
+ * posts inserts the routes use, so the triggers of the schema index every
+ * post, and reports posts indexed per second. It then times a full index
+ * rebuild (what a schema migration of posts_fts costs) and runs searchPosts,
+ * the query behind GET /search, for common, rare, multi-word and prefix
+ * queries on the first page and on the deepest allowed page, as an
+ * anonymous viewer.
+ *
+ * Words follow a Zipf distribution over a vocabulary of 4096, so the most
+ * common word is in nearly every pen and the rarest in a few. One post in
+ * ten is private. An existing database is topped up to the requested size
+ * rather than rebuilt, so larger runs can be grown step by step.
+ *
+ * Build from Server/:
+ *   g++ -std=c++17 -O2 -I. bench/search_bench.cpp -lsqlite3 -lcrypto -lpthread -o search_bench
+ * Run:
+ *   ./search_bench [posts] [database]
+ *   e.g. ./search_bench 1000000 search_bench.db
+ */
+#include "DatabaseUtils.h"
+#include "ConnectionPool.h"
+#include "PostSearch.h"
+#include "CodeBlobs.h"
+#include "sqlite3.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+
+using Clock = std::chrono::steady_clock;
+
+static const int VOCABULARY = 4096;
+static const int USERS = 1000;
+static const int BATCH = 1000;
+static const int PAGE = 20;  // DEFAULT_PAGE_SIZE of the routes
+
+static double millisSince(Clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+// Word of frequency rank `rank`: two or three syllables, all distinct
+static std::string vocabularyWord(int rank) {
+    static const char* const syllables[] = {"ka", "lo", "mi", "ne", "ru", "ta", "po", "si",
+                                            "ve", "do", "gra", "fen", "tor", "lin", "bex", "zu"};
+    std::string word = syllables[rank % 16];
+    word += syllables[(rank / 16) % 16];
+    if (rank >= 256) {
+        word += syllables[(rank / 256) % 16];
+    }
+    return word;
+}
+
+class PenGenerator {
+private:
+    std::mt19937 rng;
+    std::discrete_distribution<int> zipf;
+
+    std::string words(int count) {
+        std::string text;
+        for (int i = 0; i < count; i++) {
+            if (i > 0) {
+                text += ' ';
+            }
+            text += vocabularyWord(zipf(rng));
+        }
+        return text;
+    }
+
+public:
+    explicit PenGenerator(unsigned seed) : rng(seed) {
+        std::vector<double> weights(VOCABULARY);
+        for (int rank = 0; rank < VOCABULARY; rank++) {
+            weights[rank] = 1.0 / (rank + 1);
+        }
+        zipf = std::discrete_distribution<int>(weights.begin(), weights.end());
+    }
+
+    void next(std::string& title, std::string& html, std::string& css, std::string& js) {
+        title = words(4);
+        html = "<div class=\"" + words(1) + "\">\n  <h1>" + words(3) + "</h1>\n  <p>" + words(20) +
+               "</p>\n  <button id=\"" + words(1) + "\">" + words(2) + "</button>\n</div>\n";
+        css = "." + words(1) + " { display: grid; gap: 8px; }\n#" + words(1) +
+              " { color: #4f46e5; } /* " + words(6) + " */\n";
+        js = "const " + words(1) + " = document.querySelector('#" + words(1) + "');\n// " + words(8) +
+             "\nfunction " + words(1) + "() { return " + words(1) + "; }\n";
+    }
+};
+
+static int countPosts(sqlite3* db) {
+    sqlite3_stmt* stmt = nullptr;
+    int count = 0;
+    if (sqlite3_prepare_v2(db, "SELECT count(*) FROM posts", -1, &stmt, nullptr) == SQLITE_OK &&
+        sqlite3_step(stmt) == SQLITE_ROW) {
+        count = sqlite3_column_int(stmt, 0);
+    }
+    sqlite3_finalize(stmt);
+    return count;
+}
+
+static bool ensureUsers(sqlite3* db) {
+    return sqlite3_exec(db,
+        "WITH RECURSIVE n(i) AS (SELECT 1 UNION ALL SELECT i + 1 FROM n WHERE i < 1000) "
+        "INSERT OR IGNORE INTO users (user_id, username, email, password) "
+        "SELECT i, 'user' || i, 'user' || i || '@example.com', '' FROM n",
+        nullptr, nullptr, nullptr) == SQLITE_OK;
+}
+
+static bool storeBlob(ConnectionPool::Lease& conn, const std::string& content, std::string& hash) {
+    hash = codeHash(content);
+    CachedStatement stmt = conn.prepare(
+        "INSERT INTO code_blobs (hash, content) VALUES (?, ?) ON CONFLICT (hash) DO NOTHING");
+    if (!stmt) {
+        return false;
+    }
+    sqlite3_bind_blob(stmt, 1, hash.data(), static_cast<int>(hash.size()), SQLITE_TRANSIENT);
+    sqlite3_bind_text(stmt, 2, content.c_str(), -1, SQLITE_TRANSIENT);
+    return sqlite3_step(stmt) == SQLITE_DONE;
+}
+
+// Inserts `count` pens in transactions of BATCH posts
+static bool indexPosts(ConnectionPool& pool, PenGenerator& pens, int first, int count) {
+    std::mt19937 rng(first);
+    std::string title, html, css, js;
+    for (int done = 0; done < count; done += BATCH) {
+        int batch = std::min(BATCH, count - done);
+        bool ok = pool.executeWrite([&](ConnectionPool::Lease& conn) -> bool {
+            for (int i = 0; i < batch; i++) {
+                pens.next(title, html, css, js);
+                std::string hashes[3];
+                if (!storeBlob(conn, html, hashes[0]) || !storeBlob(conn, css, hashes[1]) ||
+                    !storeBlob(conn, js, hashes[2])) {
+                    return false;
+                }
+
+                CachedStatement stmt = conn.prepare(
+                    "INSERT INTO posts (user_id, title, html_hash, css_hash, js_hash, isPrivate) "
+                    "VALUES (?, ?, ?, ?, ?, ?)");
+                if (!stmt) {
+                    return false;
+                }
+                sqlite3_bind_int(stmt, 1, 1 + static_cast<int>(rng() % USERS));
+                sqlite3_bind_text(stmt, 2, title.c_str(), -1, SQLITE_TRANSIENT);
+                for (int h = 0; h < 3; h++) {
+                    sqlite3_bind_blob(stmt, 3 + h, hashes[h].data(), static_cast<int>(hashes[h].size()),
+                                      SQLITE_TRANSIENT);
+                }
+                sqlite3_bind_int(stmt, 6, rng() % 10 == 0 ? 1 : 0);
+                if (sqlite3_step(stmt) != SQLITE_DONE) {
+                    return false;
+                }
+            }
+            return true;
+        });
+        if (!ok) {
+            return false;
+        }
+    }
+    return true;
+}
+
+struct Latency {
+    double p50;
+    double p99;
+    size_t results;
+};
+
+static bool timeSearch(ConnectionPool& pool, const std::string& text, int offset, Latency& latency) {
+    const int runs = 50;
+    std::string match = buildSearchMatch(text);
+    std::vector<double> samples;
+    std::vector<SearchHit> hits;
+    bool hasMore = false;
+    for (int run = 0; run < runs; run++) {
+        auto conn = pool.acquireReader();
+        Clock::time_point start = Clock::now();
+        if (!searchPosts(conn, match, -1, PAGE, offset, hits, hasMore)) {
+            std::fprintf(stderr, "search failed: %s\n", sqlite3_errmsg(conn.get()));
+            return false;
+        }
+        samples.push_back(millisSince(start));
+    }
+    std::sort(samples.begin(), samples.end());
+    latency.p50 = samples[samples.size() / 2];
+    latency.p99 = samples[samples.size() * 99 / 100];
+    latency.results = hits.size();
+    return true;
+}
+
+int main(int argc, char** argv) {
+    int posts = argc > 1 ? std::atoi(argv[1]) : 200000;
+    std::string path = argc > 2 ? argv[2] : "search_bench.db";
+
+    ConnectionPool pool(path, 1);
+    if (!pool.open()) {
+        return 1;
+    }
+    {
+        auto writer = pool.acquireWriter();
+        if (!initializeDatabase(writer.get()) || !ensureUsers(writer.get())) {
+            std::fprintf(stderr, "cannot prepare %s: %s\n", path.c_str(), sqlite3_errmsg(writer.get()));
+            return 1;
+        }
+    }
+
+    int existing = 0;
+    {
+        auto writer = pool.acquireWriter();
+        existing = countPosts(writer.get());
+    }
+    if (existing < posts) {
+        PenGenerator pens(static_cast<unsigned>(existing) + 1);
+        Clock::time_point start = Clock::now();
+        if (!indexPosts(pool, pens, existing, posts - existing)) {
+            auto writer = pool.acquireWriter();
+            std::fprintf(stderr, "indexing failed: %s\n", sqlite3_errmsg(writer.get()));
+            return 1;
+        }
+        double millis = millisSince(start);
+        std::printf("indexed %d posts in %.1f s: %.0f posts/s\n", posts - existing, millis / 1000,
+                    (posts - existing) / (millis / 1000));
+    }
+
+    {
+        auto writer = pool.acquireWriter();
+        int total = countPosts(writer.get());
+        Clock::time_point start = Clock::now();
+        if (sqlite3_exec(writer.get(), "INSERT INTO posts_fts (posts_fts) VALUES ('rebuild')",
+                         nullptr, nullptr, nullptr) != SQLITE_OK) {
+            std::fprintf(stderr, "rebuild failed: %s\n", sqlite3_errmsg(writer.get()));
+            return 1;
+        }
+        std::printf("rebuilt the index of %d posts in %.1f s\n", total, millisSince(start) / 1000);
+
+        // Reading the new index out of a large WAL would slow every query;
+        // the server's checkpointer would have moved it by now
+        sqlite3_exec(writer.get(), "PRAGMA wal_checkpoint(TRUNCATE)", nullptr, nullptr, nullptr);
+    }
+
+    struct Query {
+        const char* name;
+        std::string text;
+    };
+    const std::vector<Query> queries = {
+        {"most common word", vocabularyWord(0)},
+        {"common word", vocabularyWord(20)},
+        {"rare word", vocabularyWord(VOCABULARY - 1)},
+        {"two common words", vocabularyWord(0) + " " + vocabularyWord(1)},
+        {"common + rare", vocabularyWord(0) + " " + vocabularyWord(VOCABULARY - 1)},
+        {"2-char prefix", vocabularyWord(0).substr(0, 2)},
+        {"3-char prefix", vocabularyWord(300).substr(0, 3)},
+        {"typing a word", vocabularyWord(300).substr(0, 4)},
+        {"no match", "nothingmatchesthis"},
+    };
+
+    std::printf("%-18s %-22s %8s %10s %10s %8s\n", "query", "text", "offset", "p50 ms", "p99 ms", "results");
+    for (const Query& query : queries) {
+        for (int offset : {0, MAX_SEARCH_OFFSET}) {
+            Latency latency{};
+            if (!timeSearch(pool, query.text, offset, latency)) {
+                return 1;
+            }
+            std::printf("%-18s %-22s %8d %10.2f %10.2f %8zu\n", query.name, query.text.c_str(), offset,
+                        latency.p50, latency.p99, latency.results);
+        }
+    }
+    return 0;
+}
@@ -5,68 +5,179 @@
 #include "DeadlockSafeMutex.h"
 #include <iostream>
 #include <thread>
+#include <cstdlib>
 
 // Include our new modular headers
 #include "DatabaseUtils.h"
+#include "ConnectionPool.h"
+#include "ServerConfig.h"
+#include "Logger.h"
+#include "WalCheckpointer.h"
+#include "WriteQueue.h"
+#include "CodeBlobCollector.h"
+#include "PostRevisions.h"
+#include "PasswordHasher.h"
+#include "PostCache.h"
 #include "PostLockSystem.h"
+#include "NotificationHub.h"
 #include "Routes.h"
 
 int main() {
-    // Use CORS middleware by specifying it in the App template
-    crow::App<crow::CORSHandler> app;
+    // Use the metrics and CORS middlewares by specifying them in the App template
+    ServerApp app;
     
     // Configure CORS
     auto& cors = app.get_middleware<crow::CORSHandler>();
     cors.global()
         .origin("*")
-        .methods("GET"_method, "POST"_method, "PUT"_method, "DELETE"_method, "OPTIONS"_method)
+        .methods("GET"_method, "POST"_method, "PUT"_method, "PATCH"_method, "DELETE"_method, "OPTIONS"_method)
         .headers("Content-Type", "Accept", "Authorization")
         .max_age(3600);
     
-    // Initialize SQLite database
-    sqlite3* db;
-    if (sqlite3_open("codepen.db", &db) != SQLITE_OK) {
-        std::cerr << "Cannot open database: " << sqlite3_errmsg(db) << std::endl;
+    // Settings come from server.conf (or SERVER_CONFIG) and the environment;
+    // a missing config file just means every setting keeps its default
+    ServerConfig config;
+    const char* configPath = std::getenv("SERVER_CONFIG");
+    config.loadFile(configPath ? configPath : "server.conf");
+    
+    // Structured logs are written by a background thread from here on
+    Logger& logger = Logger::instance();
+    logger.configure(parseLogLevel(config.getString("log_level", "info")),
+                     static_cast<uint64_t>(std::max(0LL, config.getInt("log_max_lines_per_second", 1000))),
+                     config.getInt("log_request_bodies", 0) != 0,
+                     static_cast<uint64_t>(std::max(1LL, config.getInt("log_debug_sample_every", 1))));
+    logger.start(static_cast<size_t>(std::max(2LL, config.getInt("log_buffer_lines", 8192))));
+    
+    // One read connection per worker thread, overridable with db_pool_size
+    unsigned int workerThreads = std::max(1u, std::thread::hardware_concurrency());
+    workerThreads = static_cast<unsigned int>(std::max(1LL, config.getInt("db_pool_size", workerThreads)));
+    
+    DatabaseSettings dbSettings = databaseSettingsFromConfig(config);
+    long long checkpointIntervalMs = config.getInt("checkpoint_interval_ms", 1000);
+    if (checkpointIntervalMs > 0) {
+        // The background checkpointer takes over from checkpoint-on-commit
+        dbSettings.walAutocheckpointPages = 0;
+    }
+    std::cout << "Database durability tier: " << durabilityTierName(dbSettings.durability) << std::endl;
+    
+    // Initialize SQLite connection pool
+    ConnectionPool pool("codepen.db", workerThreads, dbSettings);
+    if (!pool.open()) {
+        std::cerr << "Cannot open database connection pool" << std::endl;
         return 1;
     }
     
-    // Create tables if they don't exist
-    initializeDatabase(db);
+    // Create tables if they don't exist; refuse to serve a half-migrated schema
+    {
+        auto writer = pool.acquireWriter();
+        if (!initializeDatabase(writer.get(), dbSettings)) {
+            std::cerr << "Cannot migrate database schema" << std::endl;
+            return 1;
+        }
+    }
+    
+    // Checkpoint the WAL off the request path
+    std::unique_ptr<WalCheckpointer> checkpointer;
+    if (checkpointIntervalMs > 0) {
+        checkpointer = std::make_unique<WalCheckpointer>(
+            "codepen.db", dbSettings, std::chrono::milliseconds(checkpointIntervalMs));
+        if (!checkpointer->start()) {
+            return 1;
+        }
+    }
     
-    // Create authentication middleware
-    AuthMiddleware auth;
+    // Coalesce concurrent writes into shared transactions on one writer thread;
+    // by default a batch is whatever queued up while the previous one committed
+    WriteQueue writeQueue(pool,
+                          std::chrono::microseconds(std::max(0LL, config.getInt("write_batch_window_us", 0))),
+                          static_cast<size_t>(std::max(1LL, config.getInt("write_batch_max", 64))));
+    writeQueue.start();
     
-    // Use deadlock-safe mutexes instead of standard ones
-    std::unordered_map<int, std::unique_ptr<DeadlockSafeMutex>> postMutexes;
-    DeadlockSafeMutex mutexMapMutex("postMapMutex");
+    // Delete code blobs left unreferenced by edits and deletes
+    std::unique_ptr<CodeBlobCollector> blobCollector;
+    long long blobGcIntervalMs = config.getInt("code_blob_gc_interval_ms", 60000);
+    if (blobGcIntervalMs > 0) {
+        blobCollector = std::make_unique<CodeBlobCollector>(writeQueue, std::chrono::milliseconds(blobGcIntervalMs));
+        blobCollector->start();
+    }
     
-    // Post editing lock system
-    std::unordered_map<int, PostLock> postLocks;
-    DeadlockSafeMutex locksMapMutex("postLocksMapMutex");
+    // Trim revision history past the retention window and of deleted posts
+    std::unique_ptr<RevisionPruner> revisionPruner;
+    long long revisionPruneIntervalMs = config.getInt("revision_prune_interval_ms", 3600000);
+    if (revisionPruneIntervalMs > 0) {
+        revisionPruner = std::make_unique<RevisionPruner>(
+            writeQueue, std::chrono::milliseconds(revisionPruneIntervalMs),
+            static_cast<int>(std::max(0LL, config.getInt("revision_retention_days", 90))));
+        revisionPruner->start();
+    }
     
-    // Start a background thread to periodically clean up expired locks
-    std::thread cleanupThread([&postLocks, &locksMapMutex]() {
-        while (true) {
-            std::this_thread::sleep_for(std::chrono::minutes(1));
-            cleanupExpiredLocks(postLocks, locksMapMutex);
+    // Create authentication middleware; tokens expire after token_ttl_hours and
+    // are signed with auth_signing_keys (active key first)
+    std::chrono::hours tokenTtl(std::max(1LL, config.getInt("token_ttl_hours", 24)));
+    std::vector<TokenSigner::Key> signingKeys = TokenSigner::parseKeys(config.getString("auth_signing_keys", ""));
+    if (signingKeys.empty()) {
+        std::cerr << "No auth_signing_keys configured; using a random key, so logins "
+                  << "will not survive a restart" << std::endl;
+        signingKeys.push_back(TokenSigner::randomKey());
+    }
+    for (const auto& key : signingKeys) {
+        if (key.secret.size() < TokenSigner::MIN_SECRET_BYTES) {
+            std::cerr << "Signing key '" << key.id << "' is shorter than "
+                      << TokenSigner::MIN_SECRET_BYTES << " bytes" << std::endl;
         }
+    }
+    AuthMiddleware auth(signingKeys, tokenTtl);
+    
+    // Password hashing runs on its own threads so logins can't take every core,
+    // and fewer logins may wait for it than there are request threads, so a
+    // burst of logins always leaves a request thread for everything else
+    unsigned int hashThreads = std::max(1u, std::thread::hardware_concurrency() / 2);
+    unsigned int hashWaiters = std::max(1u, workerThreads - 1);
+    PasswordHasher hasher(
+        static_cast<int>(std::max(1LL, config.getInt("password_hash_iterations", 600000))),
+        static_cast<size_t>(std::max(1LL, config.getInt("password_hash_threads", hashThreads))),
+        static_cast<size_t>(std::max(1LL, config.getInt("password_hash_queue", 256))),
+        static_cast<size_t>(std::max(1LL, config.getInt("password_hash_waiters", hashWaiters))));
+    
+    // Cache of serialized post responses, sized with post_cache_mb (default 64 MB)
+    size_t postCacheMegabytes = static_cast<size_t>(std::max(0LL, config.getInt("post_cache_mb", 64)));
+    PostCache postCache(postCacheMegabytes * 1024 * 1024);
+    
+    // Per-post update mutexes, striped over a fixed pool so memory stays flat
+    StripedMutex postMutexes("post");
+    
+    // Real-time lock and post change events for WebSocket subscribers
+    NotificationHub notifications;
+    
+    // Post editing lock system; expired locks are evicted by its own thread
+    PostLockTable postLocks;
+    postLocks.setExpiryListener([&notifications](int postId, const PostLock& lock) {
+        notifications.publish(postId, lockEventMessage(postId, "expired", lock));
     });
-    cleanupThread.detach();  // Let it run independently
+    
+    // Verify every pooled connection once a minute and reopen broken ones
+    pool.startHealthChecks(std::chrono::minutes(1));
     
     // Root endpoint
     CROW_ROUTE(app, "/")([](){
         return "Codepen Style Website API";
     });
+    trackRoutes(app, {"/"});
     
-    // Setup all routes from our Routes.h module
-    setupAuthRoutes(app, db, auth);
-    setupPostRoutes(app, db, auth, postMutexes, mutexMapMutex, postLocks, locksMapMutex);
-    setupPostLockRoutes(app, db, auth, postLocks, locksMapMutex);
+    // Setup all routes from our Routes.h module; each module also tracks
+    // its route templates on /metrics
+    setupAuthRoutes(app, pool, writeQueue, auth, hasher);
+    setupPostRoutes(app, pool, writeQueue, auth, postCache, postMutexes, postLocks, notifications);
+    setupPostLockRoutes(app, pool, auth, postLocks, notifications);
+    setupNotificationRoutes(app, pool, auth, postLocks, notifications);
+    setupSearchRoutes(app, pool, auth);
+    setupStatsRoutes(app, pool, writeQueue, postCache, notifications, checkpointer.get());
+    setupMetricsRoutes(app, pool, writeQueue, postCache, postLocks, notifications, hasher, checkpointer.get());
     
-    // Set the port, set the app to run on multiple threads, and run the app
-    app.port(18080).multithreaded().run();
+    // Set the port, run one worker thread per pooled reader, and run the app
+    app.port(18080).concurrency(workerThreads).run();
     
-    // Close the database connection when the program ends
-    sqlite3_close(db);
+    // Background threads are joined and pooled connections closed as their
+    // owners go out of scope
     return 0;
 }
\ No newline at end of file